@@ -0,0 +1,148 @@
+/**
+ * @file basicimage.cpp
+ * Implementation of the BasicImage loaders.
+ */
+
+#include <stdio.h>
+#include <png.h>
+
+#include <iostream>
+
+#include "basicimage.h"
+
+using namespace std;
+
+static void basicimage_err(string const & err)
+{
+	cerr << "[BasicImage]: " << err << endl;
+}
+
+bool readPngSamples16(string const & file_name, int channels, size_t & width, size_t & height, vector<uint16_t> & samples)
+{
+	if(channels < 1 || channels > 4)
+	{
+		basicimage_err("Unsupported channel count");
+		return false;
+	}
+
+	FILE * fp = fopen(file_name.c_str(), "rb");
+	if(!fp)
+	{
+		basicimage_err("Failed to open " + file_name);
+		return false;
+	}
+
+	png_byte header[8];
+	if(fread(header, 1, 8, fp) != 8 || png_sig_cmp(header, 0, 8))
+	{
+		basicimage_err("File is not a valid PNG file");
+		fclose(fp);
+		return false;
+	}
+
+	png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if(!png_ptr)
+	{
+		basicimage_err("Failed to create read struct");
+		fclose(fp);
+		return false;
+	}
+
+	png_infop info_ptr = png_create_info_struct(png_ptr);
+	if(!info_ptr)
+	{
+		basicimage_err("Failed to create info struct");
+		png_destroy_read_struct(&png_ptr, NULL, NULL);
+		fclose(fp);
+		return false;
+	}
+
+	// libpng reports errors by jumping back here; the rows are read
+	// straight into samples, so nothing local needs freeing
+	if(setjmp(png_jmpbuf(png_ptr)))
+	{
+		basicimage_err("Error reading image with libpng");
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		fclose(fp);
+		return false;
+	}
+
+	png_init_io(png_ptr, fp);
+	png_set_sig_bytes(png_ptr, 8);
+	png_read_info(png_ptr, info_ptr);
+
+	// expand everything to 16-bit samples instead of stripping to 8
+	png_byte bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+	png_byte color_type = png_get_color_type(png_ptr, info_ptr);
+	if(color_type == PNG_COLOR_TYPE_PALETTE)
+		png_set_palette_to_rgb(png_ptr);
+	if(color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
+		png_set_expand_gray_1_2_4_to_8(png_ptr);
+	if(bit_depth < 16)
+		png_set_expand_16(png_ptr);
+
+	// then convert to the requested layout
+	bool gray = (color_type & PNG_COLOR_MASK_COLOR) == 0;
+	bool transparency = png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS) != 0;
+	bool alpha = (color_type & PNG_COLOR_MASK_ALPHA) != 0 || transparency;
+	bool wantGray = channels <= 2;
+	bool wantAlpha = channels == 2 || channels == 4;
+
+	if(gray && !wantGray)
+		png_set_gray_to_rgb(png_ptr);
+	if(!gray && wantGray)
+		png_set_rgb_to_gray_fixed(png_ptr, PNG_ERROR_ACTION_NONE, -1, -1);
+	if(transparency && wantAlpha)
+		png_set_tRNS_to_alpha(png_ptr);
+	if(alpha && !wantAlpha)
+		png_set_strip_alpha(png_ptr);
+	if(!alpha && wantAlpha)
+		png_set_add_alpha(png_ptr, 0xffff, PNG_FILLER_AFTER);
+
+	png_read_update_info(png_ptr, info_ptr);
+
+	width = png_get_image_width(png_ptr, info_ptr);
+	height = png_get_image_height(png_ptr, info_ptr);
+	size_t rowSamples = width * channels;
+	if(png_get_rowbytes(png_ptr, info_ptr) != rowSamples * 2)
+	{
+		basicimage_err("Unexpected row layout after conversion");
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		fclose(fp);
+		return false;
+	}
+
+	samples.assign(rowSamples * height, 0);
+	for(size_t y = 0; y < height; y++)
+		png_read_row(png_ptr, (png_bytep) &samples[y * rowSamples], NULL);
+
+	png_read_end(png_ptr, NULL);
+	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+	fclose(fp);
+
+	// PNG stores samples big-endian
+	png_byte const * bytes = (png_byte const *) samples.data();
+	for(size_t i = 0; i < samples.size(); i++)
+		samples[i] = (uint16_t) (bytes[2 * i] << 8 | bytes[2 * i + 1]);
+
+	return true;
+}
+
+BasicImage<uint8_t, 4> toBasicImage(PNG const & source)
+{
+	BasicImage<uint8_t, 4> image(source.width(), source.height());
+	for(size_t y = 0; y < source.height(); y++)
+	{
+		for(size_t x = 0; x < source.width(); x++)
+		{
+			RGBAPixel const & pixel = *source(x, y);
+			Rgba8Pixel & copy = *image(x, y);
+			copy.channel[0] = pixel.red;
+			copy.channel[1] = pixel.green;
+			copy.channel[2] = pixel.blue;
+			copy.channel[3] = pixel.alpha;
+		}
+	}
+
+	return image;
+}
@@ -0,0 +1,170 @@
+/**
+ * @file basicimage.h
+ * Definition of the BasicImage template, an image of BasicPixels, and of
+ * the loaders that fill one from a PNG file without reducing it to 8 bits.
+ */
+
+#ifndef BASICIMAGE_H
+#define BASICIMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "basicpixel.h"
+#include "png.h"
+
+/**
+ * A width by height grid of BasicPixels stored row by row, the
+ * counterpart of PNG for other sample types. Unlike PNG it does not clamp
+ * coordinates: callers stay inside the image.
+ *
+ * @tparam Channel Sample type: uint8_t, uint16_t or float.
+ * @tparam Channels Number of samples per pixel.
+ */
+template <class Channel, int Channels>
+class BasicImage
+{
+	public:
+		typedef BasicPixel<Channel, Channels> Pixel; /**< The pixel type. */
+
+		/**
+		 * Creates an empty image.
+		 */
+		BasicImage() : _width(0), _height(0)
+		{
+			/* nothing */
+		}
+
+		/**
+		 * Creates a width by height image of zero samples.
+		 * @param width Width of the image.
+		 * @param height Height of the image.
+		 */
+		BasicImage(size_t width, size_t height) : _width(width), _height(height), _pixels(width * height, Pixel())
+		{
+			/* nothing */
+		}
+
+		/**
+		 * @param x X coordinate of the pixel.
+		 * @param y Y coordinate of the pixel.
+		 * @return A pointer to the pixel at (x, y).
+		 */
+		Pixel * operator()(size_t x, size_t y)
+		{
+			return &_pixels[_width * y + x];
+		}
+
+		/**
+		 * @param x X coordinate of the pixel.
+		 * @param y Y coordinate of the pixel.
+		 * @return A pointer to the pixel at (x, y).
+		 */
+		Pixel const * operator()(size_t x, size_t y) const
+		{
+			return &_pixels[_width * y + x];
+		}
+
+		/**
+		 * @param other Image to compare with.
+		 * @return Whether both images have the same size and pixels.
+		 */
+		bool operator==(BasicImage const & other) const
+		{
+			return _width == other._width && _height == other._height && _pixels == other._pixels;
+		}
+
+		/**
+		 * @param other Image to compare with.
+		 * @return Whether the images differ.
+		 */
+		bool operator!=(BasicImage const & other) const
+		{
+			return !(*this == other);
+		}
+
+		/**
+		 * @return Width of the image.
+		 */
+		size_t width() const
+		{
+			return _width;
+		}
+
+		/**
+		 * @return Height of the image.
+		 */
+		size_t height() const
+		{
+			return _height;
+		}
+
+		/**
+		 * @return The pixels, row by row, for filling the image from
+		 *  raw data such as a heightmap.
+		 */
+		Pixel * data()
+		{
+			return _pixels.data();
+		}
+
+	private:
+		size_t _width;
+		size_t _height;
+		std::vector<Pixel> _pixels;
+};
+
+/**
+ * Reads a PNG file as 16-bit samples, the way PNG::readFromFile reads it
+ * as 8-bit ones but without stripping the low byte. Images of lower depth
+ * are scaled up (an 8-bit v becomes v * 257), and palettes, gray and
+ * transparency are converted to the requested layout.
+ *
+ * @param file_name Name of the file to read.
+ * @param channels 1 (gray), 2 (gray and alpha), 3 (RGB) or 4 (RGBA).
+ * @param width Receives the width of the image.
+ * @param height Receives the height of the image.
+ * @param samples Receives width * height * channels samples, row by row.
+ * @return Whether the file was read; on failure the outputs are
+ *  unspecified.
+ */
+bool readPngSamples16(std::string const & file_name, int channels, size_t & width, size_t & height,
+	std::vector<uint16_t> & samples);
+
+/**
+ * Reads a PNG file into an image of 16-bit pixels (see readPngSamples16).
+ * @param file_name Name of the file to read.
+ * @param image Receives the image; left unchanged on failure.
+ * @return Whether the file was read.
+ */
+template <int Channels>
+bool readPng16(std::string const & file_name, BasicImage<uint16_t, Channels> & image)
+{
+	static_assert(Channels >= 1 && Channels <= 4, "PNG files hold 1 to 4 channels");
+
+	size_t width;
+	size_t height;
+	std::vector<uint16_t> samples;
+	if(!readPngSamples16(file_name, Channels, width, height, samples))
+		return false;
+
+	BasicImage<uint16_t, Channels> result(width, height);
+	for(size_t i = 0; i < width * height; i++)
+	{
+		for(int c = 0; c < Channels; c++)
+			result.data()[i].channel[c] = samples[i * Channels + c];
+	}
+	image = result;
+	return true;
+}
+
+/**
+ * Copies an 8-bit PNG into an image of Rgba8Pixels.
+ * @param source The image to copy.
+ * @return The copy.
+ */
+BasicImage<uint8_t, 4> toBasicImage(PNG const & source);
+
+#endif // BASICIMAGE_H
@@ -0,0 +1,173 @@
+/**
+ * @file basicpixel.h
+ * Definition of the BasicPixel template, a pixel of any number of
+ * channels of any sample type, and of the per-type kernels BasicQuadtree
+ * averages and compares pixels with.
+ *
+ * RGBAPixel and Quadtree stay the 8-bit RGBA path; BasicPixel serves the
+ * images that do not fit it, such as 16-bit scientific captures and
+ * floating-point heightmaps.
+ */
+
+#ifndef BASICPIXEL_H
+#define BASICPIXEL_H
+
+#include <cstdint>
+
+/**
+ * A pixel of Channels samples of type Channel. For color images the
+ * samples are red, green, blue and (if there are four) alpha; alpha is
+ * treated like any other sample.
+ *
+ * @tparam Channel Sample type: uint8_t, uint16_t or float.
+ * @tparam Channels Number of samples per pixel.
+ */
+template <class Channel, int Channels>
+struct BasicPixel
+{
+	Channel channel[Channels]; /**< The samples, in file order. */
+
+	/**
+	 * @param other Pixel to compare with.
+	 * @return Whether every sample is equal.
+	 */
+	bool operator==(BasicPixel const & other) const
+	{
+		for(int c = 0; c < Channels; c++)
+		{
+			if(channel[c] != other.channel[c])
+				return false;
+		}
+		return true;
+	}
+
+	/**
+	 * @param other Pixel to compare with.
+	 * @return Whether any sample differs.
+	 */
+	bool operator!=(BasicPixel const & other) const
+	{
+		return !(*this == other);
+	}
+};
+
+typedef BasicPixel<uint8_t, 4> Rgba8Pixel;   /**< The layout of RGBAPixel. */
+typedef BasicPixel<uint16_t, 4> Rgba16Pixel; /**< 16-bit color with alpha. */
+typedef BasicPixel<uint16_t, 1> Gray16Pixel; /**< 16-bit grayscale. */
+typedef BasicPixel<float, 1> HeightPixel;    /**< One floating-point sample, such as a height. */
+
+/**
+ * The arithmetic BasicQuadtree does on one sample type: the type four
+ * samples are summed in, the type squared distances are measured in, and
+ * how a sum of four becomes their average. Only the specializations below
+ * exist, so an unsupported sample type fails to compile.
+ */
+template <class Channel>
+struct ChannelTraits;
+
+/**
+ * 8-bit samples: truncated integer averages and int distances, the same
+ * arithmetic Quadtree does, so an Rgba8Pixel tree matches a Quadtree.
+ */
+template <>
+struct ChannelTraits<uint8_t>
+{
+	typedef int Sum;      /**< Holds four samples. */
+	typedef int Distance; /**< Holds four squared differences. */
+
+	static Distance const maxSquare = 255 * 255; /**< Largest squared difference of two samples. */
+
+	/**
+	 * @param sum Total of four samples.
+	 * @return Their truncated average.
+	 */
+	static uint8_t average(Sum sum)
+	{
+		return sum / 4;
+	}
+};
+
+/**
+ * 16-bit samples: truncated integer averages; a squared difference can
+ * reach 2^32, so distances are 64-bit.
+ */
+template <>
+struct ChannelTraits<uint16_t>
+{
+	typedef uint32_t Sum;     /**< Holds four samples. */
+	typedef int64_t Distance; /**< Holds the squared differences of any number of samples. */
+
+	static Distance const maxSquare = (Distance) 65535 * 65535; /**< Largest squared difference of two samples. */
+
+	/**
+	 * @param sum Total of four samples.
+	 * @return Their truncated average.
+	 */
+	static uint16_t average(Sum sum)
+	{
+		return sum / 4;
+	}
+};
+
+/**
+ * Floating-point samples: exact averages and double distances. Samples
+ * are unbounded, so there is no maxSquare.
+ */
+template <>
+struct ChannelTraits<float>
+{
+	typedef float Sum;       /**< Holds four samples. */
+	typedef double Distance; /**< Squared differences, summed without float rounding. */
+
+	/**
+	 * @param sum Total of four samples.
+	 * @return Their average.
+	 */
+	static float average(Sum sum)
+	{
+		return sum * 0.25f;
+	}
+};
+
+/**
+ * Averages four pixels sample by sample.
+ * @param colors The four pixels (northwest, northeast, southwest,
+ *  southeast).
+ * @return Their average, rounded as ChannelTraits<Channel> rounds.
+ */
+template <class Channel, int Channels>
+BasicPixel<Channel, Channels> averagePixels(BasicPixel<Channel, Channels> const colors[4])
+{
+	typedef ChannelTraits<Channel> Traits;
+	BasicPixel<Channel, Channels> result;
+	for(int c = 0; c < Channels; c++)
+	{
+		typename Traits::Sum sum = (typename Traits::Sum) colors[0].channel[c] + colors[1].channel[c]
+			+ colors[2].channel[c] + colors[3].channel[c];
+		result.channel[c] = Traits::average(sum);
+	}
+	return result;
+}
+
+/**
+ * @param first One pixel.
+ * @param second The other pixel.
+ * @return The sum over the samples of the squared differences (for
+ *  Rgba8Pixel, the RgbMetric distance plus the squared alpha difference
+ *  Quadtree prunes with).
+ */
+template <class Channel, int Channels>
+typename ChannelTraits<Channel>::Distance pixelDistance(BasicPixel<Channel, Channels> const & first,
+	BasicPixel<Channel, Channels> const & second)
+{
+	typedef typename ChannelTraits<Channel>::Distance Distance;
+	Distance total = 0;
+	for(int c = 0; c < Channels; c++)
+	{
+		Distance difference = (Distance) first.channel[c] - (Distance) second.channel[c];
+		total += difference * difference;
+	}
+	return total;
+}
+
+#endif // BASICPIXEL_H
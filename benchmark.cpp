@@ -0,0 +1,674 @@
+/**
+ * @file benchmark.cpp
+ * Google Benchmark driver for the Quadtree library.
+ *
+ * Every public hot path (buildTree, buildPruned, updateRegion, getPixel,
+ * regionAverage, decompress, decompressInto, the tile cache, the leaf
+ * iterator, clockwiseRotate, rotate, flipHorizontal, prune, pruneSize with
+ * each color metric, idealPrune, pruneToLeafCount, pruned views, quality,
+ * the compact and progressive formats, copy construction, clear,
+ * operator== and storing in a QuadtreeStore) is measured on square images
+ * from 64x64 up to --max_size (default 2048, at most 8192; a full 8192x8192
+ * tree needs several GiB) for four kinds of content: flat, gradient, noise
+ * and a synthetic photo-like image. The tile cases build and decode every
+ * 32x32 tile of the image, with Quadtree and with FixedQuadtree; the
+ * 16-bit cases run BasicQuadtree on the image scaled to 16-bit samples.
+ *
+ * Cases are named "<operation>/<content>/<size>". To record a baseline
+ * that can be diffed between builds (for instance with Google
+ * Benchmark's tools/compare.py):
+ *
+ *   quadtree_bench --benchmark_out=base.json --benchmark_out_format=json
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "png.h"
+#include "quadtree.h"
+#include "quadtree_basic.h"
+#include "quadtree_cache.h"
+#include "quadtree_fixed.h"
+#include "quadtree_progressive.h"
+#include "quadtree_store.h"
+#include "quadtree_traversal.h"
+#include "quadtree_view.h"
+
+using namespace std;
+
+namespace
+{
+
+enum Content { FLAT, GRADIENT, NOISE, PHOTO };
+
+char const * const contentNames[] = { "flat", "gradient", "noise", "photo" };
+
+//tolerance used by the prune and pruneSize cases
+int const benchTolerance = 1000;
+
+//small deterministic generator so runs are comparable between builds
+struct XorShift
+{
+	uint32_t state;
+
+	XorShift(uint32_t seed) : state(seed)
+	{
+		/* nothing */
+	}
+
+	uint32_t next()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+};
+
+uint8_t clampByte(double value)
+{
+	return value < 0 ? 0 : (value > 255 ? 255 : (uint8_t) value);
+}
+
+//smooth low-frequency shading, a few hard-edged shapes and a little sensor noise
+RGBAPixel photoPixel(int x, int y, int size, XorShift & rng)
+{
+	double u = (double) x / size;
+	double v = (double) y / size;
+	double shade = 0.5 + 0.25 * sin(u * 6.3 + v * 2.1) + 0.15 * cos(v * 9.7 - u * 3.3);
+	double red = 200 * shade;
+	double green = 170 * shade + 40 * u;
+	double blue = 120 * shade + 80 * v;
+
+	if((u - 0.3) * (u - 0.3) + (v - 0.6) * (v - 0.6) < 0.02){
+		red = 230;
+		green = 60;
+		blue = 40;
+	}
+	if(u > 0.55 && u < 0.85 && v > 0.15 && v < 0.4){
+		red *= 0.4;
+		green *= 0.5;
+		blue = 210;
+	}
+
+	int noise = (int)(rng.next() % 9) - 4;
+	return RGBAPixel(clampByte(red + noise), clampByte(green + noise), clampByte(blue + noise));
+}
+
+PNG makeImage(Content content, int size)
+{
+	PNG image(size, size);
+	XorShift rng(2463534242u);
+
+	for(int y = 0; y < size; y++){
+		for(int x = 0; x < size; x++){
+			RGBAPixel & pixel = *image(x, y);
+			switch(content){
+				case FLAT:
+					pixel = RGBAPixel(90, 140, 200);
+					break;
+				case GRADIENT:
+					pixel = RGBAPixel((long) x * 255 / size, (long) y * 255 / size, (long)(x + y) * 127 / size);
+					break;
+				case NOISE: {
+					uint32_t bits = rng.next();
+					pixel = RGBAPixel(bits & 0xff, (bits >> 8) & 0xff, (bits >> 16) & 0xff);
+					break;
+				}
+				case PHOTO:
+					pixel = photoPixel(x, y, size, rng);
+					break;
+			}
+		}
+	}
+
+	return image;
+}
+
+//images and full trees are built once per (content, size) and shared by all cases
+PNG const & image(Content content, int size)
+{
+	static map<pair<int, int>, unique_ptr<PNG>> cache;
+	unique_ptr<PNG> & slot = cache[make_pair(content, size)];
+	if(!slot)
+		slot.reset(new PNG(makeImage(content, size)));
+	return *slot;
+}
+
+Quadtree const & tree(Content content, int size)
+{
+	static map<pair<int, int>, unique_ptr<Quadtree>> cache;
+	unique_ptr<Quadtree> & slot = cache[make_pair(content, size)];
+	if(!slot)
+		slot.reset(new Quadtree(image(content, size), size));
+	return *slot;
+}
+
+void pixelsProcessed(benchmark::State & state, int size)
+{
+	state.SetItemsProcessed(state.iterations() * (int64_t) size * size);
+}
+
+void BM_BuildTree(benchmark::State & state, Content content, int size)
+{
+	PNG const & source = image(content, size);
+	Quadtree built;
+	for(auto _ : state){
+		built.buildTree(source, size);
+	}
+	pixelsProcessed(state, size);
+}
+
+//builds the tree the prune case below produces, without the nodes it removes
+void BM_BuildPruned(benchmark::State & state, Content content, int size)
+{
+	PNG const & source = image(content, size);
+	Quadtree built;
+	for(auto _ : state){
+		built.buildPruned(source, size, benchTolerance);
+	}
+	pixelsProcessed(state, size);
+}
+
+//re-reads a 16x16 block in the middle of the image
+void BM_UpdateRegion(benchmark::State & state, Content content, int size)
+{
+	PNG const & source = image(content, size);
+	Quadtree updated(tree(content, size));
+	for(auto _ : state){
+		updated.updateRegion(source, size/2 - 8, size/2 - 8, 16, 16);
+	}
+	state.SetItemsProcessed(state.iterations() * 16 * 16);
+}
+
+void BM_GetPixel(benchmark::State & state, Content content, int size)
+{
+	Quadtree const & source = tree(content, size);
+	XorShift rng(88172645u);
+	vector<pair<int, int>> points(4096);
+	for(size_t i = 0; i < points.size(); i++){
+		points[i] = make_pair(rng.next() % size, rng.next() % size);
+	}
+
+	for(auto _ : state){
+		for(size_t i = 0; i < points.size(); i++){
+			benchmark::DoNotOptimize(source.getPixel(points[i].first, points[i].second));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * points.size());
+}
+
+void BM_RegionAverage(benchmark::State & state, Content content, int size)
+{
+	Quadtree const & source = tree(content, size);
+	XorShift rng(88172645u);
+	vector<pair<int, int>> corners(256);
+	for(size_t i = 0; i < corners.size(); i++){
+		corners[i] = make_pair(rng.next() % (size / 2), rng.next() % (size / 2));
+	}
+
+	for(auto _ : state){
+		for(size_t i = 0; i < corners.size(); i++){
+			benchmark::DoNotOptimize(source.regionAverage(corners[i].first, corners[i].second, size / 2, size / 2));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * corners.size());
+}
+
+void BM_Decompress(benchmark::State & state, Content content, int size)
+{
+	Quadtree const & source = tree(content, size);
+	for(auto _ : state){
+		benchmark::DoNotOptimize(source.decompress());
+	}
+	pixelsProcessed(state, size);
+}
+
+//decompresses into a preallocated RGBA8 frame, with no PNG allocated or copied
+void BM_DecompressInto(benchmark::State & state, Content content, int size)
+{
+	Quadtree const & source = tree(content, size);
+	vector<uint8_t> frame((size_t) size * size * 4);
+	for(auto _ : state){
+		source.decompressInto(frame.data(), (size_t) size * 4, Quadtree::RGBA8);
+		benchmark::DoNotOptimize(frame.data());
+	}
+	pixelsProcessed(state, size);
+}
+
+//a viewer's repeated requests: the whole image at every zoom level, through a cache large enough to keep them
+void BM_TileCache(benchmark::State & state, Content content, int size)
+{
+	Quadtree const & source = tree(content, size);
+	QuadtreeTileCache cache((size_t) size * size * sizeof(RGBAPixel) * 2);
+	int levels = 0;
+	while((1 << levels) <= size){
+		levels++;
+	}
+
+	for(auto _ : state){
+		for(int level = 0; level < levels; level++){
+			benchmark::DoNotOptimize(cache.get(source, level));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * levels);
+	state.counters["hitRate"] = (double) cache.counters().hits / (cache.counters().hits + cache.counters().misses);
+}
+
+//walks the leaves with the iterator, as an exporter would
+void BM_Leaves(benchmark::State & state, Content content, int size)
+{
+	Quadtree const & source = tree(content, size);
+	for(auto _ : state){
+		long area = 0;
+		for(QuadtreeBlock const & leaf : QuadtreeLeaves(source)){
+			area += (long) leaf.resolution * leaf.resolution;
+		}
+		benchmark::DoNotOptimize(area);
+	}
+	pixelsProcessed(state, size);
+}
+
+void BM_ClockwiseRotate(benchmark::State & state, Content content, int size)
+{
+	Quadtree rotated(tree(content, size));
+	for(auto _ : state){
+		rotated.clockwiseRotate();
+	}
+	pixelsProcessed(state, size);
+}
+
+void BM_Rotate180(benchmark::State & state, Content content, int size)
+{
+	Quadtree rotated(tree(content, size));
+	for(auto _ : state){
+		rotated.rotate(2);
+	}
+	pixelsProcessed(state, size);
+}
+
+void BM_FlipHorizontal(benchmark::State & state, Content content, int size)
+{
+	Quadtree flipped(tree(content, size));
+	for(auto _ : state){
+		flipped.flipHorizontal();
+	}
+	pixelsProcessed(state, size);
+}
+
+void BM_Prune(benchmark::State & state, Content content, int size)
+{
+	Quadtree const & source = tree(content, size);
+	for(auto _ : state){
+		state.PauseTiming();
+		Quadtree * pruned = new Quadtree(source);
+		state.ResumeTiming();
+
+		pruned->prune(benchTolerance);
+
+		state.PauseTiming();
+		delete pruned;
+		state.ResumeTiming();
+	}
+	pixelsProcessed(state, size);
+}
+
+void BM_PruneSize(benchmark::State & state, Content content, int size)
+{
+	Quadtree const & source = tree(content, size);
+	for(auto _ : state){
+		benchmark::DoNotOptimize(source.pruneSize(benchTolerance));
+	}
+	pixelsProcessed(state, size);
+}
+
+//pruneSize with one of the perceptual metrics, to compare against the RGB case above
+template <class Metric>
+void BM_PruneSizeWith(benchmark::State & state, Content content, int size)
+{
+	Quadtree const & source = tree(content, size);
+	for(auto _ : state){
+		benchmark::DoNotOptimize(source.pruneSize<Metric>(benchTolerance));
+	}
+	pixelsProcessed(state, size);
+}
+
+void BM_IdealPrune(benchmark::State & state, Content content, int size)
+{
+	Quadtree const & source = tree(content, size);
+	int leaves = size * size / 16;
+	for(auto _ : state){
+		benchmark::DoNotOptimize(source.idealPrune(leaves));
+	}
+	pixelsProcessed(state, size);
+}
+
+void BM_PruneToLeafCount(benchmark::State & state, Content content, int size)
+{
+	Quadtree const & source = tree(content, size);
+	int leaves = size * size / 16;
+	for(auto _ : state){
+		state.PauseTiming();
+		Quadtree * pruned = new Quadtree(source);
+		state.ResumeTiming();
+
+		pruned->pruneToLeafCount(leaves);
+
+		state.PauseTiming();
+		delete pruned;
+		state.ResumeTiming();
+	}
+	pixelsProcessed(state, size);
+}
+
+//builds a view at the prune tolerance and renders it, leaving the tree alone
+void BM_PrunedView(benchmark::State & state, Content content, int size)
+{
+	Quadtree const & source = tree(content, size);
+	for(auto _ : state){
+		QuadtreeView view(source, benchTolerance);
+		benchmark::DoNotOptimize(view.decompress());
+	}
+	pixelsProcessed(state, size);
+}
+
+//PSNR of the tree as it would be after the prune, without SSIM
+void BM_Quality(benchmark::State & state, Content content, int size)
+{
+	Quadtree const & source = tree(content, size);
+	PNG const & original = image(content, size);
+	for(auto _ : state){
+		benchmark::DoNotOptimize(source.pruneQuality(original, benchTolerance));
+	}
+	pixelsProcessed(state, size);
+}
+
+//writes the pruned tree in the compact format and reads it back, reporting the size against write()'s
+void BM_Compact(benchmark::State & state, Content content, int size)
+{
+	Quadtree pruned(tree(content, size));
+	pruned.prune(benchTolerance);
+	ostringstream raw;
+	pruned.write(raw);
+
+	size_t bytes = 0;
+	for(auto _ : state){
+		ostringstream out;
+		pruned.writeCompact(out);
+		string const data = out.str();
+		bytes = data.size();
+
+		istringstream in(data);
+		Quadtree read;
+		benchmark::DoNotOptimize(read.read(in));
+	}
+	pixelsProcessed(state, size);
+	state.counters["ratio"] = (double) raw.str().size() / bytes;
+}
+
+//writes the pruned tree in the progressive format and feeds it to a reader in 4 KiB pieces, as from a socket
+void BM_Progressive(benchmark::State & state, Content content, int size)
+{
+	Quadtree pruned(tree(content, size));
+	pruned.prune(benchTolerance);
+
+	for(auto _ : state){
+		ostringstream out;
+		pruned.writeProgressive(out);
+		string const data = out.str();
+
+		QuadtreeProgressiveReader reader;
+		for(size_t offset = 0; offset < data.size(); offset += 4096){
+			reader.feed(data.data() + offset, min<size_t>(4096, data.size() - offset));
+		}
+		benchmark::DoNotOptimize(reader.image());
+	}
+	pixelsProcessed(state, size);
+}
+
+//compares with an equal tree built separately, which shares no nodes, so the hashes cannot settle it
+void BM_Equal(benchmark::State & state, Content content, int size)
+{
+	Quadtree const & source = tree(content, size);
+	Quadtree other(image(content, size), size);
+	for(auto _ : state){
+		benchmark::DoNotOptimize(source == other);
+	}
+	pixelsProcessed(state, size);
+}
+
+//deduplicates a copy of the tree in an empty store
+void BM_Intern(benchmark::State & state, Content content, int size)
+{
+	Quadtree const & source = tree(content, size);
+	for(auto _ : state){
+		state.PauseTiming();
+		Quadtree * copy = new Quadtree(source);
+		QuadtreeStore * store = new QuadtreeStore();
+		state.ResumeTiming();
+
+		store->intern(*copy);
+
+		state.PauseTiming();
+		delete store;
+		delete copy;
+		state.ResumeTiming();
+	}
+	pixelsProcessed(state, size);
+}
+
+//the image with each sample v scaled to v * 257, as a 16-bit PNG of it would load
+BasicImage<uint16_t, 4> const & image16(Content content, int size)
+{
+	static map<pair<int, int>, unique_ptr<BasicImage<uint16_t, 4>>> cache;
+	unique_ptr<BasicImage<uint16_t, 4>> & slot = cache[make_pair(content, size)];
+	if(!slot){
+		PNG const & source = image(content, size);
+		slot.reset(new BasicImage<uint16_t, 4>(size, size));
+		for(int y = 0; y < size; y++){
+			for(int x = 0; x < size; x++){
+				RGBAPixel const & pixel = *source(x, y);
+				uint16_t const samples[4] = {pixel.red, pixel.green, pixel.blue, pixel.alpha};
+				for(int c = 0; c < 4; c++)
+					(*slot)(x, y)->channel[c] = samples[c] * 257;
+			}
+		}
+	}
+	return *slot;
+}
+
+void BM_BuildTree16(benchmark::State & state, Content content, int size)
+{
+	BasicImage<uint16_t, 4> const & source = image16(content, size);
+	for(auto _ : state){
+		BasicQuadtree<uint16_t, 4> built(source, size);
+		benchmark::DoNotOptimize(built.getResolution());
+	}
+	pixelsProcessed(state, size);
+}
+
+//the prune case on the 16-bit tree, with the tolerance scaled by 257^2 to match
+void BM_Prune16(benchmark::State & state, Content content, int size)
+{
+	BasicQuadtree<uint16_t, 4> const source(image16(content, size), size);
+	for(auto _ : state){
+		state.PauseTiming();
+		BasicQuadtree<uint16_t, 4> * pruned = new BasicQuadtree<uint16_t, 4>(source);
+		state.ResumeTiming();
+
+		pruned->prune((int64_t) benchTolerance * 257 * 257);
+
+		state.PauseTiming();
+		delete pruned;
+		state.ResumeTiming();
+	}
+	pixelsProcessed(state, size);
+}
+
+//side of the tiles the tile cases cut the image into
+int const tileLog2Size = 5;
+int const tileSize = 1 << tileLog2Size;
+
+//builds and decodes every tile with a Quadtree, each tile cut out of the image beforehand
+void BM_Tiles(benchmark::State & state, Content content, int size)
+{
+	PNG const & source = image(content, size);
+	vector<PNG> tiles;
+	for(int y = 0; y < size; y += tileSize){
+		for(int x = 0; x < size; x += tileSize){
+			PNG tile(tileSize, tileSize);
+			for(int j = 0; j < tileSize; j++)
+				for(int i = 0; i < tileSize; i++)
+					*tile(i, j) = *source(x + i, y + j);
+			tiles.push_back(tile);
+		}
+	}
+
+	Quadtree built;
+	for(auto _ : state){
+		for(PNG const & tile : tiles){
+			built.buildTree(tile, tileSize);
+			benchmark::DoNotOptimize(built.decompress());
+		}
+	}
+	pixelsProcessed(state, size);
+}
+
+//builds and decodes every tile with a FixedQuadtree, reading the tiles straight from the image
+void BM_FixedTiles(benchmark::State & state, Content content, int size)
+{
+	PNG const & source = image(content, size);
+	FixedQuadtree<tileLog2Size> built;
+	for(auto _ : state){
+		for(int y = 0; y < size; y += tileSize){
+			for(int x = 0; x < size; x += tileSize){
+				built.buildTile(source, x, y);
+				benchmark::DoNotOptimize(built.decompress());
+			}
+		}
+	}
+	pixelsProcessed(state, size);
+}
+
+void BM_Copy(benchmark::State & state, Content content, int size)
+{
+	Quadtree const & source = tree(content, size);
+	for(auto _ : state){
+		Quadtree * copy = new Quadtree(source);
+		benchmark::DoNotOptimize(copy);
+
+		state.PauseTiming();
+		delete copy;
+		state.ResumeTiming();
+	}
+	pixelsProcessed(state, size);
+}
+
+//clear is private; assigning an empty tree frees every node through it
+void BM_Clear(benchmark::State & state, Content content, int size)
+{
+	Quadtree const & source = tree(content, size);
+	Quadtree const empty;
+	for(auto _ : state){
+		state.PauseTiming();
+		Quadtree * cleared = new Quadtree(source);
+		state.ResumeTiming();
+
+		*cleared = empty;
+
+		state.PauseTiming();
+		delete cleared;
+		state.ResumeTiming();
+	}
+	pixelsProcessed(state, size);
+}
+
+typedef void (*Case)(benchmark::State &, Content, int);
+
+void registerCase(char const * name, Case function, int maxSize)
+{
+	for(int content = FLAT; content <= PHOTO; content++){
+		for(int size = 64; size <= maxSize; size *= 2){
+			string label = string(name) + "/" + contentNames[content] + "/" + to_string(size);
+			benchmark::RegisterBenchmark(label.c_str(), function, (Content) content, size)
+				->Unit(benchmark::kMicrosecond);
+		}
+	}
+}
+
+//removes --max_size=N from the arguments, returning N (or the default)
+int takeMaxSize(int & argc, char ** argv)
+{
+	int maxSize = 2048;
+	for(int i = 1; i < argc; i++){
+		if(strncmp(argv[i], "--max_size=", 11) == 0){
+			maxSize = atoi(argv[i] + 11);
+			for(int j = i; j + 1 < argc; j++)
+				argv[j] = argv[j + 1];
+			argc--;
+			break;
+		}
+	}
+
+	if(maxSize > 8192)
+		maxSize = 8192;
+	return maxSize;
+}
+
+}
+
+int main(int argc, char ** argv)
+{
+	int maxSize = takeMaxSize(argc, argv);
+
+	registerCase("buildTree", BM_BuildTree, maxSize);
+	registerCase("buildPruned", BM_BuildPruned, maxSize);
+	registerCase("updateRegion", BM_UpdateRegion, maxSize);
+	registerCase("getPixel", BM_GetPixel, maxSize);
+	registerCase("regionAverage", BM_RegionAverage, maxSize);
+	registerCase("decompress", BM_Decompress, maxSize);
+	registerCase("decompressInto", BM_DecompressInto, maxSize);
+	registerCase("tileCache", BM_TileCache, maxSize);
+	registerCase("leaves", BM_Leaves, maxSize);
+	registerCase("clockwiseRotate", BM_ClockwiseRotate, maxSize);
+	registerCase("rotate180", BM_Rotate180, maxSize);
+	registerCase("flipHorizontal", BM_FlipHorizontal, maxSize);
+	registerCase("prune", BM_Prune, maxSize);
+	registerCase("pruneSize", BM_PruneSize, maxSize);
+	registerCase("pruneSizeLuma", BM_PruneSizeWith<LumaRgbMetric>, maxSize);
+	registerCase("pruneSizeYCbCr", BM_PruneSizeWith<YCbCrMetric>, maxSize);
+	registerCase("pruneSizeLab", BM_PruneSizeWith<LabMetric>, maxSize);
+	registerCase("idealPrune", BM_IdealPrune, maxSize);
+	registerCase("pruneToLeafCount", BM_PruneToLeafCount, maxSize);
+	registerCase("prunedView", BM_PrunedView, maxSize);
+	registerCase("quality", BM_Quality, maxSize);
+	registerCase("compact", BM_Compact, maxSize);
+	registerCase("progressive", BM_Progressive, maxSize);
+	registerCase("copy", BM_Copy, maxSize);
+	registerCase("clear", BM_Clear, maxSize);
+	registerCase("equal", BM_Equal, maxSize);
+	registerCase("intern", BM_Intern, maxSize);
+	registerCase("tiles", BM_Tiles, maxSize);
+	registerCase("fixedTiles", BM_FixedTiles, maxSize);
+	registerCase("buildTree16", BM_BuildTree16, maxSize);
+	registerCase("prune16", BM_Prune16, maxSize);
+
+	benchmark::Initialize(&argc, argv);
+	if(benchmark::ReportUnrecognizedArguments(argc, argv))
+		return 1;
+
+	benchmark::AddCustomContext("max_size", to_string(maxSize));
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -0,0 +1,171 @@
+/**
+ * @file colormetric.h
+ * Color distance metrics that Quadtree's prune family can be
+ * instantiated with.
+ *
+ * Each metric is a stateless struct with a static distance() between the
+ * red, green and blue of two pixels (alpha is handled by Quadtree) and a
+ * maxDistance bound for idealPrune's search. Distances are squared and on
+ * roughly the scale of the plain RGB one, so tolerances carry over; the
+ * floating-point metrics round up, so only identical colors are at
+ * distance 0. Metrics are template arguments rather than virtual
+ * functions, so the default RgbMetric compiles to the same code as a
+ * hard-wired distance.
+ */
+
+#ifndef COLORMETRIC_H
+#define COLORMETRIC_H
+
+#include <cmath>
+
+#include "rgbapixel.h"
+
+/**
+ * Unweighted squared RGB distance; the default, and the metric the
+ * Quadtree has always used.
+ */
+struct RgbMetric
+{
+	static int const maxDistance = 3 * 255 * 255; /**< Largest possible distance. */
+
+	/**
+	 * @param first One color.
+	 * @param second The other color.
+	 * @return dr^2 + dg^2 + db^2.
+	 */
+	static int distance(RGBAPixel const & first, RGBAPixel const & second)
+	{
+		int red = first.red - second.red;
+		int green = first.green - second.green;
+		int blue = first.blue - second.blue;
+		return red * red + green * green + blue * blue;
+	}
+};
+
+/**
+ * Squared RGB distance with each channel weighted by its share of luma
+ * (0.299, 0.587, 0.114, scaled to sum to 3), so green errors count about
+ * five times as much as blue ones.
+ */
+struct LumaRgbMetric
+{
+	static int const maxDistance = 3 * 255 * 255; /**< Largest possible distance. */
+
+	/**
+	 * @param first One color.
+	 * @param second The other color.
+	 * @return The luma-weighted squared distance.
+	 */
+	static int distance(RGBAPixel const & first, RGBAPixel const & second)
+	{
+		int red = first.red - second.red;
+		int green = first.green - second.green;
+		int blue = first.blue - second.blue;
+		//weights 299, 587 and 114 per mille, times three
+		return (897 * red * red + 1761 * green * green + 342 * blue * blue + 999) / 1000;
+	}
+};
+
+/**
+ * Squared distance in YCbCr (BT.601) with the chroma differences counted
+ * at a quarter of the luma difference, the same trade-off 4:2:0 chroma
+ * subsampling makes.
+ */
+struct YCbCrMetric
+{
+	static int const maxDistance = 2 * 255 * 255; /**< Bound on the distance (luma 255^2, chroma at most 2 * 255^2 / 4). */
+
+	/**
+	 * @param first One color.
+	 * @param second The other color.
+	 * @return dY^2 + (dCb^2 + dCr^2) / 4, rounded up.
+	 */
+	static int distance(RGBAPixel const & first, RGBAPixel const & second)
+	{
+		double red = first.red - second.red;
+		double green = first.green - second.green;
+		double blue = first.blue - second.blue;
+
+		//the transform is linear, so it can be applied to the difference
+		double luma = 0.299 * red + 0.587 * green + 0.114 * blue;
+		double cb = -0.168736 * red - 0.331264 * green + 0.5 * blue;
+		double cr = 0.5 * red - 0.418688 * green - 0.081312 * blue;
+		return (int) std::ceil(luma * luma + (cb * cb + cr * cr) / 4 - 1e-9);
+	}
+};
+
+/**
+ * Squared CIE76 color difference (delta E squared) in CIE L*a*b*, taking
+ * the pixels as sRGB with a D65 white point. A delta E of about 2.3 is
+ * the smallest difference most people notice, so useful tolerances are
+ * far smaller than with the RGB metrics.
+ */
+struct LabMetric
+{
+	static int const maxDistance = 100 * 100 + 2 * 256 * 256; /**< Bound on the distance (L* spans 100, a* and b* less than 256 each). */
+
+	/**
+	 * @param first One color.
+	 * @param second The other color.
+	 * @return dL^2 + da^2 + db^2, rounded up.
+	 */
+	static int distance(RGBAPixel const & first, RGBAPixel const & second)
+	{
+		double firstLab[3], secondLab[3];
+		toLab(first, firstLab);
+		toLab(second, secondLab);
+
+		double l = firstLab[0] - secondLab[0];
+		double a = firstLab[1] - secondLab[1];
+		double b = firstLab[2] - secondLab[2];
+		return (int) std::ceil(l * l + a * a + b * b - 1e-9);
+	}
+
+	/**
+	 * Converts a pixel to L*a*b*.
+	 * @param pixel The sRGB color.
+	 * @param lab Receives L*, a* and b*.
+	 */
+	static void toLab(RGBAPixel const & pixel, double lab[3])
+	{
+		double red = linear(pixel.red);
+		double green = linear(pixel.green);
+		double blue = linear(pixel.blue);
+
+		//linear sRGB to XYZ, relative to the D65 white
+		double x = labCurve((0.4124564 * red + 0.3575761 * green + 0.1804375 * blue) / 0.95047);
+		double y = labCurve(0.2126729 * red + 0.7151522 * green + 0.0721750 * blue);
+		double z = labCurve((0.0193339 * red + 0.1191920 * green + 0.9503041 * blue) / 1.08883);
+
+		lab[0] = 116 * y - 16;
+		lab[1] = 500 * (x - y);
+		lab[2] = 200 * (y - z);
+	}
+
+	private:
+		//sRGB decoding, tabulated once since it costs a pow per channel
+		static double linear(uint8_t value)
+		{
+			static double const * const table = makeLinearTable();
+			return table[value];
+		}
+
+		static double const * makeLinearTable()
+		{
+			static double table[256];
+			for(int i = 0; i < 256; i++)
+			{
+				double v = i / 255.0;
+				table[i] = (v <= 0.04045) ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+			}
+			return table;
+		}
+
+		static double labCurve(double t)
+		{
+			double const delta = 6.0 / 29.0;
+			return (t > delta * delta * delta) ? std::cbrt(t) : t / (3 * delta * delta) + 4.0 / 29.0;
+		}
+};
+
+#endif // COLORMETRIC_H
@@ -0,0 +1,45 @@
+/**
+ * @file idealprune.h
+ * The tolerance search behind idealPrune(), shared by Quadtree,
+ * FixedQuadtree and BasicQuadtree so that the three trees settle on the
+ * same tolerance for the same leaves.
+ */
+
+#ifndef IDEALPRUNE_H
+#define IDEALPRUNE_H
+
+/**
+ * Binary search for the smallest tolerance in [lower, upper] whose prune
+ * leaves no more than numLeaves leaves, given that the leaf count never
+ * grows with the tolerance. Only the leaf counts of the tree are used, so
+ * any tree with a pruneSize() can share it.
+ *
+ * @param pruneSize Callable taking a tolerance and returning the number
+ *  of leaves a prune with it would leave (0 for a negative tolerance).
+ * @param lower Smallest tolerance to consider.
+ * @param upper Largest tolerance to consider.
+ * @param numLeaves The number of leaves wanted.
+ * @return The tolerance found; lower once the range is exhausted.
+ */
+template <class Tolerance, class PruneSize>
+Tolerance idealPruneSearch(PruneSize const & pruneSize, Tolerance lower, Tolerance upper, int numLeaves)
+{
+	if(lower > upper)
+		return lower;
+
+	Tolerance middle = (lower + upper) / 2;
+	int leaves = pruneSize(middle);
+	if(leaves == numLeaves)
+	{
+		// a smaller tolerance may leave as many leaves; look for it from 0
+		if(leaves == pruneSize(middle - 1))
+			return idealPruneSearch(pruneSize, Tolerance(0), middle - 1, numLeaves);
+		return middle;
+	}
+
+	if(leaves > numLeaves)
+		return idealPruneSearch(pruneSize, middle + 1, upper, numLeaves);
+	return idealPruneSearch(pruneSize, lower, middle - 1, numLeaves);
+}
+
+#endif // IDEALPRUNE_H
@@ -0,0 +1,658 @@
+/**
+ * @file main.cpp
+ * Command line front end for the Quadtree library: compresses PNG images
+ * into serialized trees and back, and reports per-phase throughput so
+ * that capacity tests can be run without writing any C++.
+ */
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "pipeline.h"
+#include "png.h"
+#include "quadtree.h"
+#include "quadtree_progressive.h"
+#include "quadtree_store.h"
+
+using namespace std;
+
+namespace
+{
+
+typedef chrono::steady_clock Clock;
+
+/**
+ * Wall-clock timer for one phase of a command; prints its own report line.
+ */
+class Phase
+{
+	public:
+		Phase(char const * name) : _name(name), _start(Clock::now())
+		{
+			/* nothing */
+		}
+
+		/**
+		 * Ends the phase and prints its duration.
+		 * @param nodes Number of tree nodes the phase processed, used for
+		 *  the nodes/sec figure; 0 to omit it.
+		 */
+		void done(long nodes = 0)
+		{
+			double seconds = chrono::duration<double>(Clock::now() - _start).count();
+			cout << "  " << left << setw(12) << _name << right << fixed << setprecision(3)
+				<< seconds * 1000.0 << " ms";
+			if(nodes > 0 && seconds > 0)
+				cout << "  " << setprecision(0) << nodes / seconds << " nodes/s";
+			cout << "\n";
+		}
+
+	private:
+		char const * _name;
+		Clock::time_point _start;
+};
+
+void usage()
+{
+	cerr << "usage:\n"
+		<< "  quadtree compress <in.png> <out.qt> [--resolution R]\n"
+		<< "                    [--leaves N | --max-leaves N | --tolerance T | --variance V] [--premultiplied]\n"
+		<< "                    [--metric rgb|luma|ycbcr|lab] [--compact | --progressive [--levels N]]\n"
+		<< "  quadtree decompress <in.qt> <out.png>\n"
+		<< "  quadtree preview <in.qt> <out.png> [--bytes N]\n"
+		<< "  quadtree rotate <in.qt> <out.qt> [--turns N] [--flip horizontal|vertical]\n"
+		<< "  quadtree stats <in.qt>\n"
+		<< "  quadtree quality <in.qt> <source.png> [--tolerance T] [--ssim]\n"
+		<< "  quadtree diff <from.qt> <to.qt> <out.qtd>\n"
+		<< "  quadtree patch <from.qt> <delta.qtd> <out.qt>\n"
+		<< "  quadtree batch <in-dir> <out-dir> [--resolution R] [--leaves N | --tolerance T]\n"
+		<< "                 [--decode-workers N] [--build-workers N] [--encode-workers N] [--queue N]\n";
+}
+
+//looks up "--name value" in the trailing arguments, returning fallback if absent
+int intOption(int argc, char ** argv, int first, char const * name, int fallback)
+{
+	for(int i = first; i + 1 < argc; i++){
+		if(strcmp(argv[i], name) == 0)
+			return atoi(argv[i + 1]);
+	}
+
+	return fallback;
+}
+
+//the same for options that take a real number
+double doubleOption(int argc, char ** argv, int first, char const * name, double fallback)
+{
+	for(int i = first; i + 1 < argc; i++){
+		if(strcmp(argv[i], name) == 0)
+			return strtod(argv[i + 1], NULL);
+	}
+
+	return fallback;
+}
+
+long fileSize(string const & file_name)
+{
+	ifstream in(file_name.c_str(), ios::binary | ios::ate);
+	return in ? (long) in.tellg() : -1;
+}
+
+long peakRssKilobytes()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+//prints the size figures shared by compress and stats
+void printSummary(Quadtree const & tree, long treeBytes)
+{
+	long rawBytes = (long) tree.getResolution() * tree.getResolution() * 4;
+	cout << "  resolution " << tree.getResolution() << "x" << tree.getResolution() << "\n"
+		<< "  nodes      " << tree.nodeCount() << "\n"
+		<< "  leaves     " << tree.leafCount() << "\n"
+		<< "  raw bytes  " << rawBytes << "\n"
+		<< "  tree bytes " << treeBytes << "\n";
+	if(treeBytes > 0)
+		cout << "  ratio      " << fixed << setprecision(2) << (double) rawBytes / treeBytes << ":1\n";
+}
+
+void printPeakRss()
+{
+	cout << "  peak RSS   " << peakRssKilobytes() << " KiB\n";
+}
+
+//prints the tree's instrumentation counters when the library was built with them
+void printCounters(Quadtree const & tree)
+{
+	if(Quadtree::statsEnabled())
+		cout << "counters\n" << tree.stats();
+}
+
+//writeToFile's counterpart for the compact format
+bool writeCompactFile(Quadtree const & tree, char const * file_name)
+{
+	ofstream out(file_name, ios::binary);
+	if(!out)
+		return false;
+
+	tree.writeCompact(out);
+	return (bool) out;
+}
+
+//the same for the progressive format, cut after levels levels if positive
+bool writeProgressiveFile(Quadtree const & tree, char const * file_name, int levels)
+{
+	ofstream out(file_name, ios::binary);
+	if(!out)
+		return false;
+
+	tree.writeProgressive(out, levels);
+	return (bool) out;
+}
+
+//builds the tree and prunes it, measuring colors with Metric: a fixed tolerance is applied while building, a leaf
+//count or budget needs the full tree to search for its tolerance or collapse nodes one at a time
+template <class Metric>
+void buildWithMetric(Quadtree & tree, PNG const & image, int resolution, int leaves, int maxLeaves, int tolerance)
+{
+	if(leaves <= 0 && maxLeaves <= 0 && tolerance >= 0){
+		Phase build("buildPruned");
+		tree.buildPruned<Metric>(image, resolution, tolerance);
+		build.done(tree.nodeCount());
+		cout << "  tolerance  " << tolerance << "\n";
+		return;
+	}
+
+	Phase build("build");
+	tree.buildTree(image, resolution);
+	int nodes = tree.nodeCount();
+	build.done(nodes);
+
+	if(maxLeaves > 0){
+		Phase prune("leafBudget");
+		tree.pruneToLeafCount<Metric>(maxLeaves);
+		prune.done(nodes);
+	}
+	else if(leaves > 0){
+		Phase search("idealPrune");
+		tolerance = tree.idealPrune<Metric>(leaves);
+		search.done();
+
+		Phase prune("prune");
+		tree.prune<Metric>(tolerance);
+		prune.done(nodes);
+		cout << "  tolerance  " << tolerance << "\n";
+	}
+}
+
+int compress(int argc, char ** argv)
+{
+	if(argc < 4){
+		usage();
+		return 1;
+	}
+
+	cout << "compress " << argv[2] << " -> " << argv[3] << "\n";
+
+	Phase load("load");
+	PNG image;
+	if(!image.readFromFile(argv[2]))
+		return 1;
+	load.done();
+
+	int resolution = intOption(argc, argv, 4, "--resolution", largestResolution(image));
+	if(resolution < 1 || (resolution & (resolution - 1)) != 0
+			|| (size_t) resolution > image.width() || (size_t) resolution > image.height()){
+		cerr << "resolution must be a power of two that fits in the image\n";
+		return 1;
+	}
+
+	//color metric used by --leaves, --max-leaves and --tolerance
+	char const * metric = "rgb";
+	for(int i = 4; i + 1 < argc; i++){
+		if(strcmp(argv[i], "--metric") == 0)
+			metric = argv[i + 1];
+	}
+	if(strcmp(metric, "rgb") != 0 && strcmp(metric, "luma") != 0 && strcmp(metric, "ycbcr") != 0 && strcmp(metric, "lab") != 0){
+		usage();
+		return 1;
+	}
+
+	//variance pruning needs the exact per-node sums, which have to be kept while building
+	double variance = doubleOption(argc, argv, 4, "--variance", -1);
+
+	//premultiplied alpha lets transparent areas collapse whatever color they carry
+	bool premultiplied = false;
+	for(int i = 4; i < argc; i++){
+		if(strcmp(argv[i], "--premultiplied") == 0)
+			premultiplied = true;
+	}
+
+	//the range-coded format is smaller but slower to read, the progressive one can be shown before it has all
+	//arrived (--levels caps its depth); every command reads all three
+	bool compact = false;
+	bool progressive = false;
+	for(int i = 4; i < argc; i++){
+		if(strcmp(argv[i], "--compact") == 0)
+			compact = true;
+		if(strcmp(argv[i], "--progressive") == 0)
+			progressive = true;
+	}
+	int levels = intOption(argc, argv, 4, "--levels", 0);
+
+	int leaves = intOption(argc, argv, 4, "--leaves", 0);
+	int maxLeaves = intOption(argc, argv, 4, "--max-leaves", 0);
+	int tolerance = intOption(argc, argv, 4, "--tolerance", -1);
+
+	Quadtree tree;
+	tree.setExactSums(variance >= 0);
+	tree.setPremultipliedAlpha(premultiplied);
+	if(variance >= 0){
+		Phase build("build");
+		tree.buildTree(image, resolution);
+		int nodes = tree.nodeCount();
+		build.done(nodes);
+
+		Phase prune("prune");
+		tree.pruneByVariance(variance);
+		prune.done(nodes);
+		cout << "  variance   " << defaultfloat << setprecision(6) << variance << "\n";
+	}
+	else if(strcmp(metric, "luma") == 0){
+		buildWithMetric<LumaRgbMetric>(tree, image, resolution, leaves, maxLeaves, tolerance);
+	}
+	else if(strcmp(metric, "ycbcr") == 0){
+		buildWithMetric<YCbCrMetric>(tree, image, resolution, leaves, maxLeaves, tolerance);
+	}
+	else if(strcmp(metric, "lab") == 0){
+		buildWithMetric<LabMetric>(tree, image, resolution, leaves, maxLeaves, tolerance);
+	}
+	else{
+		buildWithMetric<RgbMetric>(tree, image, resolution, leaves, maxLeaves, tolerance);
+	}
+
+	Phase save("write");
+	bool written;
+	if(compact)
+		written = writeCompactFile(tree, argv[3]);
+	else if(progressive)
+		written = writeProgressiveFile(tree, argv[3], levels);
+	else
+		written = tree.writeToFile(argv[3]);
+	if(!written){
+		cerr << "failed to write " << argv[3] << "\n";
+		return 1;
+	}
+	save.done(tree.nodeCount());
+
+	printSummary(tree, fileSize(argv[3]));
+	printPeakRss();
+	printCounters(tree);
+	return 0;
+}
+
+int decompress(int argc, char ** argv)
+{
+	if(argc < 4){
+		usage();
+		return 1;
+	}
+
+	cout << "decompress " << argv[2] << " -> " << argv[3] << "\n";
+
+	Phase load("read");
+	Quadtree tree;
+	if(!tree.readFromFile(argv[2])){
+		cerr << "failed to read " << argv[2] << "\n";
+		return 1;
+	}
+	int nodes = tree.nodeCount();
+	load.done(nodes);
+
+	Phase expand("decompress");
+	PNG image = tree.decompress();
+	expand.done(nodes);
+
+	Phase save("write");
+	if(!image.writeToFile(argv[3]))
+		return 1;
+	save.done();
+
+	printPeakRss();
+	printCounters(tree);
+	return 0;
+}
+
+//decodes the first --bytes bytes of a progressive file, as a viewer would on a slow link
+int preview(int argc, char ** argv)
+{
+	if(argc < 4){
+		usage();
+		return 1;
+	}
+
+	ifstream in(argv[2], ios::binary);
+	if(!in){
+		cerr << "failed to read " << argv[2] << "\n";
+		return 1;
+	}
+	string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+	size_t limit = intOption(argc, argv, 4, "--bytes", bytes.size());
+	if(limit > bytes.size())
+		limit = bytes.size();
+
+	cout << "preview " << argv[2] << " -> " << argv[3] << " (" << limit << " of " << bytes.size() << " bytes)\n";
+
+	Phase load("decode");
+	QuadtreeProgressiveReader reader;
+	if(!reader.feed(bytes.data(), limit)){
+		cerr << "malformed progressive stream\n";
+		return 1;
+	}
+	load.done();
+
+	if(reader.levels() == 0){
+		cerr << "not enough bytes for a first image\n";
+		return 1;
+	}
+	cout << "  levels     " << reader.levels() << (reader.complete() ? " (complete)" : "") << "\n";
+
+	Phase save("write");
+	PNG image = reader.image();
+	if(!image.writeToFile(argv[3]))
+		return 1;
+	save.done();
+	return 0;
+}
+
+int rotate(int argc, char ** argv)
+{
+	if(argc < 4){
+		usage();
+		return 1;
+	}
+
+	int turns = ((intOption(argc, argv, 4, "--turns", 1) % 4) + 4) % 4;
+	cout << "rotate " << argv[2] << " -> " << argv[3] << " (" << turns << " quarter turns)\n";
+
+	Phase load("read");
+	Quadtree tree;
+	if(!tree.readFromFile(argv[2])){
+		cerr << "failed to read " << argv[2] << "\n";
+		return 1;
+	}
+	int nodes = tree.nodeCount();
+	load.done(nodes);
+
+	//the flip, if any, is applied after the rotation
+	char const * flip = "";
+	for(int i = 4; i + 1 < argc; i++){
+		if(strcmp(argv[i], "--flip") == 0)
+			flip = argv[i + 1];
+	}
+	if(*flip != '\0' && strcmp(flip, "horizontal") != 0 && strcmp(flip, "vertical") != 0){
+		usage();
+		return 1;
+	}
+
+	Phase turn("rotate");
+	tree.rotate(turns);
+	if(strcmp(flip, "horizontal") == 0)
+		tree.flipHorizontal();
+	else if(strcmp(flip, "vertical") == 0)
+		tree.flipVertical();
+	turn.done(nodes);
+
+	Phase save("write");
+	if(!tree.writeToFile(argv[3])){
+		cerr << "failed to write " << argv[3] << "\n";
+		return 1;
+	}
+	save.done(nodes);
+
+	printPeakRss();
+	return 0;
+}
+
+int stats(int argc, char ** argv)
+{
+	if(argc < 3){
+		usage();
+		return 1;
+	}
+
+	cout << "stats " << argv[2] << "\n";
+
+	Phase load("read");
+	Quadtree tree;
+	if(!tree.readFromFile(argv[2])){
+		cerr << "failed to read " << argv[2] << "\n";
+		return 1;
+	}
+	load.done(tree.nodeCount());
+
+	//identical subtrees merged into one node each
+	Phase dedupe("intern");
+	QuadtreeStore store;
+	store.intern(tree);
+	dedupe.done(tree.nodeCount());
+
+	printSummary(tree, fileSize(argv[2]));
+	cout << "  dag nodes  " << store.size() << "\n";
+	printPeakRss();
+	return 0;
+}
+
+int quality(int argc, char ** argv)
+{
+	if(argc < 4){
+		usage();
+		return 1;
+	}
+
+	cout << "quality " << argv[2] << " vs " << argv[3] << "\n";
+
+	Phase load("read");
+	Quadtree tree;
+	PNG source;
+	if(!tree.readFromFile(argv[2]) || !source.readFromFile(argv[3])){
+		cerr << "failed to read the inputs\n";
+		return 1;
+	}
+	int nodes = tree.nodeCount();
+	load.done(nodes);
+
+	bool withSsim = false;
+	for(int i = 4; i < argc; i++){
+		if(strcmp(argv[i], "--ssim") == 0)
+			withSsim = true;
+	}
+
+	//with a tolerance the metrics are those of the pruned tree, which is not actually pruned
+	Phase measure("measure");
+	QuadtreeQuality result = tree.pruneQuality(source, intOption(argc, argv, 4, "--tolerance", -1), withSsim);
+	measure.done(nodes);
+	if(result.pixels == 0){
+		cerr << "the source is smaller than the tree\n";
+		return 1;
+	}
+
+	cout << "  " << result << "\n";
+	return 0;
+}
+
+int diff(int argc, char ** argv)
+{
+	if(argc < 5){
+		usage();
+		return 1;
+	}
+
+	cout << "diff " << argv[2] << " " << argv[3] << " -> " << argv[4] << "\n";
+
+	Phase load("read");
+	Quadtree from, to;
+	if(!from.readFromFile(argv[2]) || !to.readFromFile(argv[3])){
+		cerr << "failed to read the input trees\n";
+		return 1;
+	}
+	load.done(from.nodeCount() + to.nodeCount());
+
+	Phase compare("diff");
+	QuadtreeDelta delta = from.diff(to);
+	compare.done(to.nodeCount());
+
+	Phase save("write");
+	if(!delta.writeToFile(argv[4])){
+		cerr << "failed to write " << argv[4] << "\n";
+		return 1;
+	}
+	save.done();
+
+	long deltaBytes = fileSize(argv[4]);
+	long treeBytes = fileSize(argv[3]);
+	cout << "  changes    " << delta.changes().size() << "\n"
+		<< "  delta bytes " << deltaBytes << "\n";
+	if(deltaBytes > 0)
+		cout << "  ratio      " << fixed << setprecision(2) << (double) treeBytes / deltaBytes << ":1 against " << argv[3] << "\n";
+	printPeakRss();
+	return 0;
+}
+
+int patch(int argc, char ** argv)
+{
+	if(argc < 5){
+		usage();
+		return 1;
+	}
+
+	cout << "patch " << argv[2] << " + " << argv[3] << " -> " << argv[4] << "\n";
+
+	Phase load("read");
+	Quadtree tree;
+	QuadtreeDelta delta;
+	if(!tree.readFromFile(argv[2]) || !delta.readFromFile(argv[3])){
+		cerr << "failed to read the inputs\n";
+		return 1;
+	}
+	load.done(tree.nodeCount());
+
+	Phase apply("apply");
+	if(!tree.applyDelta(delta)){
+		cerr << argv[3] << " does not apply to " << argv[2] << "\n";
+		return 1;
+	}
+	apply.done();
+
+	Phase save("write");
+	if(!tree.writeToFile(argv[4])){
+		cerr << "failed to write " << argv[4] << "\n";
+		return 1;
+	}
+	save.done(tree.nodeCount());
+
+	printPeakRss();
+	return 0;
+}
+
+int batch(int argc, char ** argv)
+{
+	if(argc < 4){
+		usage();
+		return 1;
+	}
+
+	namespace fs = std::filesystem;
+	error_code error;
+	fs::create_directories(argv[3], error);
+
+	vector<BatchJob> jobs;
+	for(fs::directory_iterator it(argv[2], error), end; !error && it != end; it.increment(error)){
+		if(it->path().extension() != ".png")
+			continue;
+		BatchJob job;
+		job.input = it->path().string();
+		job.output = (fs::path(argv[3]) / it->path().filename()).string();
+		jobs.push_back(job);
+	}
+	if(error){
+		cerr << "failed to list " << argv[2] << ": " << error.message() << "\n";
+		return 1;
+	}
+
+	PipelineOptions options;
+	options.resolution = intOption(argc, argv, 4, "--resolution", 0);
+	options.numLeaves = intOption(argc, argv, 4, "--leaves", 0);
+	options.tolerance = intOption(argc, argv, 4, "--tolerance", -1);
+	options.decodeWorkers = intOption(argc, argv, 4, "--decode-workers", 1);
+	options.buildWorkers = intOption(argc, argv, 4, "--build-workers", 1);
+	options.encodeWorkers = intOption(argc, argv, 4, "--encode-workers", 1);
+	options.queueCapacity = intOption(argc, argv, 4, "--queue", 8);
+
+	cout << "batch " << argv[2] << " -> " << argv[3] << " (" << jobs.size() << " images)\n";
+	PipelineStats result = BatchPipeline(options).run(jobs);
+	result.print(cout);
+	printPeakRss();
+	return result.decode.failures + result.build.failures + result.encode.failures == 0 ? 0 : 1;
+}
+
+//runs the command argv[1] names
+int run(int argc, char ** argv)
+{
+	if(argc < 2){
+		usage();
+		return 1;
+	}
+
+	string command = argv[1];
+	if(command == "compress")
+		return compress(argc, argv);
+	if(command == "decompress")
+		return decompress(argc, argv);
+	if(command == "preview")
+		return preview(argc, argv);
+	if(command == "rotate")
+		return rotate(argc, argv);
+	if(command == "stats")
+		return stats(argc, argv);
+	if(command == "quality")
+		return quality(argc, argv);
+	if(command == "diff")
+		return diff(argc, argv);
+	if(command == "patch")
+		return patch(argc, argv);
+	if(command == "batch")
+		return batch(argc, argv);
+
+	usage();
+	return 1;
+}
+
+}
+
+int main(int argc, char ** argv)
+{
+	//inputs are checked before anything is sized from them, but a large enough valid one can still exhaust memory
+	try{
+		return run(argc, argv);
+	}
+	catch(bad_alloc const &){
+		cerr << "out of memory\n";
+	}
+	catch(exception const & error){
+		cerr << "error: " << error.what() << "\n";
+	}
+	return 1;
+}
@@ -0,0 +1,260 @@
+/**
+ * @file pipeline.cpp
+ * Implementation of the BatchPipeline class.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <thread>
+
+#include "pipeline.h"
+
+using namespace std;
+
+namespace
+{
+
+typedef chrono::steady_clock Clock;
+
+double secondsSince(Clock::time_point start)
+{
+	return chrono::duration<double>(Clock::now() - start).count();
+}
+
+void printStage(ostream & out, char const * name, StageStats const & stage, double wallSeconds)
+{
+	double perWall = wallSeconds > 0 ? stage.items / wallSeconds : 0.0;
+	out << "  " << left << setw(8) << name << right
+		<< " workers=" << stage.workers
+		<< " items=" << stage.items
+		<< " failed=" << stage.failures
+		<< " busy=" << fixed << setprecision(3) << stage.busySeconds << "s"
+		<< " items/busy-s=" << setprecision(2) << stage.itemsPerBusySecond()
+		<< " items/wall-s=" << perWall << "\n";
+}
+
+void printQueue(ostream & out, char const * name, QueueStats const & queue)
+{
+	out << "  " << left << setw(8) << name << right
+		<< " capacity=" << queue.capacity
+		<< " max-depth=" << queue.maxDepth
+		<< " avg-depth=" << fixed << setprecision(2) << queue.averageDepth << "\n";
+}
+
+template <typename T>
+QueueStats queueStats(BoundedQueue<T> const & queue)
+{
+	QueueStats stats;
+	stats.capacity = queue.capacity();
+	stats.maxDepth = queue.maxDepth();
+	stats.averageDepth = queue.averageDepth();
+	return stats;
+}
+
+}
+
+//returns the largest power of two that is no bigger than both dimensions of the image
+int largestResolution(PNG const & image)
+{
+	size_t limit = image.width() < image.height() ? image.width() : image.height();
+	int resolution = 1;
+	while((size_t) resolution * 2 <= limit){
+		resolution *= 2;
+	}
+
+	return resolution;
+}
+
+PipelineOptions::PipelineOptions()
+	: decodeWorkers(1), buildWorkers(1), encodeWorkers(1), queueCapacity(8),
+	  resolution(0), numLeaves(0), tolerance(-1)
+{
+	/* nothing */
+}
+
+StageStats::StageStats() : items(0), failures(0), busySeconds(0.0), workers(0)
+{
+	/* nothing */
+}
+
+double StageStats::itemsPerBusySecond() const
+{
+	return busySeconds > 0 ? items / busySeconds : 0.0;
+}
+
+QueueStats::QueueStats() : capacity(0), maxDepth(0), averageDepth(0.0)
+{
+	/* nothing */
+}
+
+PipelineStats::PipelineStats() : wallSeconds(0.0)
+{
+	/* nothing */
+}
+
+void PipelineStats::print(ostream & out) const
+{
+	out << "pipeline: " << fixed << setprecision(3) << wallSeconds << "s wall\n";
+	printStage(out, "decode", decode, wallSeconds);
+	printStage(out, "build", build, wallSeconds);
+	printStage(out, "encode", encode, wallSeconds);
+	printQueue(out, "decoded", decoded);
+	printQueue(out, "built", built);
+}
+
+BatchPipeline::BatchPipeline(PipelineOptions const & options) : _options(options)
+{
+	if(_options.decodeWorkers < 1)
+		_options.decodeWorkers = 1;
+	if(_options.buildWorkers < 1)
+		_options.buildWorkers = 1;
+	if(_options.encodeWorkers < 1)
+		_options.encodeWorkers = 1;
+}
+
+/*
+*Runs every job through the three stages. Each stage has its own worker pool that pops from the
+*queue before it and pushes into the queue after it; the last worker of a stage to finish closes
+*the next queue so that the following stage drains and exits.
+*/
+PipelineStats BatchPipeline::run(vector<BatchJob> const & jobs){
+	PipelineStats stats;
+	Clock::time_point start = Clock::now();
+
+	//the job queue is filled up front, the other two bound the work in flight
+	BoundedQueue<WorkItem> pending(jobs.size());
+	BoundedQueue<WorkItem> decoded(_options.queueCapacity);
+	BoundedQueue<WorkItem> built(_options.queueCapacity);
+
+	for(size_t i = 0; i < jobs.size(); i++){
+		WorkItem item;
+		item.job = jobs[i];
+		pending.push(std::move(item));
+	}
+	pending.close();
+
+	struct Stage
+	{
+		BoundedQueue<WorkItem> * in;
+		BoundedQueue<WorkItem> * out;
+		bool (BatchPipeline::*work)(WorkItem &) const;
+		StageStats * stats;
+		atomic<int> running;
+		mutex statsMutex;
+	};
+
+	Stage stages[3];
+	stages[0].in = &pending;
+	stages[0].out = &decoded;
+	stages[0].work = &BatchPipeline::_decode;
+	stages[0].stats = &stats.decode;
+	stages[0].stats->workers = _options.decodeWorkers;
+
+	stages[1].in = &decoded;
+	stages[1].out = &built;
+	stages[1].work = &BatchPipeline::_build;
+	stages[1].stats = &stats.build;
+	stages[1].stats->workers = _options.buildWorkers;
+
+	stages[2].in = &built;
+	stages[2].out = NULL;
+	stages[2].work = &BatchPipeline::_encode;
+	stages[2].stats = &stats.encode;
+	stages[2].stats->workers = _options.encodeWorkers;
+
+	vector<thread> threads;
+	for(int s = 0; s < 3; s++){
+		Stage & stage = stages[s];
+		stage.running = stage.stats->workers;
+
+		for(int w = 0; w < stage.stats->workers; w++){
+			threads.push_back(thread([this, &stage]{
+				StageStats local;
+				WorkItem item;
+
+				while(stage.in->pop(item)){
+					Clock::time_point begin = Clock::now();
+					bool ok = (this->*stage.work)(item);
+					local.busySeconds += secondsSince(begin);
+
+					if(!ok){
+						local.failures++;
+						continue;
+					}
+
+					local.items++;
+					if(stage.out != NULL){
+						stage.out->push(std::move(item));
+					}
+				}
+
+				{
+					lock_guard<mutex> lock(stage.statsMutex);
+					stage.stats->items += local.items;
+					stage.stats->failures += local.failures;
+					stage.stats->busySeconds += local.busySeconds;
+				}
+
+				//last worker out closes the downstream queue
+				if(--stage.running == 0 && stage.out != NULL){
+					stage.out->close();
+				}
+			}));
+		}
+	}
+
+	for(size_t i = 0; i < threads.size(); i++){
+		threads[i].join();
+	}
+
+	stats.decoded = queueStats(decoded);
+	stats.built = queueStats(built);
+	stats.wallSeconds = secondsSince(start);
+	return stats;
+}
+
+//decode stage: reads the input PNG from disk
+bool BatchPipeline::_decode(WorkItem & item) const{
+	item.image.reset(new PNG());
+	if(!item.image->readFromFile(item.job.input)){
+		cerr << "[pipeline]: failed to read " << item.job.input << endl;
+		return false;
+	}
+
+	return true;
+}
+
+//build stage: builds the Quadtree, prunes it, and releases the source image
+bool BatchPipeline::_build(WorkItem & item) const{
+	int resolution = _options.resolution > 0 ? _options.resolution : largestResolution(*item.image);
+	if((size_t) resolution > item.image->width() || (size_t) resolution > item.image->height()){
+		cerr << "[pipeline]: " << item.job.input << " is smaller than resolution " << resolution << endl;
+		return false;
+	}
+
+	item.tree.reset(new Quadtree(*item.image, resolution));
+	item.image.reset();
+
+	if(_options.numLeaves > 0){
+		item.tree->prune(item.tree->idealPrune(_options.numLeaves));
+	}
+	else if(_options.tolerance >= 0){
+		item.tree->prune(_options.tolerance);
+	}
+
+	return true;
+}
+
+//encode stage: decompresses the tree and writes the result to disk
+bool BatchPipeline::_encode(WorkItem & item) const{
+	PNG output = item.tree->decompress();
+	item.tree.reset();
+
+	if(!output.writeToFile(item.job.output)){
+		cerr << "[pipeline]: failed to write " << item.job.output << endl;
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,251 @@
+/**
+ * @file pipeline.h
+ * Definition of the BatchPipeline class, a multi-threaded driver that
+ * runs PNG decode, Quadtree build/prune and PNG encode as separate stages
+ * connected by bounded queues.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "png.h"
+#include "quadtree.h"
+
+/**
+ * A fixed-capacity, multi-producer multi-consumer FIFO queue. Producers
+ * block while the queue is full and consumers block while it is empty;
+ * once the queue is closed, consumers drain what is left and then stop.
+ */
+template <typename T>
+class BoundedQueue
+{
+	public:
+		/**
+		 * Creates an empty queue holding at most capacity items.
+		 * @param capacity Maximum number of queued items (at least 1).
+		 */
+		explicit BoundedQueue(size_t capacity)
+			: _capacity(capacity > 0 ? capacity : 1), _closed(false),
+			  _maxDepth(0), _depthSum(0), _pushes(0)
+		{
+			/* nothing */
+		}
+
+		/**
+		 * Appends an item, blocking while the queue is full.
+		 * @param item Item to be queued.
+		 * @return False if the queue was closed and the item was dropped.
+		 */
+		bool push(T item)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_notFull.wait(lock, [this] { return _closed || _items.size() < _capacity; });
+			if (_closed)
+				return false;
+
+			_items.push_back(std::move(item));
+			_pushes++;
+			_depthSum += _items.size();
+			if (_items.size() > _maxDepth)
+				_maxDepth = _items.size();
+			_notEmpty.notify_one();
+			return true;
+		}
+
+		/**
+		 * Removes the oldest item, blocking while the queue is empty.
+		 * @param item Receives the removed item.
+		 * @return False once the queue is closed and fully drained.
+		 */
+		bool pop(T & item)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_notEmpty.wait(lock, [this] { return _closed || !_items.empty(); });
+			if (_items.empty())
+				return false;
+
+			item = std::move(_items.front());
+			_items.pop_front();
+			_notFull.notify_one();
+			return true;
+		}
+
+		/**
+		 * Closes the queue: pending pops drain the remaining items, and
+		 * further pushes are rejected.
+		 */
+		void close()
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_closed = true;
+			_notEmpty.notify_all();
+			_notFull.notify_all();
+		}
+
+		/** @return The maximum number of items queued at once. */
+		size_t capacity() const
+		{
+			return _capacity;
+		}
+
+		/** @return The largest depth observed so far. */
+		size_t maxDepth() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _maxDepth;
+		}
+
+		/** @return The mean depth observed right after each push. */
+		double averageDepth() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _pushes == 0 ? 0.0 : (double) _depthSum / _pushes;
+		}
+
+	private:
+		size_t _capacity;
+		bool _closed;
+		size_t _maxDepth;
+		size_t _depthSum;
+		size_t _pushes;
+		std::deque<T> _items;
+		mutable std::mutex _mutex;
+		std::condition_variable _notEmpty;
+		std::condition_variable _notFull;
+};
+
+/**
+ * Picks the resolution used when none is configured.
+ * @param image Image that will be compressed.
+ * @return The largest power of two no bigger than the image's width and
+ *  height.
+ */
+int largestResolution(PNG const & image);
+
+/**
+ * A single unit of work: one PNG to read and where to write the result.
+ */
+struct BatchJob
+{
+	string input;  /**< Path of the PNG to compress. */
+	string output; /**< Path the decompressed PNG is written to. */
+};
+
+/**
+ * Settings for a BatchPipeline run.
+ */
+struct PipelineOptions
+{
+	int decodeWorkers;    /**< Threads reading PNG files. */
+	int buildWorkers;     /**< Threads building and pruning Quadtrees. */
+	int encodeWorkers;    /**< Threads decompressing and writing PNG files. */
+	size_t queueCapacity; /**< Capacity of each queue between stages. */
+	int resolution;       /**< Tree resolution; 0 picks the largest power of two that fits. */
+	int numLeaves;        /**< If positive, prune to idealPrune(numLeaves). */
+	int tolerance;        /**< Otherwise, if non-negative, prune with this tolerance. */
+
+	/**
+	 * Default options: one worker per stage, queues of 8, no pruning.
+	 */
+	PipelineOptions();
+};
+
+/**
+ * Throughput counters for one pipeline stage.
+ */
+struct StageStats
+{
+	size_t items;        /**< Items completed successfully. */
+	size_t failures;     /**< Items dropped because of an error. */
+	double busySeconds;  /**< Time summed over all workers spent processing. */
+	int workers;         /**< Number of worker threads. */
+
+	StageStats();
+
+	/** @return Items completed per second of worker time. */
+	double itemsPerBusySecond() const;
+};
+
+/**
+ * Occupancy counters for one queue between two stages.
+ */
+struct QueueStats
+{
+	size_t capacity;     /**< Configured capacity. */
+	size_t maxDepth;     /**< Largest depth observed. */
+	double averageDepth; /**< Mean depth observed after each push. */
+
+	QueueStats();
+};
+
+/**
+ * Statistics gathered over a whole BatchPipeline run.
+ */
+struct PipelineStats
+{
+	StageStats decode;  /**< PNG reading. */
+	StageStats build;   /**< Quadtree building and pruning. */
+	StageStats encode;  /**< Decompression and PNG writing. */
+	QueueStats decoded; /**< Queue between decode and build. */
+	QueueStats built;   /**< Queue between build and encode. */
+	double wallSeconds; /**< Elapsed time for the whole run. */
+
+	PipelineStats();
+
+	/**
+	 * Writes a human-readable report of the run.
+	 * @param out Stream to write to.
+	 */
+	void print(std::ostream & out) const;
+};
+
+/**
+ * Compresses a batch of PNG images through a three-stage pipeline:
+ * decode (PNG::readFromFile), build/prune (Quadtree::buildTree,
+ * idealPrune and prune) and encode (Quadtree::decompress and
+ * PNG::writeToFile). Every stage runs its own pool of worker threads, so
+ * file I/O overlaps with tree construction.
+ */
+class BatchPipeline
+{
+	public:
+		/**
+		 * Creates a pipeline with the given settings.
+		 * @param options Worker counts, queue sizes and prune settings.
+		 */
+		BatchPipeline(PipelineOptions const & options);
+
+		/**
+		 * Processes every job and blocks until all of them are done.
+		 * Failed jobs are reported on cerr and counted in the stats.
+		 * @param jobs Input and output paths to process.
+		 * @return Per-stage statistics for the run.
+		 */
+		PipelineStats run(std::vector<BatchJob> const & jobs);
+
+	private:
+		struct WorkItem
+		{
+			BatchJob job;
+			std::unique_ptr<PNG> image;
+			std::unique_ptr<Quadtree> tree;
+		};
+
+		PipelineOptions _options;
+
+		// stage bodies; each returns false if the item should be dropped
+		bool _decode(WorkItem & item) const;
+		bool _build(WorkItem & item) const;
+		bool _encode(WorkItem & item) const;
+};
+
+#endif // PIPELINE_H
@@ -4,7 +4,14 @@
  * @date Spring 2008
  */
 
+#include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <queue>
+#include <sstream>
+#include <type_traits>
+#include "idealprune.h"
 #include "quadtree.h"
 
 using namespace std;
@@ -16,6 +23,9 @@ using namespace std;
 */
 Quadtree::Quadtree(){
 	root = NULL;
+	rootResolution = 0;
+	exactSums = false;
+	premultiplied = false;
 }
 
 
@@ -28,6 +38,9 @@ Quadtree::Quadtree(){
 */
 Quadtree::Quadtree(PNG const & source, int resolution){
 	root = NULL;
+	rootResolution = 0;
+	exactSums = false;
+	premultiplied = false;
 	buildTree(source, resolution);
 }
 
@@ -36,11 +49,14 @@ Quadtree::Quadtree(PNG const & source, int resolution){
 
 /*
 *Copy constructor.
-*Simply sets this Quadtree to be a copy of the parameter.
+*Simply sets this Quadtree to be a copy of the parameter. This takes constant time: the two trees *share their nodes, and each one copies only the nodes on the paths it later changes.
 */
 Quadtree::Quadtree(Quadtree const & other){
 	if(other.root == NULL){
 		root = NULL;
+		rootResolution = 0;
+		exactSums = other.exactSums;
+		premultiplied = other.premultiplied;
 		return;
 	}
 
@@ -80,49 +96,303 @@ Quadtree const & Quadtree::operator=(Quadtree const & other){
 *You may assume that d is a power of two, and that the width and height of source are each at least d.
 */
 void Quadtree::buildTree(PNG const & source, int resolution){
+	QT_TIME_PHASE(counters.buildSeconds);
+
 	if(root != NULL){
 		clear(root);
 	}
 
-	root = new QuadtreeNode(0, 0, resolution);
-	buildTree(source, resolution, root);
+	root = new QuadtreeNode();
+	rootResolution = resolution;
+	QT_STAT(counters.nodesAllocated++);
+	buildTree(source, 0, 0, resolution, root);
 }
 
 //Buildtree Helper Function
-void Quadtree::buildTree(PNG const & source, int resolution, QuadtreeNode * root){
+void Quadtree::buildTree(PNG const & source, int x, int y, int resolution, QuadtreeNode * root){
 	//base case, once resolution is one we assign elements to nodes
 	if(resolution == 1){
-		root->element = *(source(root->x, root->y));
+		root->element = *(source(x, y));
+		flatSums(root, 1);
+		rehash(root);
 		return;
 	}
 
-	//creates new children initializing their x, y, and resolution
-	root->nwChild = new QuadtreeNode(root->x, root->y, resolution/2);
-	root->neChild = new QuadtreeNode(root->x + (resolution/2), root->y, resolution/2);
-	root->swChild = new QuadtreeNode(root->x, root->y + (resolution/2), resolution/2);
-	root->seChild = new QuadtreeNode(root->x + (resolution/2), root->y + (resolution/2), resolution/2);
+	//creates new children
+	root->nwChild = new QuadtreeNode();
+	root->neChild = new QuadtreeNode();
+	root->swChild = new QuadtreeNode();
+	root->seChild = new QuadtreeNode();
+	QT_STAT(counters.nodesAllocated += 4);
 
-	//recursive call to half resolution and call children recursively
-	buildTree(source, resolution/2, root->nwChild);
-	buildTree(source, resolution/2, root->neChild);
-	buildTree(source, resolution/2, root->swChild);
-	buildTree(source, resolution/2, root->seChild);
+	//recursive call to half resolution and call children recursively with their upper left corners
+	int half = resolution/2;
+	buildTree(source, x, y, half, root->nwChild);
+	buildTree(source, x + half, y, half, root->neChild);
+	buildTree(source, x, y + half, half, root->swChild);
+	buildTree(source, x + half, y + half, half, root->seChild);
 
 	//sets parent node colors
-		root->element.red = (root->nwChild->element.red +
-							 root->neChild->element.red +
-							 root->swChild->element.red +
-							 root->seChild->element.red)/4;
-		root->element.blue = (root->nwChild->element.blue +
-							  root->neChild->element.blue +
-							  root->swChild->element.blue +
-							  root->seChild->element.blue)/4;
-		root->element.green = (root->nwChild->element.green +
-							   root->neChild->element.green +
-							   root->swChild->element.green +
-							   root->seChild->element.green)/4;
+	average(root);
+	rehash(root);
+}
+
+
+
+
+//buildPruned pyramid entry for one square
+struct Quadtree::PyramidCell{
+	RGBAPixel color;    //the color the square's node would have
+	uint8_t low[4];     //lowest red, green, blue and alpha below the square
+	uint8_t high[4];    //highest red, green, blue and alpha below the square
+};
+
+/*
+*Deletes the current contents of this Quadtree and builds the tree prune<Metric>(tolerance) would *leave after buildTree(source, resolution), without ever allocating the nodes prune would remove.
+*Whether a square is split is decided from a pyramid of the colors its node would have and the *lowest and highest value of each channel below it: a flat square, or (for the RGB metric) one whose *channel ranges keep every pixel within or push some pixel beyond the tolerance, is decided at once, *and only the remaining squares are checked quadrant by quadrant down to the pixels. The pyramid takes *about four bytes per pixel, far less than the nodes of a full tree. In exact mode the colors depend *on sums the pyramid does not keep, so the tree is built in full and then pruned.
+*/
+template <class Metric>
+void Quadtree::buildPruned(PNG const & source, int resolution, int tolerance){
+	if(exactSums){
+		buildTree(source, resolution);
+		prune<Metric>(tolerance);
+		return;
+	}
+
+	QT_TIME_PHASE(counters.buildSeconds);
+
+	if(root != NULL){
+		clear(root);
+	}
+	rootResolution = resolution;
+
+	//levels[k] holds the squares of width 2^k, row by row; level 0 is read from source directly
+	vector<vector<PyramidCell> > levels(1);
+	for(int width = 2; width <= resolution; width *= 2){
+		int cells = resolution/width;
+		levels.push_back(vector<PyramidCell>(cells * cells));
+
+		for(int cy = 0; cy < cells; cy++){
+			for(int cx = 0; cx < cells; cx++){
+				PyramidCell quarters[4] = {pyramidCell(source, levels, 2*cx, 2*cy, levels.size() - 2),
+										   pyramidCell(source, levels, 2*cx + 1, 2*cy, levels.size() - 2),
+										   pyramidCell(source, levels, 2*cx, 2*cy + 1, levels.size() - 2),
+										   pyramidCell(source, levels, 2*cx + 1, 2*cy + 1, levels.size() - 2)};
+
+				PyramidCell & cell = levels.back()[cy * cells + cx];
+				RGBAPixel const colors[4] = {quarters[0].color, quarters[1].color, quarters[2].color, quarters[3].color};
+				cell.color = average(colors);
+				for(int c = 0; c < 4; c++){
+					cell.low[c] = min(min(quarters[0].low[c], quarters[1].low[c]), min(quarters[2].low[c], quarters[3].low[c]));
+					cell.high[c] = max(max(quarters[0].high[c], quarters[1].high[c]), max(quarters[2].high[c], quarters[3].high[c]));
+				}
+			}
+		}
+	}
+
+	root = buildPruned<Metric>(source, levels, 0, 0, levels.size() - 1, tolerance);
+}
+
+//buildPruned helper function, the pyramid cell of the square at column cx and row cy of level
+Quadtree::PyramidCell Quadtree::pyramidCell(PNG const & source, vector<vector<PyramidCell> > const & levels, int cx, int cy, int level) const{
+	if(level > 0){
+		return levels[level][cy * (rootResolution >> level) + cx];
+	}
+
+	RGBAPixel const & pixel = *source(cx, cy);
+	PyramidCell cell = {pixel, {pixel.red, pixel.green, pixel.blue, pixel.alpha}, {pixel.red, pixel.green, pixel.blue, pixel.alpha}};
+	return cell;
+}
+
+//buildPruned helper function, creates the subtree for the square at column cx and row cy of level
+template <class Metric>
+Quadtree::QuadtreeNode * Quadtree::buildPruned(PNG const & source, vector<vector<PyramidCell> > const & levels, int cx, int cy, int level, int tolerance){
+	PyramidCell cell = pyramidCell(source, levels, cx, cy, level);
+	QuadtreeNode * node = new QuadtreeNode(cell.color);
+	QT_STAT(counters.nodesAllocated++);
+
+	//base case, a pixel, or a square prune would collapse into a leaf of its color
+	if(level == 0 || withinTolerance<Metric>(source, levels, cx, cy, level, cell.color, tolerance)){
+		rehash(node);
+		return node;
+	}
+
+	//recursive call to each quadrant
+	node->nwChild = buildPruned<Metric>(source, levels, 2*cx, 2*cy, level - 1, tolerance);
+	node->neChild = buildPruned<Metric>(source, levels, 2*cx + 1, 2*cy, level - 1, tolerance);
+	node->swChild = buildPruned<Metric>(source, levels, 2*cx, 2*cy + 1, level - 1, tolerance);
+	node->seChild = buildPruned<Metric>(source, levels, 2*cx + 1, 2*cy + 1, level - 1, tolerance);
+	rehash(node);
+	return node;
+}
+
+//buildPruned helper function, whether every pixel of a square is within tolerance of color (what checkTolerance tests on a full tree)
+template <class Metric>
+bool Quadtree::withinTolerance(PNG const & source, vector<vector<PyramidCell> > const & levels, int cx, int cy, int level, RGBAPixel const & color, int tolerance) const{
+	PyramidCell cell = pyramidCell(source, levels, cx, cy, level);
+
+	//base case, a flat square is one pixel repeated
+	bool flat = true;
+	for(int c = 0; c < 4; c++){
+		flat = flat && cell.low[c] == cell.high[c];
+	}
+	if(flat){
+		RGBAPixel pixel(cell.low[0], cell.low[1], cell.low[2], cell.low[3]);
+		return distance<Metric>(pixel, color) <= tolerance;
+	}
 
+	//base case, with straight RGB the channel ranges bound the distance of every pixel from above and below
+	if(is_same<Metric, RgbMetric>::value && !premultiplied){
+		uint8_t const channels[4] = {color.red, color.green, color.blue, color.alpha};
+		int upper = 0, lower = 0;
+		for(int c = 0; c < 4; c++){
+			int low = channels[c] - cell.low[c];
+			int high = cell.high[c] - channels[c];
+			int far = max(low * low, high * high);
+			upper += far;
+			lower = max(lower, far);
+		}
+
+		if(upper <= tolerance){
+			return true;
+		}
+		if(lower > tolerance){
+			return false;
+		}
+	}
+
+	//recursive call to each quadrant, the pixels themselves decide at level 0 (where every square is flat)
+	return withinTolerance<Metric>(source, levels, 2*cx, 2*cy, level - 1, color, tolerance) &&
+		   withinTolerance<Metric>(source, levels, 2*cx + 1, 2*cy, level - 1, color, tolerance) &&
+		   withinTolerance<Metric>(source, levels, 2*cx, 2*cy + 1, level - 1, color, tolerance) &&
+		   withinTolerance<Metric>(source, levels, 2*cx + 1, 2*cy + 1, level - 1, color, tolerance);
+}
+
+//Buildtree helper function, sets the node's color to the truncated average of its children
+void Quadtree::average(QuadtreeNode * root){
+	average(root, root);
+}
+
+//average helper function, sets the node's color to the truncated average of parent's children (parent may be the node itself);
+//in exact mode the children's sums are added up instead, and the color is their truncated true mean. Alpha is averaged
+//like the other channels; in premultiplied mode each color is weighted by its alpha, so transparent children do not
+//tint the average (a fully transparent node keeps color 0)
+void Quadtree::average(QuadtreeNode * root, QuadtreeNode const * parent){
+	QuadtreeNode const * children[4] = {parent->nwChild, parent->neChild, parent->swChild, parent->seChild};
+
+	if(exactSums){
+		NodeSums totals = emptySums();
+		for(int i = 0; i < 4; i++){
+			addSums(totals, *children[i]->sums);
+		}
+
+		if(root->sums == NULL){
+			root->sums = new NodeSums;
+		}
+		*root->sums = totals;
+		root->element = meanColor(totals);
+		return;
+	}
+
+	RGBAPixel const colors[4] = {children[0]->element, children[1]->element, children[2]->element, children[3]->element};
+	root->element = average(colors);
+}
+
+//average helper function, the truncated average of four colors (nw, ne, sw, se) outside exact mode
+RGBAPixel Quadtree::average(RGBAPixel const colors[4]) const{
+	RGBAPixel result;
+	int alpha = colors[0].alpha + colors[1].alpha + colors[2].alpha + colors[3].alpha;
+	result.alpha = alpha/4;
+
+	if(premultiplied){
+		int red = 0, green = 0, blue = 0;
+		for(int i = 0; i < 4; i++){
+			red += colors[i].red * colors[i].alpha;
+			green += colors[i].green * colors[i].alpha;
+			blue += colors[i].blue * colors[i].alpha;
+		}
+
+		result.red = (alpha > 0) ? red / alpha : 0;
+		result.green = (alpha > 0) ? green / alpha : 0;
+		result.blue = (alpha > 0) ? blue / alpha : 0;
+		return result;
+	}
 
+	result.red = (colors[0].red + colors[1].red + colors[2].red + colors[3].red)/4;
+	result.green = (colors[0].green + colors[1].green + colors[2].green + colors[3].green)/4;
+	result.blue = (colors[0].blue + colors[1].blue + colors[2].blue + colors[3].blue)/4;
+	return result;
+}
+
+
+
+
+/*
+*Brings the Quadtree up to date after the width by height block of source starting at (x, y) has *changed, without rebuilding the rest of the tree.
+*Only nodes overlapping the block are visited: their leaves are re-read from source, pruned leaves *that the block touches are split again (the parts of them outside the block keep their pruned *color), and the averages on the way back up to the root are recomputed. The cost is proportional to *the area of the block times the depth of the tree, not to the size of the image. The block is clipped *to the tree, and source must cover the clipped block.
+*/
+void Quadtree::updateRegion(PNG const & source, int x, int y, int width, int height){
+	QT_TIME_PHASE(counters.updateSeconds);
+
+	//clip the block to the region the tree represents
+	int right = min(x + width, rootResolution);
+	int bottom = min(y + height, rootResolution);
+	x = max(x, 0);
+	y = max(y, 0);
+
+	//nothing to do for an empty tree or an empty block
+	if(root == NULL || x >= right || y >= bottom){
+		return;
+	}
+
+	updateRegion(source, x, y, right, bottom, root, 0, 0, rootResolution);
+}
+
+//updateRegion helper function
+void Quadtree::updateRegion(PNG const & source, int x, int y, int right, int bottom, QuadtreeNode *& root, int rootX, int rootY, int resolution){
+	//base case, the node lies outside the edited block
+	if(rootX >= right || rootY >= bottom || rootX + resolution <= x || rootY + resolution <= y){
+		return;
+	}
+
+	//the node is about to change, so it must not be shared with another tree
+	unshare(root);
+
+	//base case, a single pixel is re-read from the source
+	if(resolution == 1){
+		root->element = *(source(rootX, rootY));
+		flatSums(root, 1);
+		rehash(root);
+		return;
+	}
+
+	//a pruned leaf is split again, its children start out with its color (and, in exact mode, as flat squares of it)
+	int half = resolution/2;
+	if(root->nwChild == NULL){
+		root->nwChild = new QuadtreeNode(root->element);
+		root->neChild = new QuadtreeNode(root->element);
+		root->swChild = new QuadtreeNode(root->element);
+		root->seChild = new QuadtreeNode(root->element);
+		QT_STAT(counters.nodesAllocated += 4);
+		flatSums(root->nwChild, half);
+		flatSums(root->neChild, half);
+		flatSums(root->swChild, half);
+		flatSums(root->seChild, half);
+		rehash(root->nwChild);
+		rehash(root->neChild);
+		rehash(root->swChild);
+		rehash(root->seChild);
+	}
+
+	//recursive call to each child with its upper left corner
+	updateRegion(source, x, y, right, bottom, root->nwChild, rootX, rootY, half);
+	updateRegion(source, x, y, right, bottom, root->neChild, rootX + half, rootY, half);
+	updateRegion(source, x, y, right, bottom, root->swChild, rootX, rootY + half, half);
+	updateRegion(source, x, y, right, bottom, root->seChild, rootX + half, rootY + half, half);
+
+	//recompute the color and hash on the path back up
+	average(root);
+	rehash(root);
 }
 
 
@@ -133,42 +403,38 @@ void Quadtree::buildTree(PNG const & source, int resolution, QuadtreeNode * root
 *Note that the Quadtree may not contain a node specifically corresponding to this pixel (due, for *instance, to pruning - see below). In this case, getPixel will retrieve the pixel (i.e. the color) *of the square region within which the smaller query grid cell would lie. (That is, it will return *the element of the nonexistent leaf's deepest surviving ancestor.) If the supplied coordinates fall *outside of the bounds of the underlying bitmap, or if the current Quadtree is "empty" (i.e., it was *created by the default constructor) then the returned RGBAPixel should be the one which is created *by the default RGBAPixel constructor.
 */
 RGBAPixel Quadtree::getPixel(int x, int y) const{
-	if(root != NULL && x <= root->resolution && y <= root->resolution){
-		return getPixel(x, y, root);
+	QT_STAT(counters.getPixelCalls++);
+
+	if(root != NULL && x >= 0 && y >= 0 && x < rootResolution && y < rootResolution){
+		return getPixel(x, y, root, rootResolution);
 	}
 
 	return RGBAPixel();
 }
 
-//getPixel helper function
-RGBAPixel Quadtree::getPixel(int x, int y, QuadtreeNode * root) const{
-	//base case, resolution reaches 1 it returns element
-	if((root->x == x && root->y == y && root->resolution ==1) || root->nwChild == NULL){
+//getPixel helper function, x and y are relative to the upper left corner of root
+RGBAPixel Quadtree::getPixel(int x, int y, QuadtreeNode * root, int resolution) const{
+	QT_STAT(counters.getPixelNodesVisited++);
+
+	//base case, a leaf (possibly a pruned one) covers the point
+	if(root->nwChild == NULL){
 		return root->element;
 	}
 
-	//if statements to see if x and y are within a specific child
-	if(range(x, y, root->nwChild)){
-		return getPixel(x, y, root->nwChild);
-	}
-	else if(range(x, y, root->neChild)){
-		return getPixel(x, y, root->neChild);
-	}
-	else if(range(x, y, root->swChild)){
-		return getPixel(x, y, root->swChild);
+	//descend into the child whose quadrant contains x and y
+	int half = resolution/2;
+	if(y < half){
+		if(x < half){
+			return getPixel(x, y, root->nwChild, half);
+		}
+		return getPixel(x - half, y, root->neChild, half);
 	}
 	else{
-		return getPixel(x , y, root->seChild);
+		if(x < half){
+			return getPixel(x, y - half, root->swChild, half);
+		}
+		return getPixel(x - half, y - half, root->seChild, half);
 	}
-
-}
-
-//getPixel helper function (returns weather or not x and y lies within a specific child passed by previous helper fucntion
-bool Quadtree::range(int x, int y, QuadtreeNode * root) const{
-	int xr = root->x + root->resolution;
-	int yr = root->y + root->resolution;
-
-	return ((x >= root->x && x < xr) && (y >= root->y && y < yr));
 }
 
 
@@ -180,10 +446,12 @@ bool Quadtree::range(int x, int y, QuadtreeNode * root) const{
 */
 
 PNG Quadtree::decompress() const{
+	QT_TIME_PHASE(counters.decompressSeconds);
+
 	//create PNG of size resolution by resolution call decompress and return changed value
 	if(root != NULL){
-		PNG retval(root->resolution, root->resolution);
-		decompress(root, retval);
+		PNG retval(rootResolution, rootResolution);
+		decompress(root, 0, 0, rootResolution, retval);
 		return retval;
 	}
 
@@ -191,22 +459,133 @@ PNG Quadtree::decompress() const{
 	return PNG();
 }
 
-//decompress helper function, pass PNG by reference and store current root's pixel in PNG using preorder traversal of the quad tree
-void Quadtree::decompress(QuadtreeNode * root, PNG &retval) const{
-	//returns if root is NULL
-	if(root == NULL){
+//decompress helper function, pass PNG by reference and paint each leaf's square using preorder traversal of the quad tree
+void Quadtree::decompress(QuadtreeNode * root, int x, int y, int resolution, PNG &retval) const{
+	//base case, a leaf fills the whole square it represents
+	if(root->nwChild == NULL){
+		for(int j = y; j < y + resolution; j++){
+			for(int i = x; i < x + resolution; i++){
+				*retval(i, j) = root->element;
+			}
+		}
 		return;
 	}
 
-	//temp variable stores resolution (for loop base case to get x and y values)
-	int res = root->resolution;
+	//recursive call to each child with its upper left corner
+	int half = resolution/2;
+	decompress(root->nwChild, x, y, half, retval);
+	decompress(root->neChild, x + half, y, half, retval);
+	decompress(root->swChild, x, y + half, half, retval);
+	decompress(root->seChild, x + half, y + half, half, retval);
+}
+
+/*
+*Returns the number of bytes one pixel takes in the given format.
+*/
+int Quadtree::bytesPerPixel(PixelFormat format){
+	return (format == RGB8) ? 3 : 4;
+}
+
+/*
+*Writes the image the Quadtree represents straight into caller-owned memory, with no intermediate PNG: *resolution rows of resolution pixels in the given format, row j starting stride bytes after row j - 1 *at dst. The stride must be at least resolution * bytesPerPixel(format); the bytes between the end of a *row and the start of the next one are left untouched. Nothing is written for an empty tree.
+*Each leaf's first row is built once and copied down the rest of its square.
+*/
+void Quadtree::decompressInto(uint8_t * dst, size_t stride, PixelFormat format) const{
+	QT_TIME_PHASE(counters.decompressSeconds);
+
+	if(root != NULL && dst != NULL){
+		decompressInto(root, dst, rootResolution, stride, format);
+	}
+}
+
+//decompressInto helper function, paints each leaf's square in preorder like decompress
+void Quadtree::decompressInto(QuadtreeNode * root, uint8_t * corner, int resolution, size_t stride, PixelFormat format) const{
+	//base case, a leaf writes its first row pixel by pixel, then copies it to the rows below
+	if(root->nwChild == NULL){
+		RGBAPixel const & color = root->element;
+		uint8_t pixel[4] = {color.red, color.green, color.blue, color.alpha};
+		if(format == BGRA8){
+			swap(pixel[0], pixel[2]);
+		}
+
+		//fixed-size copies, so each pixel is a single store
+		int bytes = bytesPerPixel(format);
+		if(bytes == 4){
+			for(int i = 0; i < resolution; i++){
+				memcpy(corner + (size_t) i * 4, pixel, 4);
+			}
+		}
+		else{
+			for(int i = 0; i < resolution; i++){
+				memcpy(corner + (size_t) i * 3, pixel, 3);
+			}
+		}
+
+		size_t rowBytes = (size_t) resolution * bytes;
+		for(int j = 1; j < resolution; j++){
+			memcpy(corner + j * stride, corner, rowBytes);
+		}
+		return;
+	}
+
+	//recursive call to each child with the address of its upper left pixel
+	int half = resolution/2;
+	size_t across = (size_t) half * bytesPerPixel(format);
+	size_t down = half * stride;
+	decompressInto(root->nwChild, corner, half, stride, format);
+	decompressInto(root->neChild, corner + across, half, stride, format);
+	decompressInto(root->swChild, corner + down, half, stride, format);
+	decompressInto(root->seChild, corner + down + across, half, stride, format);
+}
+
+/*
+*Returns the width by height rectangle of the image whose upper left corner is at x, y, reduced by a *factor of 2^level in each direction: output pixel (i, j) is the color of the node of size 2^level (or of *the leaf above it) covering pixel (x + i * 2^level, y + j * 2^level) of the image, so level 0 gives the *pixels themselves and each level up the averages of the next coarser nodes. The output is width / 2^level *by height / 2^level pixels, rounded up; pixels outside the tree keep the color of a new PNG.
+*Only the nodes over the rectangle are visited, down to the size the level asks for. Returns the default *PNG if the rectangle is empty or level is negative.
+*/
+PNG Quadtree::decompressRegion(int x, int y, int width, int height, int level) const{
+	if(width <= 0 || height <= 0 || level < 0 || level > 30){
+		return PNG();
+	}
+
+	int step = 1 << level;
+	PNG retval((width + step - 1)/step, (height + step - 1)/step);
+	if(root != NULL){
+		decompressRegion(root, 0, 0, rootResolution, x, y, step, retval);
+	}
+
+	return retval;
+}
+
+//decompressRegion helper function, the first sample index at or after offset pixels from the region's edge
+static int firstSample(int offset, int step){
+	return (offset > 0) ? (offset + step - 1)/step : -((-offset)/step);
+}
+
+//decompressRegion helper function, paints the samples that fall in root's square (nodeX, nodeY its corner, x, y the region's)
+void Quadtree::decompressRegion(QuadtreeNode * root, int nodeX, int nodeY, int resolution, int x, int y, int step, PNG & retval) const{
+	int firstI = max(0, firstSample(nodeX - x, step));
+	int endI = min((int) retval.width(), firstSample(nodeX + resolution - x, step));
+	int firstJ = max(0, firstSample(nodeY - y, step));
+	int endJ = min((int) retval.height(), firstSample(nodeY + resolution - y, step));
+	if(firstI >= endI || firstJ >= endJ){
+		return;
+	}
 
-	//stores pixel in PNG image using getPixel (PNG passed by reference here and returned above)
-	for(int x = 0; x < res; x++){
-		for(int y = 0; y < res; y++){
-			*retval(x,y) = getPixel(x, y);
+	//base case, a leaf or a node as coarse as the level asks for fills its samples
+	if(root->nwChild == NULL || resolution <= step){
+		for(int j = firstJ; j < endJ; j++){
+			for(int i = firstI; i < endI; i++){
+				*retval(i, j) = root->element;
+			}
 		}
+		return;
 	}
+
+	int half = resolution/2;
+	decompressRegion(root->nwChild, nodeX, nodeY, half, x, y, step, retval);
+	decompressRegion(root->neChild, nodeX + half, nodeY, half, x, y, step, retval);
+	decompressRegion(root->swChild, nodeX, nodeY + half, half, x, y, step, retval);
+	decompressRegion(root->seChild, nodeX + half, nodeY + half, half, x, y, step, retval);
 }
 
 
@@ -218,49 +597,89 @@ void Quadtree::decompress(QuadtreeNode * root, PNG &retval) const{
 */
 
 void Quadtree::clockwiseRotate(){
-	//call helper function if root is not null
+	rotate(1);
+}
+
+/*
+*Rotates the underlying image clockwise by quarterTurns * 90 degrees (a negative count rotates *counterclockwise).
+*Any number of turns costs a single traversal: nodes do not store their position, so every internal *node just has its four child pointers permuted the same way.
+*/
+void Quadtree::rotate(int quarterTurns){
+	QT_TIME_PHASE(counters.rotateSeconds);
+
+	//the slot each child moves to for one clockwise turn: nw <- sw, ne <- nw, sw <- se, se <- ne
+	int const clockwise[4] = {2, 0, 3, 1};
+	int order[4] = {0, 1, 2, 3};
+
+	//compose the permutation for the requested number of turns
+	int turns = ((quarterTurns % 4) + 4) % 4;
+	for(int t = 0; t < turns; t++){
+		int next[4];
+		for(int i = 0; i < 4; i++){
+			next[i] = order[clockwise[i]];
+		}
+		for(int i = 0; i < 4; i++){
+			order[i] = next[i];
+		}
+	}
+
+	//call helper function if root is not null and there is anything to do
+	if(root != NULL && turns != 0){
+		permute(root, order);
+	}
+}
+
+/*
+*Mirrors the underlying image left to right in a single traversal.
+*/
+void Quadtree::flipHorizontal(){
+	QT_TIME_PHASE(counters.rotateSeconds);
+
+	//nw <-> ne, sw <-> se
+	int const order[4] = {1, 0, 3, 2};
 	if(root != NULL){
-		clockwiseRotate(root);
+		permute(root, order);
 	}
+}
 
-	//return if root is null
-	return;
+/*
+*Mirrors the underlying image top to bottom in a single traversal.
+*/
+void Quadtree::flipVertical(){
+	QT_TIME_PHASE(counters.rotateSeconds);
+
+	//nw <-> sw, ne <-> se
+	int const order[4] = {2, 3, 0, 1};
+	if(root != NULL){
+		permute(root, order);
+	}
 }
 
-//clockwiseRotate helper function
-void Quadtree::clockwiseRotate(QuadtreeNode * root){
-	//if nwChild of root = NULL then return
+//rotate and flip helper function, slot i (nw, ne, sw, se) takes the child currently in slot order[i]
+void Quadtree::permute(QuadtreeNode *& root, int const order[4]){
+	//base case, leaves have nothing to permute
 	if(root->nwChild == NULL){
 		return;
 	}
 
-	//temp stores nwChild
-	QuadtreeNode * temp = root->nwChild;
+	//the node is about to change, so it must not be shared with another tree
+	unshare(root);
 
 	//pointer manipulation
-	root->nwChild = root->swChild;	//nwChild = swChild
-	root->swChild = root->seChild;	//swChild = seChild
-	root->seChild = root->neChild;	//seChild = neChild
-	root->neChild = temp;			//neChild = temp(nwChild)
-
-	//resets x and y values for each child after pointers manipulated to rotate 90 degrees
-	root->nwChild->x = root->x;
-	root->nwChild->y = root->y;
-
-	root->neChild->x = root->x + root->resolution/2;
-	root->neChild->y = root->y;
-
-	root->swChild->x = root->x;
-	root->swChild->y = root->y + root->resolution/2;
-
-	root->seChild->x = root->x + root->resolution/2;
-	root->seChild->y = root->y + root->resolution/2;
+	QuadtreeNode * children[4] = {root->nwChild, root->neChild, root->swChild, root->seChild};
+	root->nwChild = children[order[0]];
+	root->neChild = children[order[1]];
+	root->swChild = children[order[2]];
+	root->seChild = children[order[3]];
 
 	//recursive call
-	clockwiseRotate(root->nwChild);
-	clockwiseRotate(root->neChild);
-	clockwiseRotate(root->swChild);
-	clockwiseRotate(root->seChild);
+	permute(root->nwChild, order);
+	permute(root->neChild, order);
+	permute(root->swChild, order);
+	permute(root->seChild, order);
+
+	//the children moved, so the layout the hash covers changed
+	rehash(root);
 }
 
 
@@ -288,65 +707,151 @@ void Quadtree::clockwiseRotate(QuadtreeNode * root){
 *tolerance	The integer tolerance between two nodes that determines whether the subtree can be pruned.
 */
 
+template <class Metric>
 void Quadtree::prune(int tolerance){
+	QT_TIME_PHASE(counters.pruneSeconds);
+
 	if(root != NULL){
-		prune(root, tolerance);
+		QuadtreeNode * pruned = prune<Metric>(root, tolerance, -1, true);
+
+		//the root was shared, so the pruned tree starts from a new one
+		if(pruned != root){
+			clear(root);
+			root = pruned;
+		}
 	}
 
 	return;
 }
 
-//prune helper function
-void Quadtree::prune(QuadtreeNode * root, int tolerance){
+//prune helper function; nodes shared with other trees are never modified, the changed ones are copied
+//instead, so that pruning a copy only allocates along the paths it actually prunes
+template <class Metric>
+Quadtree::QuadtreeNode * Quadtree::prune(QuadtreeNode * root, int tolerance, double maxVariance, bool owned){
 	//base case, return when nwChild is null
 	if(root->nwChild == NULL){
-		return;
+		return root;
 	}
 
+	//root may only be modified in place if nothing else can reach it
+	owned = owned && root->refs == 1;
+
 	//if children are within tolerance then parents color = children average color and then clears out children and returns
-	if(checkTolerance(root, root, tolerance)){
+	if(prunable<Metric>(root, tolerance, maxVariance)){
+		if(owned){
+			average(root);
+
+			clear(root->nwChild);
+			clear(root->neChild);
+			clear(root->swChild);
+			clear(root->seChild);
+			rehash(root);
+			return root;
+		}
 
-		int red = (root->nwChild->element.red + root->neChild->element.red + root->swChild->element.red + root->seChild->element.red)/4;
-		int blue = (root->nwChild->element.blue + root->neChild->element.blue + root->swChild->element.blue + root->seChild->element.blue)/4;
-		int green = (root->nwChild->element.green + root->neChild->element.green + root->swChild->element.green + root->seChild->element.green)/4;
+		//a shared node is replaced by a new leaf
+		QuadtreeNode * leaf = new QuadtreeNode(root->element);
+		QT_STAT(counters.nodesAllocated++; counters.nodesCopied++);
+		average(leaf, root);
+		rehash(leaf);
+		return leaf;
+	}
 
-		root->element.red = red;
-		root->element.blue = blue;
-		root->element.green = green;
+	//recursive call to each child
+	QuadtreeNode * nw = prune<Metric>(root->nwChild, tolerance, maxVariance, owned);
+	QuadtreeNode * ne = prune<Metric>(root->neChild, tolerance, maxVariance, owned);
+	QuadtreeNode * sw = prune<Metric>(root->swChild, tolerance, maxVariance, owned);
+	QuadtreeNode * se = prune<Metric>(root->seChild, tolerance, maxVariance, owned);
+
+	//no child was replaced, though an owned one may have been pruned in place and changed its hash
+	if(nw == root->nwChild && ne == root->neChild && sw == root->swChild && se == root->seChild){
+		if(owned){
+			rehash(root);
+		}
+		return root;
+	}
 
-		clear(root->nwChild);
-		clear(root->neChild);
-		clear(root->swChild);
-		clear(root->seChild);
-		return;
+	//a shared node gets a copy that shares its unchanged children
+	QuadtreeNode * node = root;
+	if(!owned){
+		node = new QuadtreeNode(root->element);
+		QT_STAT(counters.nodesAllocated++; counters.nodesCopied++);
+		copySums(node, root);
+		node->nwChild = share(root->nwChild);
+		node->neChild = share(root->neChild);
+		node->swChild = share(root->swChild);
+		node->seChild = share(root->seChild);
 	}
 
-	//recursive call to each child
-	prune(root->nwChild, tolerance);
-	prune(root->neChild, tolerance);
-	prune(root->swChild, tolerance);
-	prune(root->seChild, tolerance);
+	//swap in the changed children, dropping the references to the ones they replace
+	if(nw != node->nwChild){
+		clear(node->nwChild);
+		node->nwChild = nw;
+	}
+	if(ne != node->neChild){
+		clear(node->neChild);
+		node->neChild = ne;
+	}
+	if(sw != node->swChild){
+		clear(node->swChild);
+		node->swChild = sw;
+	}
+	if(se != node->seChild){
+		clear(node->seChild);
+		node->seChild = se;
+	}
+
+	rehash(node);
+	return node;
+}
+
+//prune helper function, whether root is collapsed: its variance in exact mode when a variance limit is given, otherwise
+//the difference of its leaves from its color
+template <class Metric>
+bool Quadtree::prunable(QuadtreeNode * root, int tolerance, double maxVariance) const{
+	if(maxVariance >= 0){
+		return root->sums != NULL && variance(*root->sums) <= maxVariance;
+	}
+
+	return checkTolerance<Metric>(root, root, tolerance);
+}
+
+//prune helper function, squared Metric difference of two colors plus the squared alpha difference; premultiplied colors
+//are scaled by their alpha first, so any two fully transparent pixels are equal
+template <class Metric>
+int Quadtree::distance(RGBAPixel const & first, RGBAPixel const & second) const{
+	int alpha = first.alpha - second.alpha;
+
+	if(premultiplied){
+		RGBAPixel scaledFirst(first.red * first.alpha / 255, first.green * first.alpha / 255, first.blue * first.alpha / 255);
+		RGBAPixel scaledSecond(second.red * second.alpha / 255, second.green * second.alpha / 255, second.blue * second.alpha / 255);
+		return Metric::distance(scaledFirst, scaledSecond) + alpha * alpha;
+	}
+
+	return Metric::distance(first, second) + alpha * alpha;
 }
 
 //prune helper function to see if child lies within tolerance of its parent node
-bool Quadtree::checkTolerance(QuadtreeNode * root, QuadtreeNode * other, int tolerance) const{
+template <class Metric>
+bool Quadtree::checkTolerance(QuadtreeNode * root, QuadtreeNode * other, int tolerance, int depth) const{
+#ifdef QUADTREE_STATS
+	counters.checkToleranceCalls++;
+	if(depth > counters.checkToleranceMaxDepth){
+		counters.checkToleranceMaxDepth = depth;
+	}
+#endif
+
 	//base case, return true or false when nwChild is NULL
 	if(other->nwChild == NULL){
-		//runs difference algorithm
-		int red = ((other->element.red - root->element.red) * (other->element.red - root->element.red));
-		int blue = ((other->element.blue - root->element.blue) * (other->element.blue - root->element.blue));
-		int green = ((other->element.green - root->element.green) * (other->element.green - root->element.green));
-		int dif = (red + green + blue);
-
 		//true if difference is less than or equal to tolerance
-		return dif <= tolerance;
+		return distance<Metric>(other->element, root->element) <= tolerance;
 	}
 
 	//recursive call, for prune to occur base case needs to be true for all children
-	return (checkTolerance(root, other->nwChild, tolerance)&&
-			checkTolerance(root, other->neChild, tolerance)&&
-			checkTolerance(root, other->swChild, tolerance)&&
-			checkTolerance(root, other->seChild, tolerance));
+	return (checkTolerance<Metric>(root, other->nwChild, tolerance, depth + 1)&&
+			checkTolerance<Metric>(root, other->neChild, tolerance, depth + 1)&&
+			checkTolerance<Metric>(root, other->swChild, tolerance, depth + 1)&&
+			checkTolerance<Metric>(root, other->seChild, tolerance, depth + 1));
 }
 
 
@@ -363,10 +868,14 @@ bool Quadtree::checkTolerance(QuadtreeNode * root, QuadtreeNode * other, int tol
 *How many leaves this Quadtree would have if it were pruned with the given tolerance.
 */
 
+template <class Metric>
 int Quadtree::pruneSize(int tolerance) const{
+	QT_TIME_PHASE(counters.pruneSizeSeconds);
+	QT_STAT(counters.pruneSizeCalls++);
+
 	//call helper function if root is not null and tolerance is greater than or equal to 0
 	if(root != NULL && tolerance >= 0){
-		return pruneSize(root, tolerance);
+		return pruneSize<Metric>(root, tolerance);
 	}
 
 	//if either condition above fails then return 0
@@ -374,6 +883,7 @@ int Quadtree::pruneSize(int tolerance) const{
 }
 
 //pruneSize helper function
+template <class Metric>
 int Quadtree::pruneSize(QuadtreeNode * root, int tolerance) const{
 	//base case, if nwChild is null then returns 1
 	if(root->nwChild == NULL){
@@ -381,12 +891,12 @@ int Quadtree::pruneSize(QuadtreeNode * root, int tolerance) const{
 	}
 
 	//base case, if current node is within tolerance then return one
-	if(checkTolerance(root, root, tolerance)){
+	if(checkTolerance<Metric>(root, root, tolerance)){
 		return 1;
 	}
 
 	//adds each call of each child called recursively, this returns number of leaves given a tolerance
-	return pruneSize(root->nwChild, tolerance) + pruneSize(root->neChild, tolerance) + pruneSize(root->swChild, tolerance) + pruneSize(root->seChild, tolerance);
+	return pruneSize<Metric>(root->nwChild, tolerance) + pruneSize<Metric>(root->neChild, tolerance) + pruneSize<Metric>(root->swChild, tolerance) + pruneSize<Metric>(root->seChild, tolerance);
 }
 
 
@@ -408,96 +918,818 @@ int Quadtree::pruneSize(QuadtreeNode * root, int tolerance) const{
 *The "obvious" implementation involves a sort of linear search over all possible tolerances. What if *you tried a binary search instead?
 */
 
+template <class Metric>
 int Quadtree::idealPrune(int numLeaves) const{
-	//calls helper function if root is not null
+	QT_TIME_PHASE(counters.idealPruneSeconds);
+	QT_STAT(counters.idealPruneCalls++);
+
+	//searches the tolerances if root is not null; the search is shared with FixedQuadtree and BasicQuadtree
 	if(root != NULL){
-		return idealPrune(0, 255 * 255 * 3, numLeaves);
+		auto leaves = [this](int tolerance){ return pruneSize<Metric>(tolerance); };
+#ifdef QUADTREE_STATS
+		long before = counters.pruneSizeCalls;
+		int tolerance = idealPruneSearch(leaves, 0, Metric::maxDistance + 255 * 255, numLeaves);
+		counters.lastIdealPrunePruneSizeCalls = counters.pruneSizeCalls - before;
+		if(counters.lastIdealPrunePruneSizeCalls > counters.maxIdealPrunePruneSizeCalls){
+			counters.maxIdealPrunePruneSizeCalls = counters.lastIdealPrunePruneSizeCalls;
+		}
+		return tolerance;
+#else
+		return idealPruneSearch(leaves, 0, Metric::maxDistance + 255 * 255, numLeaves);
+#endif
 	}
 
 	//if root is null returns 0
 	return 0;
 }
 
-//idealPrune helper function
-int Quadtree::idealPrune(int lower, int upper, int numLeaves) const{
-	//temp variable representing leaves returned from pruneSize
-	int tol;
+//the prune family is compiled once for each metric in colormetric.h
+#define QUADTREE_INSTANTIATE_METRIC(Metric) \
+	template void Quadtree::buildPruned<Metric>(PNG const &, int, int); \
+	template void Quadtree::prune<Metric>(int); \
+	template int Quadtree::pruneSize<Metric>(int) const; \
+	template int Quadtree::idealPrune<Metric>(int) const; \
+	template bool Quadtree::checkTolerance<Metric>(QuadtreeNode *, QuadtreeNode *, int, int) const;
 
-	//if lowerbound ever goes over the upper bound then return the lower bound
-	if(lower > upper){
-		return lower;
+QUADTREE_INSTANTIATE_METRIC(RgbMetric)
+QUADTREE_INSTANTIATE_METRIC(LumaRgbMetric)
+QUADTREE_INSTANTIATE_METRIC(YCbCrMetric)
+QUADTREE_INSTANTIATE_METRIC(LabMetric)
+
+#undef QUADTREE_INSTANTIATE_METRIC
+
+
+
+
+//pruneToLeafCount bookkeeping for one internal node, indexed in preorder
+struct Quadtree::PruneCandidate{
+	int parent;    //index of the parent's candidate, -1 for the root
+	int error;     //smallest tolerance at which prune collapses the node or one of its ancestors
+	int pending;   //children that are still internal nodes
+	int size;      //internal nodes in the subtree, the node included
+	bool collapse; //whether the node becomes a leaf
+	bool changed;  //whether the node or one below it becomes a leaf
+};
+
+/*
+*Prunes the Quadtree down to at most numLeaves leaves, collapsing one node at a time and measuring *colors with Metric.
+*Nodes are collapsed in the order a rising tolerance would collapse them: a node's error is the *smallest tolerance at which prune<Metric> removes its children, that is the smaller of its own *largest difference to a leaf below it and its parent's error. The tree therefore passes through *prune<Metric>(t) for every t, and at any leaf count prune reaches it is never worse than *prune<Metric>(idealPrune<Metric>(numLeaves)), but unlike it this lands within three leaves of any *budget. Each collapse removes three leaves, so the result has between numLeaves - 2 and numLeaves *leaves (or a single leaf if numLeaves < 1). Takes O(N log N) time for N nodes.
+*/
+template <class Metric>
+void Quadtree::pruneToLeafCount(int numLeaves){
+	QT_TIME_PHASE(counters.pruneSeconds);
+
+	if(root == NULL){
+		return;
+	}
+
+	//number the internal nodes in preorder, caching each one's error
+	vector<PruneCandidate> candidates;
+	collectCandidates<Metric>(root, -1, candidates);
+
+	//nodes whose children are all leaves, smallest error (then earliest in preorder) first
+	typedef pair<int, int> Entry;
+	priority_queue<Entry, vector<Entry>, greater<Entry> > ready;
+	for(size_t i = 0; i < candidates.size(); i++){
+		if(candidates[i].pending == 0){
+			ready.push(Entry(candidates[i].error, i));
+		}
 	}
 
-	//store leaves of lower+upper/2
-	tol = pruneSize((lower + upper)/2);
+	//collapse the cheapest node until the budget is met, its parent may become collapsible in turn
+	int leaves = 3 * candidates.size() + 1;
+	while(leaves > numLeaves && !ready.empty()){
+		int index = ready.top().second;
+		ready.pop();
+
+		candidates[index].collapse = true;
+		leaves -= 3;
 
-	//if tolerance = number of leaves and if tolerance = number of leaves with 1 less then recursive cal with half of lower+upper - 1;
-	if(tol == numLeaves){
-		if(tol == pruneSize(((lower + upper)/2)-1)){
-			return idealPrune(0, ((lower + upper)/2)-1, numLeaves);
+		int parent = candidates[index].parent;
+		if(parent >= 0 && --candidates[parent].pending == 0){
+			ready.push(Entry(candidates[parent].error, parent));
 		}
+	}
 
-		//if the num leaves from 'tol' doesnt statisfy then return lower+upper/2
-		return (lower+upper)/2;
+	//mark the paths down to the collapsed nodes, parents come before their children in preorder
+	for(size_t i = candidates.size(); i-- > 0; ){
+		candidates[i].changed = candidates[i].changed || candidates[i].collapse;
+		if(candidates[i].changed && candidates[i].parent >= 0){
+			candidates[candidates[i].parent].changed = true;
+		}
 	}
 
-	//if number of leaves produced by given tolerance is > numLeaves then divide lower+upper and add 1 to value for the lower bound
-	else if(tol > numLeaves){
-		return idealPrune(((lower + upper)/2)+1, upper, numLeaves);
+	collapseMarked(root, 0, candidates);
+}
+
+//pruneToLeafCount helper function, appends root's subtree to candidates in preorder
+template <class Metric>
+int Quadtree::collectCandidates(QuadtreeNode * root, int parent, vector<PruneCandidate> & candidates) const{
+	//base case, leaves cannot be collapsed
+	if(root->nwChild == NULL){
+		return -1;
 	}
 
-	//if number of leaves produced by given tolerance is < numLeaves then divide lower+upper subtract 1 to value for the upper bound
-	else if(tol < numLeaves){
-		return idealPrune(lower, ((lower+upper)/2)-1, numLeaves);
+	int index = candidates.size();
+	//once the parent collapses this node goes with it, so its error is at most the parent's
+	int error = maxError<Metric>(root, root);
+	if(parent >= 0){
+		error = min(error, candidates[parent].error);
 	}
 
-	//return 0 if no conditions are met
-	else{
-		return 0;
+	PruneCandidate candidate = {parent, error, 0, 0, false, false};
+	candidates.push_back(candidate);
+
+	//recursive call to each child, counting the ones that are internal
+	QuadtreeNode * children[4] = {root->nwChild, root->neChild, root->swChild, root->seChild};
+	for(int i = 0; i < 4; i++){
+		if(collectCandidates<Metric>(children[i], index, candidates) >= 0){
+			candidates[index].pending++;
+		}
 	}
+
+	candidates[index].size = candidates.size() - index;
+	return index;
 }
 
+//pruneToLeafCount helper function, the same difference checkTolerance compares against the tolerance
+template <class Metric>
+int Quadtree::maxError(QuadtreeNode * root, QuadtreeNode * other) const{
+	//base case, difference between root and a leaf
+	if(other->nwChild == NULL){
+		return distance<Metric>(other->element, root->element);
+	}
 
+	//recursive call to each child, keeping the largest
+	return max(max(maxError<Metric>(root, other->nwChild), maxError<Metric>(root, other->neChild)),
+			   max(maxError<Metric>(root, other->swChild), maxError<Metric>(root, other->seChild)));
+}
 
+//pruneToLeafCount helper function, walks the tree in the order collectCandidates numbered it
+int Quadtree::collapseMarked(QuadtreeNode *& root, int index, vector<PruneCandidate> const & candidates){
+	//base case, leaves were not numbered
+	if(root->nwChild == NULL){
+		return index;
+	}
 
-//copy function to assist "Big Three" functions
-void Quadtree::copy(const Quadtree & other){
-	//checks to make sure we have a tree to even copy first
-	if(other.root == NULL){
-		root = NULL;
+	PruneCandidate const & candidate = candidates[index];
+
+	//the node becomes a leaf; its color already is the average of its children, as prune would set it
+	if(candidate.collapse){
+		if(root->refs == 1){
+			clear(root->nwChild);
+			clear(root->neChild);
+			clear(root->swChild);
+			clear(root->seChild);
+			rehash(root);
+		}
+		else{
+			//a shared node is replaced by a new leaf
+			QuadtreeNode * leaf = new QuadtreeNode(root->element);
+			QT_STAT(counters.nodesAllocated++; counters.nodesCopied++);
+			copySums(leaf, root);
+			rehash(leaf);
+			clear(root);
+			root = leaf;
+		}
+		return index + candidate.size;
+	}
+
+	//nothing below changes, skip the subtree
+	if(!candidate.changed){
+		return index + candidate.size;
+	}
+
+	//the node is about to change, so it must not be shared with another tree
+	unshare(root);
+
+	//recursive call to each child
+	int next = index + 1;
+	next = collapseMarked(root->nwChild, next, candidates);
+	next = collapseMarked(root->neChild, next, candidates);
+	next = collapseMarked(root->swChild, next, candidates);
+	next = collapseMarked(root->seChild, next, candidates);
+	rehash(root);
+	return next;
+}
+
+//the greedy prune is compiled for the same metrics as the rest of the prune family
+template void Quadtree::pruneToLeafCount<RgbMetric>(int);
+template void Quadtree::pruneToLeafCount<LumaRgbMetric>(int);
+template void Quadtree::pruneToLeafCount<YCbCrMetric>(int);
+template void Quadtree::pruneToLeafCount<LabMetric>(int);
+
+
+
+
+/*
+*Switches exact mode on or off. In exact mode every node keeps 64-bit sums and sums of squares of the *red, green, blue and alpha values of the source pixels below it, and its color is the truncated true mean of *those pixels rather than the truncated average of its children's truncated averages. The mean and *variance of any node then cost a single lookup, which pruneByVariance relies on.
+*Switching it on computes the sums from the current leaves (each leaf counts as a square of its own *color, which is exact for a tree that has not been pruned yet) and recolors the internal nodes; the *mode is kept by buildTree, read and copies. Switching it off frees the sums.
+*/
+void Quadtree::setExactSums(bool enabled){
+	if(exactSums == enabled){
 		return;
 	}
 
-	//root is copied
-	root = new QuadtreeNode(other.root->element, other.root->resolution, other.root->x, other.root->y);
+	exactSums = enabled;
+	if(root != NULL){
+		recompute(root, rootResolution);
+	}
+}
 
-	//if all children are NULL then stop here
-	if(other.root->nwChild == NULL && other.root->neChild == NULL && other.root->swChild == NULL && other.root->seChild == NULL){
+/*
+*Returns whether the Quadtree keeps exact sums (see setExactSums).
+*/
+bool Quadtree::hasExactSums() const{
+	return exactSums;
+}
+
+/*
+*Switches premultiplied alpha on or off. Alpha is always averaged and compared like the other channels; *in premultiplied mode the colors of an average are also weighted by their alpha, and prune compares *colors scaled by their alpha, so transparent areas collapse into single leaves whatever color their *pixels carry. Leaves keep their straight colors, so decompress is unaffected. Switching recolors the *internal nodes (and, in exact mode, the sums); the mode is kept by buildTree, read and copies.
+*/
+void Quadtree::setPremultipliedAlpha(bool enabled){
+	if(premultiplied == enabled){
 		return;
 	}
 
-	//call helper
-	copy(root, other.root, other.root->resolution);
+	premultiplied = enabled;
+	if(root != NULL){
+		recompute(root, rootResolution);
+	}
 }
 
+/*
+*Returns whether the Quadtree averages and compares premultiplied colors (see setPremultipliedAlpha).
+*/
+bool Quadtree::hasPremultipliedAlpha() const{
+	return premultiplied;
+}
 
-//copy helper function
-void Quadtree::copy(QuadtreeNode * root, QuadtreeNode * other, int resolution){
-	//if all children are not null
-	if(other->nwChild == NULL){
+/*
+*Prunes every subtree whose source pixels have a variance (the mean squared distance from their mean, *summed over red, green, blue and alpha) of at most maxVariance, as prune does with its tolerance. This is *the same scale as prune's tolerance, but averaged over the pixels instead of taken at the worst one, *and each decision is a single lookup instead of a walk over the subtree.
+*Pruned leaves keep the sums of the pixels they replace, so pruning again stays exact. Does nothing *unless the tree is in exact mode (see setExactSums).
+*/
+void Quadtree::pruneByVariance(double maxVariance){
+	QT_TIME_PHASE(counters.pruneSeconds);
+
+	if(root != NULL && exactSums && maxVariance >= 0){
+		QuadtreeNode * pruned = prune<RgbMetric>(root, -1, maxVariance, true);
+
+		//the root was shared, so the pruned tree starts from a new one
+		if(pruned != root){
+			clear(root);
+			root = pruned;
+		}
+	}
+}
+
+//exact sums helper function, used for new leaves (a source pixel, or a split leaf's quarters) in exact mode
+void Quadtree::flatSums(QuadtreeNode * root, int resolution){
+	if(!exactSums){
+		return;
+	}
+
+	if(root->sums == NULL){
+		root->sums = new NodeSums;
+	}
+
+	*root->sums = flatTotals(root->element, (uint64_t) resolution * resolution);
+}
+
+//exact sums helper function, the sums of count pixels of one color (premultiplied sums total color times alpha)
+Quadtree::NodeSums Quadtree::flatTotals(RGBAPixel const & color, uint64_t count) const{
+	uint64_t weight = premultiplied ? color.alpha : 1;
+	uint64_t const channels[4] = {color.red * weight, color.green * weight, color.blue * weight, color.alpha};
+	uint8_t const straight[4] = {color.red, color.green, color.blue, color.alpha};
+
+	NodeSums totals;
+	totals.count = count;
+	for(int c = 0; c < 4; c++){
+		totals.sum[c] = count * channels[c];
+		totals.squares[c] = count * channels[c] * channels[c];
+		totals.low[c] = straight[c];
+		totals.high[c] = straight[c];
+	}
+
+	return totals;
+}
+
+//exact sums helper function, sums of no pixels, whose bounds any pixel widens
+Quadtree::NodeSums Quadtree::emptySums(){
+	NodeSums totals = {0, {0, 0, 0, 0}, {0, 0, 0, 0}, {255, 255, 255, 255}, {0, 0, 0, 0}};
+	return totals;
+}
+
+//exact sums helper function, merges the pixels of other into totals
+void Quadtree::addSums(NodeSums & totals, NodeSums const & other){
+	totals.count += other.count;
+	for(int c = 0; c < 4; c++){
+		totals.sum[c] += other.sum[c];
+		totals.squares[c] += other.squares[c];
+		totals.low[c] = min(totals.low[c], other.low[c]);
+		totals.high[c] = max(totals.high[c], other.high[c]);
+	}
+}
+
+//exact sums helper function, the truncated mean color of at least one pixel; premultiplied sums divide by the total
+//alpha instead of the pixel count
+RGBAPixel Quadtree::meanColor(NodeSums const & sums) const{
+	uint64_t weight = premultiplied ? sums.sum[3] : sums.count;
+	RGBAPixel color;
+	color.red = (weight > 0) ? sums.sum[0] / weight : 0;
+	color.green = (weight > 0) ? sums.sum[1] / weight : 0;
+	color.blue = (weight > 0) ? sums.sum[2] / weight : 0;
+	color.alpha = sums.sum[3] / sums.count;
+	return color;
+}
+
+//exact sums helper function, copies travel with their sums
+void Quadtree::copySums(QuadtreeNode * root, QuadtreeNode const * other){
+	if(other->sums != NULL){
+		root->sums = new NodeSums(*other->sums);
+	}
+}
+
+//setExactSums and setPremultipliedAlpha helper function, rebuilds (or frees) the sums and colors bottom up
+void Quadtree::recompute(QuadtreeNode *& root, int resolution){
+	//the node is about to change, so it must not be shared with another tree
+	unshare(root);
+
+	//base case, leaves are flat squares
+	if(root->nwChild == NULL){
+		if(exactSums){
+			flatSums(root, resolution);
+		}
+		else{
+			delete root->sums;
+			root->sums = NULL;
+		}
 		return;
 	}
-		//set all children of root to new copied values
-		root->nwChild = new QuadtreeNode(other->nwChild->element, other->nwChild->resolution, other->nwChild->x, other->nwChild->y);
-		root->neChild = new QuadtreeNode(other->neChild->element, other->neChild->resolution, other->neChild->x, other->neChild->y);
-		root->swChild = new QuadtreeNode(other->swChild->element, other->swChild->resolution, other->swChild->x, other->swChild->y);
-		root->seChild = new QuadtreeNode(other->seChild->element, other->seChild->resolution, other->seChild->x, other->seChild->y);
 
-		//recursive call
-		copy(root->nwChild, other->nwChild, resolution/2);
-		copy(root->neChild, other->neChild, resolution/2);
-		copy(root->swChild, other->swChild, resolution/2);
-		copy(root->seChild, other->seChild, resolution/2);
+	//recursive call to each child
+	int half = resolution/2;
+	recompute(root->nwChild, half);
+	recompute(root->neChild, half);
+	recompute(root->swChild, half);
+	recompute(root->seChild, half);
+
+	if(!exactSums){
+		delete root->sums;
+		root->sums = NULL;
+	}
+	average(root);
+}
+
+//exact sums helper function, sum over the channels of E[v^2] - E[v]^2 (premultiplied colors are scaled back to 0-255)
+double Quadtree::variance(NodeSums const & sums) const{
+	double total = 0;
+	for(int c = 0; c < 4; c++){
+		double mean = (double) sums.sum[c] / sums.count;
+		double channel = (double) sums.squares[c] / sums.count - mean * mean;
+		total += (premultiplied && c < 3) ? channel / (255.0 * 255.0) : channel;
+	}
+
+	return total;
+}
+
+
+
+
+/*
+*Returns the width (and height) of the square region this Quadtree represents, or 0 if the Quadtree *is empty.
+*/
+int Quadtree::getResolution() const{
+	if(root != NULL){
+		return rootResolution;
+	}
+
+	return 0;
+}
+
+/*
+*Returns the number of leaves currently in the Quadtree (0 if the Quadtree is empty).
+*/
+int Quadtree::leafCount() const{
+	if(root != NULL){
+		return leafCount(root);
+	}
+
+	return 0;
+}
+
+//leafCount helper function
+int Quadtree::leafCount(QuadtreeNode * root) const{
+	//base case, a node without children is a single leaf
+	if(root->nwChild == NULL){
+		return 1;
+	}
+
+	return leafCount(root->nwChild) + leafCount(root->neChild) + leafCount(root->swChild) + leafCount(root->seChild);
+}
+
+/*
+*Returns the total number of nodes (internal nodes and leaves) in the Quadtree (0 if the Quadtree is *empty).
+*/
+int Quadtree::nodeCount() const{
+	if(root != NULL){
+		return nodeCount(root);
+	}
+
+	return 0;
+}
+
+//nodeCount helper function
+int Quadtree::nodeCount(QuadtreeNode * root) const{
+	//base case, a leaf counts only itself
+	if(root->nwChild == NULL){
+		return 1;
+	}
+
+	return 1 + nodeCount(root->nwChild) + nodeCount(root->neChild) + nodeCount(root->swChild) + nodeCount(root->seChild);
+}
+
+/*
+*Returns a 64-bit hash of the leaves' colors and layout (0 if the Quadtree is empty). Every change to the tree keeps it
+*current, so it costs nothing to read: trees with different hashes differ, and equal trees always hash alike. Internal
+*colors, exact sums and the resolution are not covered, just as operator== ignores them.
+*/
+uint64_t Quadtree::hash() const{
+	if(root != NULL){
+		return root->hash;
+	}
+
+	return 0;
+}
+
+//hash helper function, the 64-bit finalizer of splitmix64: spreads every input bit over the whole value
+static uint64_t mixHash(uint64_t value){
+	value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+	return value ^ (value >> 31);
+}
+
+//hash helper function, a Merkle hash: a leaf hashes its color, an internal node its children's hashes in order (the two
+//kinds are seeded differently so a leaf never hashes like a split square). Callers rehash a node after its children do
+void Quadtree::rehash(QuadtreeNode * root){
+	//base case, a leaf packs its four channels
+	if(root->nwChild == NULL){
+		RGBAPixel const & color = root->element;
+		uint64_t packed = (uint64_t) color.red | (uint64_t) color.green << 8 | (uint64_t) color.blue << 16 | (uint64_t) color.alpha << 24;
+		root->hash = mixHash(packed ^ 0x9e3779b97f4a7c15ULL);
+		return;
+	}
+
+	uint64_t value = 0x632be59bd9b4e019ULL;
+	value = mixHash(value + root->nwChild->hash);
+	value = mixHash(value + root->neChild->hash);
+	value = mixHash(value + root->swChild->hash);
+	value = mixHash(value + root->seChild->hash);
+	root->hash = value;
+}
+
+
+
+
+/*
+*Writes the Quadtree to a stream in a compact binary format:
+*
+*  4 bytes   magic "QTR1"
+*  4 bytes   resolution, little endian (0 for an empty tree)
+*  preorder  for every node, one flag byte: 0 for a leaf, followed by its red, green, blue and alpha *bytes, or 1 for an internal node, followed by its nw, ne, sw and se subtrees.
+*
+*Colors of internal nodes are not stored; read() recomputes them from the children the same way *buildTree does.
+*/
+void Quadtree::write(ostream & out) const{
+	int resolution = getResolution();
+	char header[8] = {'Q', 'T', 'R', '1',
+					  (char)(resolution & 0xff), (char)((resolution >> 8) & 0xff),
+					  (char)((resolution >> 16) & 0xff), (char)((resolution >> 24) & 0xff)};
+	out.write(header, 8);
+
+	if(root != NULL){
+		write(out, root);
+	}
+}
+
+//write helper function, preorder traversal emitting split flags and leaf colors
+void Quadtree::write(ostream & out, QuadtreeNode * root) const{
+	//base case, leaves write their flag and color
+	if(root->nwChild == NULL){
+		char leaf[5] = {0, (char)root->element.red, (char)root->element.green, (char)root->element.blue, (char)root->element.alpha};
+		out.write(leaf, 5);
+		return;
+	}
+
+	out.put(1);
+	write(out, root->nwChild);
+	write(out, root->neChild);
+	write(out, root->swChild);
+	write(out, root->seChild);
+}
+
+/*
+*Replaces the contents of this Quadtree with a tree read from a stream written by write(), *writeCompact() or writeProgressive(). Returns *false, leaving the Quadtree empty, if the stream is truncated or malformed. A header claiming more than *maxResolution pixels a side is rejected, since decompressing the tree would allocate that many.
+*/
+bool Quadtree::read(istream & in, int maxResolution){
+	clear(root);
+	rootResolution = 0;
+
+	//the compact format of writeCompact and the progressive format of writeProgressive have their own magic
+	unsigned char header[8];
+	if(!in.read((char *)header, 8) || header[0] != 'Q' || header[1] != 'T' || (header[2] != 'R' && header[2] != 'C' && header[2] != 'P') || header[3] != '1'){
+		return false;
+	}
+
+	int resolution = header[4] | (header[5] << 8) | (header[6] << 16) | (header[7] << 24);
+
+	//an empty tree has nothing after its header
+	if(resolution == 0){
+		return true;
+	}
+
+	//resolution must be a positive power of two, and no larger than the caller will allocate for
+	if(resolution < 0 || resolution > maxResolution || (resolution & (resolution - 1)) != 0){
+		return false;
+	}
+
+	if(header[2] == 'C'){
+		root = readCompact(in, resolution);
+	}
+	else if(header[2] == 'P'){
+		root = readProgressive(in, resolution);
+	}
+	else{
+		root = readPlain(in, resolution);
+	}
+	rootResolution = (root != NULL) ? resolution : 0;
+	return root != NULL;
+}
+
+//read helper function, rebuilds a subtree in preorder and recomputes its internal colors
+Quadtree::QuadtreeNode * Quadtree::readPlain(istream & in, int resolution){
+	int flag = in.get();
+
+	//base case, leaves carry their color
+	if(flag == 0){
+		unsigned char color[4];
+		if(!in.read((char *)color, 4)){
+			return NULL;
+		}
+
+		QuadtreeNode * leaf = new QuadtreeNode(RGBAPixel(color[0], color[1], color[2], color[3]));
+		QT_STAT(counters.nodesAllocated++);
+		flatSums(leaf, resolution);
+		rehash(leaf);
+		return leaf;
+	}
+
+	//a node of resolution one cannot be split
+	if(flag != 1 || resolution == 1){
+		return NULL;
+	}
+
+	QuadtreeNode * node = new QuadtreeNode();
+	QT_STAT(counters.nodesAllocated++);
+	int half = resolution/2;
+
+	node->nwChild = readPlain(in, half);
+	node->neChild = (node->nwChild != NULL) ? readPlain(in, half) : NULL;
+	node->swChild = (node->neChild != NULL) ? readPlain(in, half) : NULL;
+	node->seChild = (node->swChild != NULL) ? readPlain(in, half) : NULL;
+
+	//stops at the first malformed child and frees what was read so far
+	if(node->seChild == NULL){
+		clear(node);
+		return NULL;
+	}
+
+	average(node);
+	rehash(node);
+	return node;
+}
+
+/*
+*Writes the Quadtree to a file using write(). Returns whether the file was written successfully.
+*/
+bool Quadtree::writeToFile(string const & file_name) const{
+	ofstream out(file_name.c_str(), ios::binary);
+	if(!out){
+		return false;
+	}
+
+	write(out);
+	return (bool)out;
+}
+
+/*
+*Replaces the contents of this Quadtree with a tree read from a file written by writeToFile(). *Returns false, leaving the Quadtree empty, on failure or if the tree is larger than maxResolution.
+*/
+bool Quadtree::readFromFile(string const & file_name, int maxResolution){
+	ifstream in(file_name.c_str(), ios::binary);
+	if(!in){
+		clear(root);
+		return false;
+	}
+
+	return read(in, maxResolution);
+}
+
+
+
+
+/*
+*Returns the changes that turn this Quadtree into target: a list of the smallest subtrees of target *that differ from the subtree at the same square of this tree. A square whose four quarters all *changed is recorded once, as a whole.
+*Both trees should have the same resolution; if they do not, the delta simply replaces the whole *tree.
+*/
+QuadtreeDelta Quadtree::diff(Quadtree const & target) const{
+	QuadtreeDelta delta;
+	delta._resolution = target.getResolution();
+
+	//an empty target is expressed by a delta with resolution 0 and no changes
+	if(target.root == NULL){
+		return delta;
+	}
+
+	if(root == NULL || rootResolution != target.rootResolution){
+		addChange(target.root, 0, 0, target.rootResolution, delta);
+		return delta;
+	}
+
+	diff(root, target.root, 0, 0, rootResolution, delta);
+	return delta;
+}
+
+//diff helper function
+bool Quadtree::diff(QuadtreeNode * root, QuadtreeNode * other, int x, int y, int resolution, QuadtreeDelta & delta) const{
+	//base case, a subtree shared by both trees is unchanged
+	if(root == other){
+		return false;
+	}
+
+	//base case, matching hashes are confirmed by comparing the leaves, which is cheaper than walking them here
+	if(root->hash == other->hash && compareTrees(root, other)){
+		return false;
+	}
+
+	//base case, two leaves differ only if their colors do
+	if(root->nwChild == NULL && other->nwChild == NULL){
+		if(root->element == other->element){
+			return false;
+		}
+
+		addChange(other, x, y, resolution, delta);
+		return true;
+	}
+
+	//base case, the shapes differ so other's subtree replaces root's
+	if(root->nwChild == NULL || other->nwChild == NULL){
+		addChange(other, x, y, resolution, delta);
+		return true;
+	}
+
+	//recursive call to each child; the subtrees differ, so at least one quarter changed
+	int half = resolution/2;
+	bool nw = diff(root->nwChild, other->nwChild, x, y, half, delta);
+	bool ne = diff(root->neChild, other->neChild, x + half, y, half, delta);
+	bool sw = diff(root->swChild, other->swChild, x, y + half, half, delta);
+	bool se = diff(root->seChild, other->seChild, x + half, y + half, half, delta);
+
+	//if all four quarters were replaced, replace this square in one change instead
+	if(nw && ne && sw && se){
+		delta._changes.resize(delta._changes.size() - 4);
+		addChange(other, x, y, resolution, delta);
+		return true;
+	}
+
+	return false;
+}
+
+//diff helper function, records other's subtree as a change
+void Quadtree::addChange(QuadtreeNode * other, int x, int y, int resolution, QuadtreeDelta & delta) const{
+	ostringstream out;
+	write(out, other);
+
+	QuadtreeDelta::Change change;
+	change.x = x;
+	change.y = y;
+	change.resolution = resolution;
+	change.subtree = out.str();
+	delta._changes.push_back(change);
+}
+
+/*
+*Applies a delta produced by diff(), turning this Quadtree into the diff's target. The tree should be *the one diff() was called on (or equal to it); applying a delta elsewhere still replaces the named *squares, splitting any pruned leaf on the way.
+*Returns false, leaving the tree untouched, if the delta is malformed or was made for another *resolution. Deltas built in memory are checked as strictly as those read from a stream.
+*/
+bool Quadtree::applyDelta(QuadtreeDelta const & delta){
+	if(!QuadtreeDelta::validResolution(delta._resolution)){
+		return false;
+	}
+
+	//an empty target empties the tree
+	if(delta._resolution == 0){
+		clear(root);
+		rootResolution = 0;
+		return true;
+	}
+
+	vector<QuadtreeDelta::Change> const & changes = delta._changes;
+
+	//unless the first change replaces everything, the tree must already have the delta's resolution
+	bool replacesRoot = !changes.empty() && changes[0].resolution == delta._resolution;
+	if(!replacesRoot && (root == NULL || rootResolution != delta._resolution)){
+		return false;
+	}
+
+	//decode every subtree first so that a malformed delta changes nothing
+	vector<QuadtreeNode *> subtrees;
+	for(size_t i = 0; i < changes.size(); i++){
+		QuadtreeDelta::Change const & change = changes[i];
+		QuadtreeNode * subtree = NULL;
+		if(QuadtreeDelta::validSquare(change.x, change.y, change.resolution, delta._resolution)){
+			istringstream in(change.subtree);
+			subtree = readPlain(in, change.resolution);
+		}
+		if(subtree == NULL){
+			for(size_t j = 0; j < subtrees.size(); j++){
+				clear(subtrees[j]);
+			}
+			return false;
+		}
+		subtrees.push_back(subtree);
+	}
+
+	rootResolution = delta._resolution;
+	for(size_t i = 0; i < changes.size(); i++){
+		applyChange(root, 0, 0, rootResolution, changes[i], subtrees[i]);
+	}
+
+	return true;
+}
+
+//applyDelta helper function
+void Quadtree::applyChange(QuadtreeNode *& root, int rootX, int rootY, int resolution, QuadtreeDelta::Change const & change, QuadtreeNode * subtree){
+	//base case, this is the square being replaced
+	if(resolution == change.resolution){
+		clear(root);
+		root = subtree;
+		return;
+	}
+
+	//the node is about to change, so it must not be shared with another tree
+	unshare(root);
+
+	//a leaf on the way down is split, its children start out with its color
+	int half = resolution/2;
+	if(root->nwChild == NULL){
+		root->nwChild = new QuadtreeNode(root->element);
+		root->neChild = new QuadtreeNode(root->element);
+		root->swChild = new QuadtreeNode(root->element);
+		root->seChild = new QuadtreeNode(root->element);
+		QT_STAT(counters.nodesAllocated += 4);
+		flatSums(root->nwChild, half);
+		flatSums(root->neChild, half);
+		flatSums(root->swChild, half);
+		flatSums(root->seChild, half);
+		rehash(root->nwChild);
+		rehash(root->neChild);
+		rehash(root->swChild);
+		rehash(root->seChild);
+	}
+
+	//recursive call to the child containing the square
+	bool east = change.x >= rootX + half;
+	bool south = change.y >= rootY + half;
+	if(!south && !east){
+		applyChange(root->nwChild, rootX, rootY, half, change, subtree);
+	}
+	else if(!south){
+		applyChange(root->neChild, rootX + half, rootY, half, change, subtree);
+	}
+	else if(!east){
+		applyChange(root->swChild, rootX, rootY + half, half, change, subtree);
+	}
+	else{
+		applyChange(root->seChild, rootX + half, rootY + half, half, change, subtree);
+	}
+
+	//recompute the color and hash on the path back up
+	average(root);
+	rehash(root);
+}
+
+
+
+
+//copy function to assist "Big Three" functions, the nodes are shared rather than duplicated
+void Quadtree::copy(const Quadtree & other){
+	QT_TIME_PHASE(counters.copySeconds);
+
+	root = share(other.root);
+	rootResolution = (other.root != NULL) ? other.rootResolution : 0;
+	exactSums = other.exactSums;
+	premultiplied = other.premultiplied;
 }
 
 
@@ -509,6 +1741,13 @@ void Quadtree::clear(QuadtreeNode *& root){
 	if(root == NULL){
 		return;
 	}
+
+	//another tree or parent still uses the subtree, only this reference goes away
+	if(--root->refs > 0){
+		root = NULL;
+		return;
+	}
+
 	//recursive call to each child of quadtree's root
 	clear(root->nwChild);
 	clear(root->neChild);
@@ -518,4 +1757,65 @@ void Quadtree::clear(QuadtreeNode *& root){
 	//deletes root and sets to NULL
 	delete root;
 	root = NULL;
+	QT_STAT(counters.nodesFreed++);
+}
+
+//copy-on-write helper function, adds a reference to a node
+Quadtree::QuadtreeNode * Quadtree::share(QuadtreeNode * root){
+	if(root != NULL){
+		root->refs++;
+	}
+
+	return root;
+}
+
+//copy-on-write helper function, gives this tree its own copy of a shared node before it is changed;
+//the copy shares the node's children, which are copied in turn only if they are changed too
+Quadtree::QuadtreeNode * Quadtree::unshare(QuadtreeNode *& root){
+	if(root->refs == 1){
+		return root;
+	}
+
+	QuadtreeNode * node = new QuadtreeNode(root->element);
+	QT_STAT(counters.nodesAllocated++; counters.nodesCopied++);
+	copySums(node, root);
+	node->hash = root->hash;
+	node->nwChild = share(root->nwChild);
+	node->neChild = share(root->neChild);
+	node->swChild = share(root->swChild);
+	node->seChild = share(root->seChild);
+
+	//dropping the old reference frees the original if the other sharer let go in the meantime
+	clear(root);
+	root = node;
+	return node;
+}
+
+
+
+
+/*
+*Returns the counters gathered by this Quadtree since it was created or since resetStats() was last *called. Every counter stays zero unless the library was built with QUADTREE_STATS. Counters are *updated by const methods too, so concurrent readers of one instrumented tree race on them.
+*/
+QuadtreeStats const & Quadtree::stats() const{
+#ifdef QUADTREE_STATS
+	return counters;
+#else
+	static QuadtreeStats const none;
+	return none;
+#endif
+}
+
+//zeroes the counters; does nothing when instrumentation is compiled out
+void Quadtree::resetStats(){
+	QT_STAT(counters.reset());
+}
+
+//returns whether the library was built with QUADTREE_STATS
+bool Quadtree::statsEnabled(){
+#ifdef QUADTREE_STATS
+	return true;
+#else
+	return false;
+#endif
 }
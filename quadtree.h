@@ -7,7 +7,16 @@
 #ifndef QUADTREE_H
 #define QUADTREE_H
 
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "colormetric.h"
 #include "png.h"
+#include "quadtree_delta.h"
+#include "quadtree_quality.h"
+#include "quadtree_region.h"
+#include "quadtree_stats.h"
 
 /**
  * A tree structure that is used to compress PNG images.
@@ -27,14 +36,90 @@ class Quadtree
 
 		//public memeber functions
 		void buildTree(PNG const & source, int resolution);
+		template <class Metric = RgbMetric> void buildPruned(PNG const & source, int resolution, int tolerance);
+		void updateRegion(PNG const & source, int x, int y, int width, int height);
 		RGBAPixel getPixel(int x, int y) const;
 		PNG decompress() const;
+		PNG decompressRegion(int x, int y, int width, int height, int level = 0) const;
 		void clockwiseRotate();
-		void prune(int tolerance);
-		int pruneSize(int tolerance) const;
-		int idealPrune(int numLeaves) const;
+		void rotate(int quarterTurns);
+		void flipHorizontal();
+		void flipVertical();
+
+		//decompressing into memory the caller owns (framebuffers, encoder input): 8 bits per channel, in this byte order
+		enum PixelFormat { RGBA8, BGRA8, RGB8 };
+		static int bytesPerPixel(PixelFormat format);
+		void decompressInto(uint8_t * dst, size_t stride, PixelFormat format) const;
+
+		//the prune family measures color differences with Metric, one of the metrics in colormetric.h
+		template <class Metric = RgbMetric> void prune(int tolerance);
+		template <class Metric = RgbMetric> int pruneSize(int tolerance) const;
+		template <class Metric = RgbMetric> int idealPrune(int numLeaves) const;
+
+		template <class Metric = RgbMetric> void pruneToLeafCount(int numLeaves);
+
+		//exact mode: 64-bit channel sums per node, exact means and variance-based pruning
+		void setExactSums(bool enabled);
+		bool hasExactSums() const;
+		void pruneByVariance(double maxVariance);
+
+		//alpha: averages and distances always include it; premultiplied mode weights colors by it
+		void setPremultipliedAlpha(bool enabled);
+		bool hasPremultipliedAlpha() const;
+
+		//size queries
+		int getResolution() const;
+		int leafCount() const;
+		int nodeCount() const;
+
+		//content hash of the leaves and their layout: equal trees have equal hashes, so a mismatch proves them different
+		uint64_t hash() const;
+
+		//serialization: a preorder stream of split flags and leaf colors (see quadtree.cpp for the layout)
+		void write(std::ostream & out) const;
+		bool read(std::istream & in, int maxResolution = 1 << 14);
+		bool writeToFile(string const & file_name) const;
+		bool readFromFile(string const & file_name, int maxResolution = 1 << 14);
+
+		//compact serialization: split flags and color residuals under a range coder (see quadtree_codec.cpp); read() accepts both formats
+		void writeCompact(std::ostream & out) const;
+		static bool readCompactImage(std::istream & in, PNG & image, int maxResolution = 1 << 14);
+
+		//progressive serialization: breadth-first, so any prefix is a coarser tree (see quadtree_progressive.h)
+		void writeProgressive(std::ostream & out, int maxLevels = 0) const;
+
+		//frame-to-frame deltas: the subtrees that differ between two trees of the same resolution
+		QuadtreeDelta diff(Quadtree const & target) const;
+		bool applyDelta(QuadtreeDelta const & delta);
+
+		//distortion against the source image, as is or after a prune (see quadtree_quality.cpp)
+		QuadtreeQuality quality(PNG const & source, bool withSsim = false) const;
+		QuadtreeQuality pruneQuality(PNG const & source, int tolerance, bool withSsim = false) const;
+
+		//rectangle queries: the mean of the pixels a rectangle covers, and (in exact mode) their bounds and variance
+		RGBAPixel regionAverage(int x, int y, int width, int height) const;
+		QuadtreeRegionStats regionStats(int x, int y, int width, int height) const;
+
+		//instrumentation counters (all zero unless built with QUADTREE_STATS)
+		QuadtreeStats const & stats() const;
+		void resetStats();
+		static bool statsEnabled();
 
   private:
+		/**
+		 * Exact totals of the channels of the source pixels below a node
+		 * (index 0 is red, 1 green, 2 blue, 3 alpha). In premultiplied
+		 * mode the color entries total each channel times alpha.
+		 */
+		struct NodeSums
+		{
+			uint64_t count;      /**< number of pixels */
+			uint64_t sum[4];     /**< sum of each channel */
+			uint64_t squares[4]; /**< sum of the squares of each channel */
+			uint8_t low[4];      /**< smallest value of each channel (straight, even in premultiplied mode) */
+			uint8_t high[4];     /**< largest value of each channel (straight, even in premultiplied mode) */
+		};
+
     /**
      * A simple class representing a single node of a Quadtree.
      * You may want to add to this class; in particular, it could
@@ -51,68 +136,167 @@ class Quadtree
 
 		    RGBAPixel element; /**< the pixel stored as this node's "data" */
 
-			//added QuadtreeNode attributes of x, y, and resolution
-			int x;
-			int y;
-			int resolution;
+			std::atomic<int> refs; /**< number of pointers (parents or tree roots) to this node; nodes are shared between copies until one of them changes */
+
+			NodeSums * sums; /**< totals of the pixels below this node, NULL unless the tree keeps exact sums */
+
+			uint64_t hash; /**< hash of the subtree's shape and leaf colors, set by rehash; equal subtrees have equal hashes */
 
-			//QuadtreeNode constructor to help build quadtree and store x, y, and resolution easily
-			QuadtreeNode(int xpoint, int ypoint, int res){
-				x = xpoint;
-				y = ypoint;
-				resolution = res;
+			//a node's position and size are not stored: they follow from the path taken from the root, so
+			//rotations and flips only have to permute child pointers
 
+			//QuadtreeNode constructor for a node whose color is filled in later
+			QuadtreeNode() : refs(1), sums(NULL), hash(0){
 				nwChild = NULL;
 				neChild = NULL;
 				swChild = NULL;
 				seChild = NULL;
-
 			}
 
-			//QuadtreeNode constructor to help our copy function: stores RGBA pixel, resolution, x points, and y points
-			QuadtreeNode(const RGBAPixel & ele, int res, int xpoint, int ypoint){
-				x = xpoint;
-				y = ypoint;
+			//QuadtreeNode constructor to help our copy function: stores RGBA pixel
+			QuadtreeNode(const RGBAPixel & ele) : refs(1), sums(NULL), hash(0){
 				element = ele;
-				resolution = res;
 
 				nwChild = NULL;
 				neChild = NULL;
 				swChild = NULL;
 				seChild = NULL;
 			}
+
+			//QuadtreeNode destructor, children are released by clear
+			~QuadtreeNode(){
+				delete sums;
+			}
 		};
 
 		/**< pointer to root of quadtree */
 		QuadtreeNode* root;
 
+		//whether every node carries NodeSums and colors are exact (truncated) means
+		bool exactSums;
+
+		//whether averages weight colors by alpha and distances compare premultiplied colors
+		bool premultiplied;
+
+		/**< width and height of the region root represents (0 when empty) */
+		int rootResolution;
+
+#ifdef QUADTREE_STATS
+		/**< work counters updated through the QT_STAT macros */
+		mutable QuadtreeStats counters;
+#endif
+
 		//helper function for Buildtree
-		void buildTree(PNG const & source, int resolution, QuadtreeNode * root); //takes PNG, resolution, and QuadtreeNode
+		void buildTree(PNG const & source, int x, int y, int resolution, QuadtreeNode * root); //takes PNG, the node's upper left corner and resolution, and QuadtreeNode
+		void average(QuadtreeNode * root); //sets root's element to the truncated average of its four children
+		void average(QuadtreeNode * root, QuadtreeNode const * parent); //sets root's element to the truncated average of parent's four children
+		RGBAPixel average(RGBAPixel const colors[4]) const; //takes four colors (returns their truncated average, outside exact mode)
+
+		//buildPruned helper functions
+		struct PyramidCell; //color and channel ranges of one square (defined in quadtree.cpp)
+		PyramidCell pyramidCell(PNG const & source, std::vector<std::vector<PyramidCell> > const & levels, int cx, int cy, int level) const; //takes PNG, the pyramid, and a square's column, row and level (returns its cell)
+		template <class Metric> QuadtreeNode * buildPruned(PNG const & source, std::vector<std::vector<PyramidCell> > const & levels, int cx, int cy, int level, int tolerance); //takes PNG, the pyramid, a square's column, row and level, and tolerance (returns the pruned subtree for the square)
+		template <class Metric> bool withinTolerance(PNG const & source, std::vector<std::vector<PyramidCell> > const & levels, int cx, int cy, int level, RGBAPixel const & color, int tolerance) const; //takes PNG, the pyramid, a square's column, row and level, a color, and tolerance (returns whether every pixel of the square is within tolerance of color)
+
+		//updateRegion helper function
+		void updateRegion(PNG const & source, int x, int y, int right, int bottom, QuadtreeNode *& root, int rootX, int rootY, int resolution); //takes PNG, the edited region's corners (right and bottom exclusive), and QuadtreeNode with its upper left corner and resolution
 
 		//getPixel helper functions
-		RGBAPixel getPixel(int x, int y, QuadtreeNode * root) const; //takes x point, y point, and QuadtreeNode (returns RGBApixel)
-		bool range(int x, int y, QuadtreeNode * root) const;		 //takes x point, ypoint, and quadtreeNode (returns true if in range or false if not in range)
+		RGBAPixel getPixel(int x, int y, QuadtreeNode * root, int resolution) const; //takes x point and y point relative to the node, QuadtreeNode, and its resolution (returns RGBApixel)
 
 		//decompres helper function
-		void decompress(QuadtreeNode * root, PNG &retval) const; //takes QuadtreeNode and PNG by reference (PNG instantiated in public function based on resolution)
+		void decompress(QuadtreeNode * root, int x, int y, int resolution, PNG &retval) const; //takes QuadtreeNode, its upper left corner and resolution, and PNG by reference (PNG instantiated in public function based on resolution)
+		void decompressInto(QuadtreeNode * root, uint8_t * corner, int resolution, size_t stride, PixelFormat format) const; //takes QuadtreeNode, the address of its upper left pixel and its resolution, the bytes from one row to the next, and the format
+		void decompressRegion(QuadtreeNode * root, int nodeX, int nodeY, int resolution, int x, int y, int step, PNG & retval) const; //takes QuadtreeNode with its upper left corner and resolution, the region's upper left corner and sample spacing, and the PNG of samples
 
-		//clockwiseRotate helper function
-		void clockwiseRotate(QuadtreeNode * root); //takes QuadtreeNode
+		//rotate and flip helper function
+		void permute(QuadtreeNode *& root, int const order[4]); //takes QuadtreeNode and the child each slot (nw, ne, sw, se) takes its pointer from
 
 		//prune helper functions
-		void prune(QuadtreeNode * root, int tolerance); //takes QuadtreeNode and tolerance
-		bool checkTolerance(QuadtreeNode * root, QuadtreeNode * other, int tolerance) const; //takes QuadtreeNode, QuadtreeNode, and tolerance (returns true or false (difference <= tolerance))
+		template <class Metric> QuadtreeNode * prune(QuadtreeNode * root, int tolerance, double maxVariance, bool owned); //takes QuadtreeNode, tolerance, variance limit (negative to use the tolerance), and whether the path down to root belongs to this tree alone (returns root, or a new node to put in its place)
+		template <class Metric> bool prunable(QuadtreeNode * root, int tolerance, double maxVariance) const; //takes QuadtreeNode, tolerance, and variance limit (returns whether prune collapses root)
+		template <class Metric> int distance(RGBAPixel const & first, RGBAPixel const & second) const; //takes two colors (returns the squared Metric distance prune compares with the tolerance, alpha included)
+		template <class Metric = RgbMetric> bool checkTolerance(QuadtreeNode * root, QuadtreeNode * other, int tolerance, int depth = 0) const; //takes QuadtreeNode, QuadtreeNode, tolerance, and other's depth below root (returns true or false (difference <= tolerance))
 
 		//pruneSize helper functions
-		int pruneSize(QuadtreeNode * root, int tolerance) const; //takes QuadtreeNode and tolerance (returns amount of leaves pruned with a given tolerance)
+		template <class Metric> int pruneSize(QuadtreeNode * root, int tolerance) const; //takes QuadtreeNode and tolerance (returns amount of leaves pruned with a given tolerance)
+
+		//pruneToLeafCount helper functions
+		struct PruneCandidate; //an internal node the greedy prune may collapse (defined in quadtree.cpp)
+		template <class Metric> int collectCandidates(QuadtreeNode * root, int parent, std::vector<PruneCandidate> & candidates) const; //takes QuadtreeNode, the index of its parent's candidate, and the candidates so far (returns the node's index, or -1 for a leaf)
+		template <class Metric> int maxError(QuadtreeNode * root, QuadtreeNode * other) const; //takes QuadtreeNode and a node below it (returns the largest difference between root and any leaf below other)
+		int collapseMarked(QuadtreeNode *& root, int index, std::vector<PruneCandidate> const & candidates); //takes QuadtreeNode, its candidate index, and the candidates; collapses the marked nodes (returns the index after the subtree)
+
+		//quality helper functions
+		struct QualitySums; //running totals of one measurement (defined in quadtree_quality.cpp)
+		bool measuredAsLeaf(QuadtreeNode * root, int tolerance) const; //takes QuadtreeNode and tolerance, negative for none (returns whether root is a leaf after the prune)
+		void measure(PNG const & source, QuadtreeNode * root, int x, int y, int resolution, int tolerance, QualitySums & sums) const; //takes source PNG, QuadtreeNode with its upper left corner and resolution, tolerance, and the totals to add the squared and max error to
+		void measureSsim(PNG const & source, QuadtreeNode * root, int x, int y, int resolution, int tolerance, QualitySums & sums) const; //takes source PNG, QuadtreeNode with its upper left corner and resolution, tolerance, and the totals to add the windows' SSIM to
+		void paintLuma(QuadtreeNode * root, int x, int y, int resolution, int tolerance, double * buffer, int stride) const; //takes QuadtreeNode with its corner inside the buffer and resolution, tolerance, and the buffer and its width
+		double ssim(PNG const & source, int x, int y, int window, double const * reconstructed) const; //takes source PNG, the window's upper left corner and size, and its reconstructed luma (returns the window's SSIM)
+
+		//exact sums helper functions
+		void flatSums(QuadtreeNode * root, int resolution); //takes QuadtreeNode and resolution, gives root the sums of a square of its own color (exact mode only)
+		static void copySums(QuadtreeNode * root, QuadtreeNode const * other); //takes QuadtreeNode and the node it copies, duplicates other's sums
+		void recompute(QuadtreeNode *& root, int resolution); //takes QuadtreeNode and resolution, recolors the internal nodes and adds or (outside exact mode) removes the sums of the subtree after a mode change
+		NodeSums flatTotals(RGBAPixel const & color, uint64_t count) const; //takes a color and a pixel count (returns the sums of that many pixels of the color)
+		static NodeSums emptySums(); //returns the sums of no pixels
+		static void addSums(NodeSums & totals, NodeSums const & other); //takes running sums and the sums to add to them
+		RGBAPixel meanColor(NodeSums const & sums) const; //takes sums of at least one pixel (returns their truncated mean color)
+		double variance(NodeSums const & sums) const; //takes sums of at least one pixel (returns the mean squared distance of the pixels from their mean)
 
-		//ideaPrune helper function
-		int idealPrune(int lowerbound, int upperBound, int numLeaves) const; //takes lowerbound (0), upperbound (255 * 255 * 3), and a number of leaves (returns tolerance needed to produce a tree with 'numLeaves' remaining)
+		//rectangle query helper function
+		void regionSums(QuadtreeNode * root, int x, int y, int resolution, int left, int top, int right, int bottom, NodeSums & totals) const; //takes QuadtreeNode with its upper left corner and resolution, the rectangle's edges (right and bottom exclusive), and the totals to add the covered pixels to
+
+		//compact format helper functions
+		struct CompactEntry; //a node's prediction and split flag in preorder (defined in quadtree_codec.cpp)
+		class CompactWriter; //range coder and adaptive models writing the compact format (defined in quadtree_codec.cpp)
+		class CompactReader; //range decoder and adaptive models reading the compact format (defined in quadtree_codec.cpp)
+		static RGBAPixel gatherCompact(QuadtreeNode * root, std::vector<CompactEntry> & entries); //takes QuadtreeNode and the entries so far, appends the subtree's entries in preorder (returns root's prediction)
+		static void writeCompact(CompactWriter & writer, std::vector<CompactEntry> const & entries, size_t index, int resolution); //takes the writer, the entries, and a split entry with its resolution, writes its children's flags and colors and their subtrees
+		static bool readCompactImage(CompactReader & reader, RGBAPixel const & color, bool split, int x, int y, int resolution, PNG & image); //takes the reader, a node's decoded color and split flag, upper left corner and resolution, and the image to paint its leaves into (returns false if the stream is malformed)
+		QuadtreeNode * readCompact(std::istream & in, int resolution); //takes stream after the header and the resolution (returns the tree, or NULL if the stream is truncated or malformed)
+		QuadtreeNode * readCompact(CompactReader & reader, RGBAPixel const & color, bool split, int resolution); //takes the reader, a node's decoded color and split flag, and its resolution (returns the subtree, or NULL if the stream is malformed)
+
+		//progressive format helper function
+		QuadtreeNode * readProgressive(std::istream & in, int resolution); //takes stream after the header and the resolution (returns the tree, or NULL if the stream is truncated or malformed)
+
+		//size query helper functions
+		int leafCount(QuadtreeNode * root) const; //takes QuadtreeNode (returns number of leaves below it)
+		int nodeCount(QuadtreeNode * root) const; //takes QuadtreeNode (returns number of nodes below and including it)
+
+		//serialization helper functions
+		void write(std::ostream & out, QuadtreeNode * root) const;			//takes stream and QuadtreeNode, writes the subtree in preorder
+		QuadtreeNode * readPlain(std::istream & in, int resolution); //takes stream and the resolution of the node (returns the subtree read, or NULL on malformed input)
+
+		//diff and applyDelta helper functions
+		bool diff(QuadtreeNode * root, QuadtreeNode * other, int x, int y, int resolution, QuadtreeDelta & delta) const; //takes both trees' nodes for the square at x, y, and the delta to add to (returns true if other's whole subtree was recorded as one change)
+		void addChange(QuadtreeNode * other, int x, int y, int resolution, QuadtreeDelta & delta) const; //records other's subtree as the replacement for the square at x, y
+		void applyChange(QuadtreeNode *& root, int rootX, int rootY, int resolution, QuadtreeDelta::Change const & change, QuadtreeNode * subtree); //takes the node for the square at rootX, rootY, and puts subtree in place of the square the change names
+
+		//hashing helper function
+		static void rehash(QuadtreeNode * root); //takes QuadtreeNode, sets its hash from its color (a leaf) or from its children's hashes
 
 		//Big Three helpers
-		void copy(const Quadtree & other); //takes another Quadtree and copies it into current tree
-		void copy(QuadtreeNode * root, QuadtreeNode * other, int resolution); //copy helper function: does the actual calculations and copies new tree in
-		void clear(QuadtreeNode *& root); //deallocates all data in our destructor and utilized to 'prune' children nodes
+		void copy(const Quadtree & other); //takes another Quadtree and shares its nodes with the current tree
+		void clear(QuadtreeNode *& root); //drops this pointer's reference to root, deallocating the subtree once nothing else shares it
+
+		//copy-on-write helpers
+		static QuadtreeNode * share(QuadtreeNode * root); //takes QuadtreeNode, adds a reference to it (returns root)
+		QuadtreeNode * unshare(QuadtreeNode *& root); //takes the pointer to a node whose parent already belongs to this tree alone, replaces a shared node with a private copy (returns the node now in place)
+
+		//pruned views read the nodes directly and reuse checkTolerance
+		friend class QuadtreeView;
+
+		//stores swap equal subtrees for one shared node, through the copy-on-write helpers
+		friend class QuadtreeStore;
+
+		//progressive readers build the trees they decode node by node
+		friend class QuadtreeProgressiveReader;
+
+		//leaf iterators and visitors walk the nodes directly with their own stacks
+		friend class QuadtreeLeafIterator;
+		friend class QuadtreeTraversal;
 
 /**** Functions for testing/grading                      ****/
 /**** Do not remove this line or copy its contents here! ****/
@@ -0,0 +1,378 @@
+/**
+ * @file quadtree_basic.h
+ * Definition of the BasicQuadtree class template, a Quadtree over images
+ * of any sample type and channel count.
+ */
+
+#ifndef QUADTREE_BASIC_H
+#define QUADTREE_BASIC_H
+
+#include <type_traits>
+
+#include "basicimage.h"
+#include "basicpixel.h"
+#include "idealprune.h"
+
+/**
+ * The Quadtree of a BasicImage: 16-bit captures keep their full depth and
+ * float heightmaps their exact values. The tree is built, read, pruned and
+ * measured the way Quadtree does it, with averages and distances taken
+ * from ChannelTraits<Channel>: each internal node holds the average of its
+ * children, and a subtree is collapsed when every leaf below it is within
+ * tolerance (a sum of squared sample differences) of its color. A
+ * BasicQuadtree<uint8_t, 4> gives the same pixels, leaf counts and
+ * tolerances as a Quadtree with straight alpha; the 8-bit RGBA path itself
+ * stays with Quadtree and RGBAPixel.
+ *
+ * @tparam Channel Sample type: uint8_t, uint16_t or float.
+ * @tparam Channels Number of samples per pixel.
+ */
+template <class Channel, int Channels>
+class BasicQuadtree
+{
+	public:
+		typedef BasicPixel<Channel, Channels> Pixel;                    /**< The pixel type. */
+		typedef BasicImage<Channel, Channels> Image;                    /**< The image type. */
+		typedef typename ChannelTraits<Channel>::Distance Distance;     /**< Type of distances and tolerances. */
+
+		/**
+		 * Creates an empty tree.
+		 */
+		BasicQuadtree() : _root(NULL), _resolution(0)
+		{
+			/* nothing */
+		}
+
+		/**
+		 * Creates the tree of the upper left resolution x resolution
+		 * pixels of source.
+		 * @param source The image to compress.
+		 * @param resolution A power of two no larger than the image.
+		 */
+		BasicQuadtree(Image const & source, int resolution) : _root(NULL), _resolution(0)
+		{
+			buildTree(source, resolution);
+		}
+
+		/**
+		 * Copy constructor.
+		 * @param other The tree to copy.
+		 */
+		BasicQuadtree(BasicQuadtree const & other) : _root(copy(other._root)), _resolution(other._resolution)
+		{
+			/* nothing */
+		}
+
+		/**
+		 * Destructor.
+		 */
+		~BasicQuadtree()
+		{
+			clear(_root);
+		}
+
+		/**
+		 * Assignment operator.
+		 * @param other The tree to copy.
+		 * @return This tree.
+		 */
+		BasicQuadtree const & operator=(BasicQuadtree const & other)
+		{
+			if(this != &other)
+			{
+				clear(_root);
+				_root = copy(other._root);
+				_resolution = other._resolution;
+			}
+			return *this;
+		}
+
+		/**
+		 * Rebuilds the tree from the upper left resolution x resolution
+		 * pixels of source.
+		 * @param source The image to compress.
+		 * @param resolution A power of two no larger than the image.
+		 */
+		void buildTree(Image const & source, int resolution)
+		{
+			clear(_root);
+			_resolution = resolution;
+			_root = build(source, 0, 0, resolution);
+		}
+
+		/**
+		 * @param x X coordinate of the pixel.
+		 * @param y Y coordinate of the pixel.
+		 * @return The color of the leaf covering (x, y), or a pixel of
+		 *  zero samples outside the tree or when it is empty.
+		 */
+		Pixel getPixel(int x, int y) const
+		{
+			if(_root == NULL || x < 0 || y < 0 || x >= _resolution || y >= _resolution)
+				return Pixel();
+
+			Node const * node = _root;
+			int half = _resolution;
+			while(node->nwChild != NULL)
+			{
+				half /= 2;
+				bool east = x >= half;
+				bool south = y >= half;
+				node = south ? (east ? node->seChild : node->swChild) : (east ? node->neChild : node->nwChild);
+				if(east)
+					x -= half;
+				if(south)
+					y -= half;
+			}
+
+			return node->element;
+		}
+
+		/**
+		 * @return The image the tree represents, or an empty image when
+		 *  the tree is empty.
+		 */
+		Image decompress() const
+		{
+			if(_root == NULL)
+				return Image();
+
+			Image image(_resolution, _resolution);
+			paint(_root, 0, 0, _resolution, image);
+			return image;
+		}
+
+		/**
+		 * Collapses every subtree whose leaves are all within tolerance
+		 * of its color, as Quadtree::prune() does.
+		 * @param tolerance Largest distance a leaf may have from the
+		 *  collapsed color.
+		 */
+		void prune(Distance tolerance)
+		{
+			if(_root != NULL)
+				prune(_root, tolerance);
+		}
+
+		/**
+		 * @param tolerance The tolerance to simulate.
+		 * @return The number of leaves prune(tolerance) would leave (0
+		 *  when the tree is empty or tolerance is negative).
+		 */
+		int pruneSize(Distance tolerance) const
+		{
+			if(_root == NULL || tolerance < 0)
+				return 0;
+
+			return pruneSize(_root, tolerance);
+		}
+
+		/**
+		 * Finds a tolerance leaving numLeaves leaves with the search
+		 * Quadtree::idealPrune() uses. Only integer samples have the
+		 * upper bound the search starts from.
+		 * @param numLeaves The number of leaves wanted.
+		 * @return The tolerance.
+		 */
+		Distance idealPrune(int numLeaves) const
+		{
+			static_assert(std::is_integral<Distance>::value, "idealPrune searches integer tolerances only");
+
+			if(_root == NULL)
+				return 0;
+
+			auto leaves = [this](Distance tolerance) { return pruneSize(tolerance); };
+			return idealPruneSearch(leaves, Distance(0), Distance(Channels * ChannelTraits<Channel>::maxSquare), numLeaves);
+		}
+
+		/**
+		 * @return The resolution, or 0 when the tree is empty.
+		 */
+		int getResolution() const
+		{
+			return _root != NULL ? _resolution : 0;
+		}
+
+		/**
+		 * @return The number of leaves.
+		 */
+		int leafCount() const
+		{
+			return _root != NULL ? leafCount(_root) : 0;
+		}
+
+		/**
+		 * @return The number of nodes.
+		 */
+		int nodeCount() const
+		{
+			return _root != NULL ? nodeCount(_root) : 0;
+		}
+
+		/**
+		 * Compares the leaves of two trees, as Quadtree::operator== does.
+		 * @param other The tree to compare with.
+		 * @return Whether both trees have the same shape and leaf colors.
+		 */
+		bool operator==(BasicQuadtree const & other) const
+		{
+			return equal(_root, other._root);
+		}
+
+	private:
+		/**
+		 * A node: a leaf when its children are NULL.
+		 */
+		struct Node
+		{
+			Node * nwChild;  /**< northwest child */
+			Node * neChild;  /**< northeast child */
+			Node * swChild;  /**< southwest child */
+			Node * seChild;  /**< southeast child */
+			Pixel element;   /**< the node's color */
+
+			Node(Pixel const & color) : nwChild(NULL), neChild(NULL), swChild(NULL), seChild(NULL), element(color)
+			{
+				/* nothing */
+			}
+		};
+
+		Node * _root;
+		int _resolution;
+
+		static Node * build(Image const & source, int x, int y, int resolution)
+		{
+			if(resolution == 1)
+				return new Node(*source(x, y));
+
+			int half = resolution / 2;
+			Node * node = new Node(Pixel());
+			node->nwChild = build(source, x, y, half);
+			node->neChild = build(source, x + half, y, half);
+			node->swChild = build(source, x, y + half, half);
+			node->seChild = build(source, x + half, y + half, half);
+			node->element = average(node);
+			return node;
+		}
+
+		static Pixel average(Node const * node)
+		{
+			Pixel const colors[4] = {node->nwChild->element, node->neChild->element, node->swChild->element, node->seChild->element};
+			return averagePixels(colors);
+		}
+
+		static void paint(Node const * node, int x, int y, int resolution, Image & image)
+		{
+			if(node->nwChild == NULL)
+			{
+				for(int j = y; j < y + resolution; j++)
+					for(int i = x; i < x + resolution; i++)
+						*image(i, j) = node->element;
+				return;
+			}
+
+			int half = resolution / 2;
+			paint(node->nwChild, x, y, half, image);
+			paint(node->neChild, x + half, y, half, image);
+			paint(node->swChild, x, y + half, half, image);
+			paint(node->seChild, x + half, y + half, half, image);
+		}
+
+		// whether every leaf below node is within tolerance of color
+		static bool withinTolerance(Node const * node, Pixel const & color, Distance tolerance)
+		{
+			if(node->nwChild == NULL)
+				return pixelDistance(node->element, color) <= tolerance;
+
+			return withinTolerance(node->nwChild, color, tolerance) && withinTolerance(node->neChild, color, tolerance)
+				&& withinTolerance(node->swChild, color, tolerance) && withinTolerance(node->seChild, color, tolerance);
+		}
+
+		static void prune(Node * node, Distance tolerance)
+		{
+			if(node->nwChild == NULL)
+				return;
+
+			if(withinTolerance(node, node->element, tolerance))
+			{
+				clear(node->nwChild);
+				clear(node->neChild);
+				clear(node->swChild);
+				clear(node->seChild);
+				return;
+			}
+
+			prune(node->nwChild, tolerance);
+			prune(node->neChild, tolerance);
+			prune(node->swChild, tolerance);
+			prune(node->seChild, tolerance);
+		}
+
+		static int pruneSize(Node const * node, Distance tolerance)
+		{
+			if(node->nwChild == NULL || withinTolerance(node, node->element, tolerance))
+				return 1;
+
+			return pruneSize(node->nwChild, tolerance) + pruneSize(node->neChild, tolerance)
+				+ pruneSize(node->swChild, tolerance) + pruneSize(node->seChild, tolerance);
+		}
+
+		static int leafCount(Node const * node)
+		{
+			if(node->nwChild == NULL)
+				return 1;
+
+			return leafCount(node->nwChild) + leafCount(node->neChild) + leafCount(node->swChild) + leafCount(node->seChild);
+		}
+
+		static int nodeCount(Node const * node)
+		{
+			if(node->nwChild == NULL)
+				return 1;
+
+			return 1 + nodeCount(node->nwChild) + nodeCount(node->neChild) + nodeCount(node->swChild) + nodeCount(node->seChild);
+		}
+
+		static bool equal(Node const * first, Node const * second)
+		{
+			if(first == NULL || second == NULL)
+				return first == second;
+
+			if(first->nwChild == NULL || second->nwChild == NULL)
+				return first->nwChild == second->nwChild && first->element == second->element;
+
+			return equal(first->nwChild, second->nwChild) && equal(first->neChild, second->neChild)
+				&& equal(first->swChild, second->swChild) && equal(first->seChild, second->seChild);
+		}
+
+		static Node * copy(Node const * node)
+		{
+			if(node == NULL)
+				return NULL;
+
+			Node * result = new Node(node->element);
+			if(node->nwChild != NULL)
+			{
+				result->nwChild = copy(node->nwChild);
+				result->neChild = copy(node->neChild);
+				result->swChild = copy(node->swChild);
+				result->seChild = copy(node->seChild);
+			}
+			return result;
+		}
+
+		static void clear(Node *& node)
+		{
+			if(node == NULL)
+				return;
+
+			clear(node->nwChild);
+			clear(node->neChild);
+			clear(node->swChild);
+			clear(node->seChild);
+			delete node;
+			node = NULL;
+		}
+};
+
+#endif // QUADTREE_BASIC_H
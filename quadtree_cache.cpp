@@ -0,0 +1,149 @@
+/**
+ * @file quadtree_cache.cpp
+ * Implementation of the QuadtreeTileCache class.
+ */
+
+#include <functional>
+
+#include "quadtree_cache.h"
+
+using namespace std;
+
+bool QuadtreeTileCache::Key::operator==(Key const & other) const
+{
+	return tree == other.tree && resolution == other.resolution && premultiplied == other.premultiplied
+		&& exact == other.exact && x == other.x && y == other.y && width == other.width
+		&& height == other.height && level == other.level;
+}
+
+size_t QuadtreeTileCache::KeyHash::operator()(Key const & key) const
+{
+	// the tree hash is already well mixed; fold the rest of the key into it
+	uint64_t h = key.tree;
+	int const fields[7] = {key.resolution, key.premultiplied << 1 | key.exact, key.x, key.y, key.width, key.height,
+						   key.level};
+	for (int field : fields)
+		h = (h ^ (uint32_t) field) * 0x100000001b3ULL;
+	return hash<uint64_t>()(h);
+}
+
+QuadtreeTileCache::QuadtreeTileCache(size_t capacityBytes)
+	: _capacity(capacityBytes), _bytes(0), _hits(0), _misses(0), _evictions(0), _uncached(0)
+{
+	/* nothing */
+}
+
+shared_ptr<PNG const> QuadtreeTileCache::get(Quadtree const & tree, int x, int y, int width, int height, int level)
+{
+	// exact-mode colors above the leaves come from sums the key cannot cover
+	if (level > 0 && tree.hasExactSums())
+	{
+		{
+			lock_guard<mutex> lock(_mutex);
+			_misses++;
+			_uncached++;
+		}
+		return make_shared<PNG const>(tree.decompressRegion(x, y, width, height, level));
+	}
+
+	Key key = {tree.hash(), tree.getResolution(), tree.hasPremultipliedAlpha(), tree.hasExactSums(),
+			   x, y, width, height, level};
+
+	unique_lock<mutex> lock(_mutex);
+	while (true)
+	{
+		auto found = _entries.find(key);
+		if (found == _entries.end())
+			break;
+
+		if (found->second.image)
+		{
+			_hits++;
+			_order.splice(_order.begin(), _order, found->second.position);
+			return found->second.image;
+		}
+
+		// another thread is rendering it; if that render fails or is too big to keep, this one renders
+		_rendered.wait(lock);
+	}
+
+	// reserve the key so that concurrent requests wait for this render
+	_misses++;
+	Entry pending = {shared_ptr<PNG const>(), 0, _order.end()};
+	_entries[key] = pending;
+	lock.unlock();
+
+	shared_ptr<PNG const> image;
+	try
+	{
+		image = make_shared<PNG const>(tree.decompressRegion(x, y, width, height, level));
+	}
+	catch (...)
+	{
+		lock.lock();
+		_entries.erase(key);
+		_rendered.notify_all();
+		throw;
+	}
+
+	size_t bytes = (size_t) image->width() * image->height() * sizeof(RGBAPixel);
+
+	lock.lock();
+	if (bytes > _capacity)
+	{
+		_entries.erase(key);
+		_uncached++;
+	}
+	else
+	{
+		_order.push_front(key);
+		Entry & entry = _entries[key];
+		entry.image = image;
+		entry.bytes = bytes;
+		entry.position = _order.begin();
+		_bytes += bytes;
+		evict();
+	}
+	_rendered.notify_all();
+	return image;
+}
+
+shared_ptr<PNG const> QuadtreeTileCache::get(Quadtree const & tree, int level)
+{
+	int resolution = tree.getResolution();
+	return get(tree, 0, 0, resolution, resolution, level);
+}
+
+void QuadtreeTileCache::clear()
+{
+	lock_guard<mutex> lock(_mutex);
+	for (Key const & key : _order)
+		_entries.erase(key);
+	_order.clear();
+	_bytes = 0;
+}
+
+QuadtreeTileCache::Counters QuadtreeTileCache::counters() const
+{
+	lock_guard<mutex> lock(_mutex);
+	Counters result = {_hits, _misses, _evictions, _uncached, _bytes, _order.size()};
+	return result;
+}
+
+size_t QuadtreeTileCache::capacity() const
+{
+	return _capacity;
+}
+
+// drops least recently used images until the rest fit; the caller holds the lock
+void QuadtreeTileCache::evict()
+{
+	while (_bytes > _capacity && !_order.empty())
+	{
+		auto found = _entries.find(_order.back());
+		_bytes -= found->second.bytes;
+		_entries.erase(found);
+		_order.pop_back();
+		_evictions++;
+	}
+}
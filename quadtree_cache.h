@@ -0,0 +1,153 @@
+/**
+ * @file quadtree_cache.h
+ * Definition of the QuadtreeTileCache class, a thread-safe, memory-bounded
+ * cache of the images Quadtree::decompressRegion() renders.
+ */
+
+#ifndef QUADTREE_CACHE_H
+#define QUADTREE_CACHE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "png.h"
+#include "quadtree.h"
+
+/**
+ * A least-recently-used cache of decompressed regions, for viewers that
+ * ask for the same images, rectangles and zoom levels over and over.
+ *
+ * Entries are keyed by everything the rendered image depends on: the
+ * tree's content hash (Quadtree::hash(), which covers the leaves and their
+ * layout), its resolution, its premultiplied and exact modes, the
+ * rectangle and the level. Equal trees therefore share their entries, and
+ * an edited tree never sees the images of its old content.
+ *
+ * Levels above 0 also show the colors of internal nodes, which the hash
+ * does not cover. Outside exact mode those colors are the averages of the
+ * children in the tree's alpha mode, so the leaves and the modes determine
+ * them; in exact mode they are means of the source pixels, which the
+ * leaves do not determine, so such requests are rendered every time and
+ * never cached. The hash is 64 bits: two different trees colliding on it
+ * would share entries, which is as unlikely as a collision of any 64-bit
+ * hash.
+ *
+ * The cache accounts for the pixel bytes of the images it holds and
+ * evicts the least recently used ones once they exceed its capacity; an
+ * image larger than the whole capacity is rendered and returned without
+ * being kept.
+ * Images are handed out as shared pointers, so an evicted image stays
+ * valid for as long as a caller holds it.
+ *
+ * Any number of threads may call get() at once. The tree walk runs outside
+ * the lock, and a thread asking for a region another thread is rendering
+ * waits for that render instead of repeating it, so each region is
+ * rendered once for as long as it stays cached. The trees must not be
+ * modified while a get() on them is running.
+ */
+class QuadtreeTileCache
+{
+	public:
+		/**
+		 * The cache's counters, as returned by counters().
+		 */
+		struct Counters
+		{
+			size_t hits;      /**< Requests answered from the cache, including those that waited for another thread's render. */
+			size_t misses;    /**< Requests that rendered their region. */
+			size_t evictions; /**< Images dropped to make room. */
+			size_t uncached;  /**< Misses whose image could not be kept: larger than the capacity, or an exact-mode tree above level 0. */
+			size_t bytes;     /**< Pixel bytes held now. */
+			size_t entries;   /**< Images held now. */
+		};
+
+		/**
+		 * Creates an empty cache.
+		 * @param capacityBytes The most pixel bytes to hold at once.
+		 */
+		explicit QuadtreeTileCache(size_t capacityBytes);
+
+		QuadtreeTileCache(QuadtreeTileCache const & other) = delete;
+		QuadtreeTileCache & operator=(QuadtreeTileCache const & other) = delete;
+
+		/**
+		 * Returns tree.decompressRegion(x, y, width, height, level),
+		 * rendering it only if it is not cached yet.
+		 * @param tree The tree to render.
+		 * @param x Left edge of the region.
+		 * @param y Top edge of the region.
+		 * @param width Width of the region, in pixels of the tree.
+		 * @param height Height of the region, in pixels of the tree.
+		 * @param level The region is reduced by 2^level in each direction.
+		 * @return The rendered region, shared with the cache.
+		 */
+		std::shared_ptr<PNG const> get(Quadtree const & tree, int x, int y, int width, int height, int level = 0);
+
+		/**
+		 * Returns the whole image of the tree at the given level.
+		 * @param tree The tree to render.
+		 * @param level The image is reduced by 2^level in each direction.
+		 * @return The rendered image, shared with the cache.
+		 */
+		std::shared_ptr<PNG const> get(Quadtree const & tree, int level = 0);
+
+		/**
+		 * Drops every cached image; renders in progress still complete.
+		 * The hit, miss, eviction and uncached counts are kept.
+		 */
+		void clear();
+
+		/** @return The counters so far. */
+		Counters counters() const;
+
+		/** @return The most pixel bytes held at once. */
+		size_t capacity() const;
+
+	private:
+		struct Key
+		{
+			uint64_t tree;
+			int resolution;
+			bool premultiplied;
+			bool exact;
+			int x;
+			int y;
+			int width;
+			int height;
+			int level;
+
+			bool operator==(Key const & other) const;
+		};
+
+		struct KeyHash
+		{
+			size_t operator()(Key const & key) const;
+		};
+
+		struct Entry
+		{
+			std::shared_ptr<PNG const> image; /**< NULL while the region is being rendered */
+			size_t bytes;
+			std::list<Key>::iterator position; /**< place in _order, once rendered */
+		};
+
+		size_t _capacity;
+		size_t _bytes;
+		size_t _hits;
+		size_t _misses;
+		size_t _evictions;
+		size_t _uncached;
+		std::unordered_map<Key, Entry, KeyHash> _entries;
+		std::list<Key> _order;  /**< rendered entries, most recently used first */
+		mutable std::mutex _mutex;
+		std::condition_variable _rendered;
+
+		void evict();
+};
+
+#endif // QUADTREE_CACHE_H
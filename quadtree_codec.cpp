@@ -0,0 +1,647 @@
+/**
+ * @file quadtree_codec.cpp
+ * Implementation of the compact Quadtree format: split flags and color
+ * residuals under an adaptive binary range coder.
+ *
+ * Every node is predicted by the plain truncated average of its four
+ * children, the average buildTree stores, whatever mode the tree is in.
+ * A split node's children are sent as residuals from that prediction, so
+ * on smooth images most residuals are near zero; and since the four
+ * children average to the prediction, the fourth child only needs the
+ * remainder of the division (0 to 3) per channel. Every flag, residual
+ * bit and remainder bit has its own adaptive probability, chosen by the
+ * size of the square and, for green and blue, by how far red moved.
+ */
+
+#include <cstring>
+#include <string>
+
+#include "quadtree.h"
+
+using namespace std;
+
+//contexts: squares are bucketed by log2 of their size, the residual of green and blue by the size of red's
+int const compactLevels = 12;
+int const compactBuckets = 4;
+
+//the probabilities are 11-bit estimates that a bit is 0, moved 1/32 of the way after every bit
+int const probabilityBits = 11;
+int const adaptShift = 5;
+uint16_t const probabilityHalf = 1 << (probabilityBits - 1);
+uint32_t const rangeTop = 1u << 24;
+
+//a node's predicted color and split flag, in preorder; end is the index after its subtree
+struct Quadtree::CompactEntry{
+	RGBAPixel color;
+	bool split;
+	size_t end;
+};
+
+//the plain truncated average the format predicts with
+static RGBAPixel predict(RGBAPixel const colors[4])
+{
+	return RGBAPixel((colors[0].red + colors[1].red + colors[2].red + colors[3].red) / 4,
+		(colors[0].green + colors[1].green + colors[2].green + colors[3].green) / 4,
+		(colors[0].blue + colors[1].blue + colors[2].blue + colors[3].blue) / 4,
+		(colors[0].alpha + colors[1].alpha + colors[2].alpha + colors[3].alpha) / 4);
+}
+
+static void channels(RGBAPixel const & color, int values[4])
+{
+	values[0] = color.red;
+	values[1] = color.green;
+	values[2] = color.blue;
+	values[3] = color.alpha;
+}
+
+static int level(int resolution)
+{
+	int result = 0;
+	while(resolution > 1 && result < compactLevels - 1)
+	{
+		resolution /= 2;
+		result++;
+	}
+	return result;
+}
+
+//residuals wrap around 256 and are folded so small changes of either sign get small codes: 0, -1, 1, -2, ...
+static int fold(int residual)
+{
+	int wrapped = (int8_t) (uint8_t) residual;
+	return (uint8_t) ((wrapped * 2) ^ (wrapped >> 7));
+}
+
+static int unfold(int code)
+{
+	return (code >> 1) ^ -(code & 1);
+}
+
+static int bucket(int code)
+{
+	if(code == 0)
+		return 0;
+	if(code <= 4)
+		return 1;
+	if(code <= 16)
+		return 2;
+	return 3;
+}
+
+/**
+ * The adaptive probabilities shared by the encoder and the decoder, which
+ * must see the same bits in the same contexts to stay in step.
+ */
+struct CompactModels
+{
+	vector<uint16_t> split;     // [level][split siblings before it]
+	vector<uint16_t> residual;  // [channel][level][split][bucket] bit trees of 256
+	vector<uint16_t> remainder; // [channel][level] bit trees of 4
+
+	CompactModels()
+		: split(compactLevels * 4, probabilityHalf),
+		  residual(4 * compactLevels * 2 * compactBuckets * 256, probabilityHalf),
+		  remainder(4 * compactLevels * 4, probabilityHalf)
+	{
+		/* nothing */
+	}
+
+	uint16_t & splitFlag(int level, int siblings)
+	{
+		return split[level * 4 + siblings];
+	}
+
+	uint16_t * residualTree(int channel, int level, bool split, int bucket)
+	{
+		return &residual[(((channel * compactLevels + level) * 2 + split) * compactBuckets + bucket) * 256];
+	}
+
+	uint16_t * remainderTree(int channel, int level)
+	{
+		return &remainder[(channel * compactLevels + level) * 4];
+	}
+};
+
+/**
+ * Binary range encoder (the LZMA scheme): low carries into bytes already
+ * produced, so a run of 0xff bytes is held back until the carry is known.
+ */
+class RangeEncoder
+{
+	public:
+		RangeEncoder() : _low(0), _range(0xffffffffu), _cache(0), _cacheSize(1)
+		{
+			/* nothing */
+		}
+
+		void bit(uint16_t & probability, int value)
+		{
+			uint32_t bound = (_range >> probabilityBits) * probability;
+			if(value == 0)
+			{
+				_range = bound;
+				probability += ((1 << probabilityBits) - probability) >> adaptShift;
+			}
+			else
+			{
+				_low += bound;
+				_range -= bound;
+				probability -= probability >> adaptShift;
+			}
+
+			if(_range < rangeTop)
+			{
+				_range <<= 8;
+				shiftLow();
+			}
+		}
+
+		// the bits of value, most significant first, down a tree of 2^bits probabilities
+		void symbol(uint16_t * tree, int bits, int value)
+		{
+			int node = 1;
+			for(int i = bits - 1; i >= 0; i--)
+			{
+				int next = (value >> i) & 1;
+				bit(tree[node], next);
+				node = (node << 1) | next;
+			}
+		}
+
+		string const & finish()
+		{
+			for(int i = 0; i < 5; i++)
+				shiftLow();
+			return _bytes;
+		}
+
+	private:
+		void shiftLow()
+		{
+			if((uint32_t) _low < 0xff000000u || (_low >> 32) != 0)
+			{
+				uint8_t carry = _low >> 32;
+				uint8_t pending = _cache;
+				do
+				{
+					_bytes.push_back((char) (uint8_t) (pending + carry));
+					pending = 0xff;
+				} while(--_cacheSize != 0);
+				_cache = (uint8_t) (_low >> 24);
+			}
+			_cacheSize++;
+			_low = (_low & 0x00ffffffu) << 8;
+		}
+
+		uint64_t _low;
+		uint32_t _range;
+		uint8_t _cache;
+		uint64_t _cacheSize;
+		string _bytes;
+};
+
+/**
+ * The decoder of RangeEncoder. Reading past the end of the stream counts
+ * as zero bytes and marks the stream truncated.
+ */
+class RangeDecoder
+{
+	public:
+		RangeDecoder(istream & in) : _in(in.rdbuf()), _code(0), _range(0xffffffffu), _truncated(_in == NULL)
+		{
+			for(int i = 0; i < 5; i++)
+				_code = (_code << 8) | next();
+		}
+
+		int bit(uint16_t & probability)
+		{
+			uint32_t bound = (_range >> probabilityBits) * probability;
+			int value;
+			if(_code < bound)
+			{
+				_range = bound;
+				probability += ((1 << probabilityBits) - probability) >> adaptShift;
+				value = 0;
+			}
+			else
+			{
+				_code -= bound;
+				_range -= bound;
+				probability -= probability >> adaptShift;
+				value = 1;
+			}
+
+			if(_range < rangeTop)
+			{
+				_range <<= 8;
+				_code = (_code << 8) | next();
+			}
+			return value;
+		}
+
+		int symbol(uint16_t * tree, int bits)
+		{
+			int node = 1;
+			for(int i = 0; i < bits; i++)
+				node = (node << 1) | bit(tree[node]);
+			return node - (1 << bits);
+		}
+
+		bool truncated() const
+		{
+			return _truncated;
+		}
+
+	private:
+		uint8_t next()
+		{
+			if(_truncated)
+				return 0;
+
+			int value = _in->sbumpc();
+			if(value == char_traits<char>::eof())
+			{
+				_truncated = true;
+				return 0;
+			}
+			return (uint8_t) value;
+		}
+
+		streambuf * _in;
+		uint32_t _code;
+		uint32_t _range;
+		bool _truncated;
+};
+
+/**
+ * Writes the symbols of the compact format.
+ */
+class Quadtree::CompactWriter
+{
+	public:
+		// the split flags of a node's four children, each half wide
+		void splits(bool const values[4], int half)
+		{
+			int siblings = 0;
+			for(int i = 0; i < 4; i++)
+			{
+				_coder.bit(_models.splitFlag(level(half), siblings), values[i]);
+				siblings += values[i];
+			}
+		}
+
+		void split(bool value, int resolution)
+		{
+			_coder.bit(_models.splitFlag(level(resolution), 0), value);
+		}
+
+		// the colors of a node's four children, predicted as parent
+		void children(RGBAPixel const & parent, RGBAPixel const colors[4], bool const splits[4], int half)
+		{
+			int depth = level(half);
+			int predicted[4];
+			channels(parent, predicted);
+
+			int sums[4] = {0, 0, 0, 0};
+			for(int i = 0; i < 3; i++)
+			{
+				int values[4];
+				channels(colors[i], values);
+				residual(predicted, values, depth, splits[i]);
+				for(int c = 0; c < 4; c++)
+					sums[c] += values[c];
+			}
+
+			// the fourth child is implied by the prediction up to the division's remainder
+			int last[4];
+			channels(colors[3], last);
+			for(int c = 0; c < 4; c++)
+				_coder.symbol(_models.remainderTree(c, depth), 2, sums[c] + last[c] - 4 * predicted[c]);
+		}
+
+		void color(RGBAPixel const & color, int resolution)
+		{
+			int zero[4] = {0, 0, 0, 0};
+			int values[4];
+			channels(color, values);
+			residual(zero, values, level(resolution), false);
+		}
+
+		string const & finish()
+		{
+			return _coder.finish();
+		}
+
+	private:
+		// green and blue are sent relative to red's residual, which they usually follow
+		void residual(int const predicted[4], int const values[4], int depth, bool split)
+		{
+			int red = values[0] - predicted[0];
+			for(int c = 0; c < 4; c++)
+			{
+				int change = values[c] - predicted[c];
+				int context = 0;
+				if(c == 1 || c == 2)
+				{
+					context = bucket(fold(red));
+					change -= red;
+				}
+				_coder.symbol(_models.residualTree(c, depth, split, context), 8, fold(change));
+			}
+		}
+
+		RangeEncoder _coder;
+		CompactModels _models;
+};
+
+/**
+ * Reads the symbols CompactWriter writes.
+ */
+class Quadtree::CompactReader
+{
+	public:
+		CompactReader(istream & in) : _coder(in)
+		{
+			/* nothing */
+		}
+
+		void splits(bool values[4], int half)
+		{
+			int siblings = 0;
+			for(int i = 0; i < 4; i++)
+			{
+				values[i] = _coder.bit(_models.splitFlag(level(half), siblings)) != 0;
+				siblings += values[i];
+			}
+		}
+
+		bool split(int resolution)
+		{
+			return _coder.bit(_models.splitFlag(level(resolution), 0)) != 0;
+		}
+
+		// false if the remainders do not give the fourth child a valid color
+		bool children(RGBAPixel const & parent, RGBAPixel colors[4], bool const splits[4], int half)
+		{
+			int depth = level(half);
+			int predicted[4];
+			channels(parent, predicted);
+
+			int sums[4] = {0, 0, 0, 0};
+			for(int i = 0; i < 3; i++)
+			{
+				int values[4];
+				residual(predicted, values, depth, splits[i]);
+				colors[i] = RGBAPixel(values[0], values[1], values[2], values[3]);
+				for(int c = 0; c < 4; c++)
+					sums[c] += values[c];
+			}
+
+			int last[4];
+			for(int c = 0; c < 4; c++)
+			{
+				last[c] = 4 * predicted[c] + _coder.symbol(_models.remainderTree(c, depth), 2) - sums[c];
+				if(last[c] < 0 || last[c] > 255)
+					return false;
+			}
+			colors[3] = RGBAPixel(last[0], last[1], last[2], last[3]);
+			return true;
+		}
+
+		RGBAPixel color(int resolution)
+		{
+			int zero[4] = {0, 0, 0, 0};
+			int values[4];
+			residual(zero, values, level(resolution), false);
+			return RGBAPixel(values[0], values[1], values[2], values[3]);
+		}
+
+		bool truncated() const
+		{
+			return _coder.truncated();
+		}
+
+	private:
+		void residual(int const predicted[4], int values[4], int depth, bool split)
+		{
+			int red = 0;
+			for(int c = 0; c < 4; c++)
+			{
+				int context = (c == 1 || c == 2) ? bucket(fold(red)) : 0;
+				int change = unfold(_coder.symbol(_models.residualTree(c, depth, split, context), 8));
+				if(c == 0)
+					red = change;
+				if(c == 1 || c == 2)
+					change += red;
+				values[c] = (predicted[c] + change) & 0xff;
+			}
+		}
+
+		RangeDecoder _coder;
+		CompactModels _models;
+};
+
+static bool readCompactHeader(istream & in, int & resolution)
+{
+	unsigned char header[8];
+	if(!in.read((char *) header, 8) || memcmp(header, "QTC1", 4) != 0)
+		return false;
+
+	resolution = header[4] | (header[5] << 8) | (header[6] << 16) | (header[7] << 24);
+	return resolution >= 0 && (resolution & (resolution - 1)) == 0;
+}
+
+
+
+
+/*
+*Writes the Quadtree to a stream in the compact format, which read() also accepts:
+*
+*  4 bytes   magic "QTC1"
+*  4 bytes   resolution, little endian (0 for an empty tree)
+*  payload   range coded, for the root its color (residuals from 0) and split flag, then for every *split node in preorder: its children's colors (see below), followed by each child's split flag and, *if it is split, its own children. Squares of one pixel have no split flag.
+*
+*A split node's children are coded against the node's prediction, the plain truncated average of its *children's predictions (leaves predict their own color): the first three as per-channel residuals, *the fourth as the remainder of the four colors' sum after dividing by 4. The prediction is the same in *every mode, so the stream does not depend on exact or premultiplied mode; read() recomputes the *internal colors for its own.
+*/
+void Quadtree::writeCompact(ostream & out) const{
+	int resolution = getResolution();
+	char header[8] = {'Q', 'T', 'C', '1',
+					  (char)(resolution & 0xff), (char)((resolution >> 8) & 0xff),
+					  (char)((resolution >> 16) & 0xff), (char)((resolution >> 24) & 0xff)};
+	out.write(header, 8);
+
+	if(root == NULL){
+		return;
+	}
+
+	vector<CompactEntry> entries;
+	entries.reserve(nodeCount(root));
+	gatherCompact(root, entries);
+
+	CompactWriter writer;
+	writer.color(entries[0].color, resolution);
+	if(resolution > 1){
+		writer.split(entries[0].split, resolution);
+	}
+	if(entries[0].split){
+		writeCompact(writer, entries, 0, resolution);
+	}
+
+	string const & bytes = writer.finish();
+	out.write(bytes.data(), bytes.size());
+}
+
+/*
+*Decodes a stream written by writeCompact() straight into image, one leaf square at a time, without *building a tree. The image is resized to the tree's resolution. Returns false, leaving image in an *unspecified state, if the stream is truncated or malformed; an empty tree gives an empty image. A *header claiming more than maxResolution pixels a side is rejected before anything is allocated.
+*/
+bool Quadtree::readCompactImage(istream & in, PNG & image, int maxResolution){
+	int resolution;
+	if(!readCompactHeader(in, resolution) || resolution > maxResolution){
+		return false;
+	}
+
+	image.resize(resolution, resolution);
+	if(resolution == 0){
+		return true;
+	}
+
+	CompactReader reader(in);
+	RGBAPixel color = reader.color(resolution);
+	bool split = resolution > 1 && reader.split(resolution);
+	return readCompactImage(reader, color, split, 0, 0, resolution, image) && !reader.truncated();
+}
+
+//compact format helper function, appends root's subtree in preorder and returns its prediction
+RGBAPixel Quadtree::gatherCompact(QuadtreeNode * root, vector<CompactEntry> & entries){
+	size_t index = entries.size();
+	entries.push_back(CompactEntry());
+
+	if(root->nwChild == NULL){
+		entries[index].color = root->element;
+		entries[index].split = false;
+		entries[index].end = index + 1;
+		return root->element;
+	}
+
+	RGBAPixel colors[4];
+	colors[0] = gatherCompact(root->nwChild, entries);
+	colors[1] = gatherCompact(root->neChild, entries);
+	colors[2] = gatherCompact(root->swChild, entries);
+	colors[3] = gatherCompact(root->seChild, entries);
+
+	entries[index].color = predict(colors);
+	entries[index].split = true;
+	entries[index].end = entries.size();
+	return entries[index].color;
+}
+
+//compact format helper function, writes the split flags and colors of the children of the split entry at index, then
+//the children of each split child
+void Quadtree::writeCompact(CompactWriter & writer, vector<CompactEntry> const & entries, size_t index, int resolution){
+	size_t children[4];
+	children[0] = index + 1;
+	for(int i = 1; i < 4; i++){
+		children[i] = entries[children[i - 1]].end;
+	}
+
+	int half = resolution/2;
+	bool const splits[4] = {entries[children[0]].split, entries[children[1]].split, entries[children[2]].split, entries[children[3]].split};
+	RGBAPixel const colors[4] = {entries[children[0]].color, entries[children[1]].color, entries[children[2]].color, entries[children[3]].color};
+	if(half > 1){
+		writer.splits(splits, half);
+	}
+	writer.children(entries[index].color, colors, splits, half);
+
+	for(int i = 0; i < 4; i++){
+		if(splits[i]){
+			writeCompact(writer, entries, children[i], half);
+		}
+	}
+}
+
+//compact format helper function, paints the subtree of a node decoded as color
+bool Quadtree::readCompactImage(CompactReader & reader, RGBAPixel const & color, bool split, int x, int y, int resolution, PNG & image){
+	//past the end of the stream the decoder only produces noise
+	if(reader.truncated()){
+		return false;
+	}
+
+	if(!split){
+		for(int j = y; j < y + resolution; j++){
+			for(int i = x; i < x + resolution; i++){
+				*image(i, j) = color;
+			}
+		}
+		return true;
+	}
+
+	int half = resolution/2;
+	bool splits[4] = {false, false, false, false};
+	RGBAPixel colors[4];
+	if(half > 1){
+		reader.splits(splits, half);
+	}
+	if(!reader.children(color, colors, splits, half)){
+		return false;
+	}
+
+	return readCompactImage(reader, colors[0], splits[0], x, y, half, image) && readCompactImage(reader, colors[1], splits[1], x + half, y, half, image)
+		&& readCompactImage(reader, colors[2], splits[2], x, y + half, half, image) && readCompactImage(reader, colors[3], splits[3], x + half, y + half, half, image);
+}
+
+//compact format helper function, the tree read() builds from the payload after the header
+Quadtree::QuadtreeNode * Quadtree::readCompact(istream & in, int resolution){
+	CompactReader reader(in);
+	RGBAPixel color = reader.color(resolution);
+	bool split = resolution > 1 && reader.split(resolution);
+	QuadtreeNode * result = readCompact(reader, color, split, resolution);
+	if(result != NULL && reader.truncated()){
+		clear(result);
+	}
+
+	return result;
+}
+
+//compact format helper function, rebuilds the subtree of a node decoded as color and recomputes its internal colors
+Quadtree::QuadtreeNode * Quadtree::readCompact(CompactReader & reader, RGBAPixel const & color, bool split, int resolution){
+	//past the end of the stream the decoder only produces noise
+	if(reader.truncated()){
+		return NULL;
+	}
+
+	if(!split){
+		QuadtreeNode * leaf = new QuadtreeNode(color);
+		QT_STAT(counters.nodesAllocated++);
+		flatSums(leaf, resolution);
+		rehash(leaf);
+		return leaf;
+	}
+
+	int half = resolution/2;
+	bool splits[4] = {false, false, false, false};
+	RGBAPixel colors[4];
+	if(half > 1){
+		reader.splits(splits, half);
+	}
+	if(!reader.children(color, colors, splits, half)){
+		return NULL;
+	}
+
+	QuadtreeNode * node = new QuadtreeNode();
+	QT_STAT(counters.nodesAllocated++);
+
+	node->nwChild = readCompact(reader, colors[0], splits[0], half);
+	node->neChild = (node->nwChild != NULL) ? readCompact(reader, colors[1], splits[1], half) : NULL;
+	node->swChild = (node->neChild != NULL) ? readCompact(reader, colors[2], splits[2], half) : NULL;
+	node->seChild = (node->swChild != NULL) ? readCompact(reader, colors[3], splits[3], half) : NULL;
+
+	//stops at the first malformed child and frees what was read so far
+	if(node->seChild == NULL){
+		clear(node);
+		return NULL;
+	}
+
+	average(node);
+	rehash(node);
+	return node;
+}
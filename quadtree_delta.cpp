@@ -0,0 +1,176 @@
+/**
+ * @file quadtree_delta.cpp
+ * Implementation of the QuadtreeDelta class.
+ *
+ * File layout, all integers 4 bytes little endian:
+ *
+ *   "QTD1" resolution count
+ *   count times: x y resolution length, then length bytes of subtree
+ */
+
+#include <algorithm>
+#include <climits>
+#include <fstream>
+
+#include "quadtree_delta.h"
+
+using namespace std;
+
+namespace
+{
+
+void putWord(ostream & out, unsigned int value)
+{
+	char bytes[4] = {(char)(value & 0xff), (char)((value >> 8) & 0xff),
+					 (char)((value >> 16) & 0xff), (char)((value >> 24) & 0xff)};
+	out.write(bytes, 4);
+}
+
+bool getWord(istream & in, unsigned int & value)
+{
+	unsigned char bytes[4];
+	if(!in.read((char *)bytes, 4))
+		return false;
+
+	value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int) bytes[3] << 24);
+	return true;
+}
+
+// the longest preorder encoding of a size x size square: every pixel a
+// 5-byte leaf, plus a flag byte for each internal node above them
+long long maxSubtreeBytes(long long size)
+{
+	return 5 * size * size + (size * size - 1) / 3;
+}
+
+// appends length bytes to out, growing it only as the bytes arrive
+bool getBytes(istream & in, string & out, unsigned int length)
+{
+	char buffer[65536];
+	while(length > 0)
+	{
+		unsigned int chunk = min(length, (unsigned int) sizeof(buffer));
+		if(!in.read(buffer, chunk))
+			return false;
+
+		out.append(buffer, chunk);
+		length -= chunk;
+	}
+	return true;
+}
+
+}
+
+QuadtreeDelta::QuadtreeDelta() : _resolution(0)
+{
+	/* nothing */
+}
+
+int QuadtreeDelta::getResolution() const
+{
+	return _resolution;
+}
+
+vector<QuadtreeDelta::Change> const & QuadtreeDelta::changes() const
+{
+	return _changes;
+}
+
+size_t QuadtreeDelta::payloadSize() const
+{
+	size_t bytes = 0;
+	for(size_t i = 0; i < _changes.size(); i++)
+		bytes += _changes[i].subtree.size();
+	return bytes;
+}
+
+void QuadtreeDelta::write(ostream & out) const
+{
+	out.write("QTD1", 4);
+	putWord(out, _resolution);
+	putWord(out, _changes.size());
+
+	for(size_t i = 0; i < _changes.size(); i++)
+	{
+		Change const & change = _changes[i];
+		putWord(out, change.x);
+		putWord(out, change.y);
+		putWord(out, change.resolution);
+		putWord(out, change.subtree.size());
+		out.write(change.subtree.data(), change.subtree.size());
+	}
+}
+
+bool QuadtreeDelta::read(istream & in)
+{
+	_resolution = 0;
+	_changes.clear();
+
+	char magic[4];
+	unsigned int resolution, count;
+	if(!in.read(magic, 4) || string(magic, 4) != "QTD1"
+			|| !getWord(in, resolution) || !getWord(in, count))
+		return false;
+
+	// the changes are disjoint squares, so there are at most resolution^2
+	if(!validResolution(resolution) || count > (long long) resolution * resolution)
+		return false;
+
+	vector<Change> changes;
+	for(unsigned int i = 0; i < count; i++)
+	{
+		Change change;
+		unsigned int x, y, size, length;
+		if(!getWord(in, x) || !getWord(in, y) || !getWord(in, size) || !getWord(in, length))
+			return false;
+
+		if(!validSquare(x, y, size, resolution) || length > maxSubtreeBytes(size))
+			return false;
+
+		change.x = x;
+		change.y = y;
+		change.resolution = size;
+		if(!getBytes(in, change.subtree, length))
+			return false;
+
+		changes.push_back(change);
+	}
+
+	_resolution = resolution;
+	_changes.swap(changes);
+	return true;
+}
+
+bool QuadtreeDelta::validResolution(long long resolution)
+{
+	return resolution >= 0 && resolution <= INT_MAX && (resolution & (resolution - 1)) == 0;
+}
+
+bool QuadtreeDelta::validSquare(long long x, long long y, long long size, long long resolution)
+{
+	return size > 0 && size <= resolution && (size & (size - 1)) == 0
+		&& x >= 0 && y >= 0 && x < resolution && y < resolution && x % size == 0 && y % size == 0;
+}
+
+bool QuadtreeDelta::writeToFile(string const & file_name) const
+{
+	ofstream out(file_name.c_str(), ios::binary);
+	if(!out)
+		return false;
+
+	write(out);
+	return (bool) out;
+}
+
+bool QuadtreeDelta::readFromFile(string const & file_name)
+{
+	ifstream in(file_name.c_str(), ios::binary);
+	if(!in)
+	{
+		_resolution = 0;
+		_changes.clear();
+		return false;
+	}
+
+	return read(in);
+}
@@ -0,0 +1,105 @@
+/**
+ * @file quadtree_delta.h
+ * Definition of the QuadtreeDelta class, the set of subtrees that differ
+ * between two Quadtrees of the same resolution.
+ */
+
+#ifndef QUADTREE_DELTA_H
+#define QUADTREE_DELTA_H
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * The changes that turn one Quadtree into another, as produced by
+ * Quadtree::diff() and consumed by Quadtree::applyDelta(). Each change
+ * replaces the square subtree at (x, y) with the given resolution by a
+ * new subtree, stored in the same preorder layout as Quadtree::write()
+ * uses after its header.
+ */
+class QuadtreeDelta
+{
+	public:
+		/**
+		 * One replaced subtree.
+		 */
+		struct Change
+		{
+			int x;              /**< Left edge of the replaced square. */
+			int y;              /**< Top edge of the replaced square. */
+			int resolution;     /**< Width and height of the replaced square. */
+			std::string subtree; /**< Preorder encoding of the new subtree. */
+		};
+
+		/**
+		 * Creates a delta that turns any tree into an empty one.
+		 */
+		QuadtreeDelta();
+
+		/**
+		 * @return The resolution of the tree the delta produces (0 for an
+		 *  empty tree).
+		 */
+		int getResolution() const;
+
+		/**
+		 * @return The replaced subtrees, in preorder of their position.
+		 */
+		std::vector<Change> const & changes() const;
+
+		/**
+		 * @return The total number of bytes of encoded subtrees.
+		 */
+		size_t payloadSize() const;
+
+		/**
+		 * Writes the delta to a stream in a compact binary format.
+		 * @param out Stream to write to.
+		 */
+		void write(std::ostream & out) const;
+
+		/**
+		 * Replaces this delta with one read from a stream written by
+		 * write().
+		 * @param in Stream to read from.
+		 * @return Whether the delta was read successfully; on failure the
+		 *  delta is left empty.
+		 */
+		bool read(std::istream & in);
+
+		/**
+		 * Writes the delta to a file using write().
+		 * @param file_name Name of the file to write to.
+		 * @return Whether the file was written successfully.
+		 */
+		bool writeToFile(std::string const & file_name) const;
+
+		/**
+		 * Reads the delta from a file written by writeToFile().
+		 * @param file_name Name of the file to read from.
+		 * @return Whether the file was read successfully.
+		 */
+		bool readFromFile(std::string const & file_name);
+
+	private:
+		int _resolution;
+		std::vector<Change> _changes;
+
+		/**
+		 * @return Whether resolution is 0 or a power of two that fits in
+		 *  an int.
+		 */
+		static bool validResolution(long long resolution);
+
+		/**
+		 * @return Whether (x, y) and size name an aligned square inside a
+		 *  tree of the given (valid) resolution.
+		 */
+		static bool validSquare(long long x, long long y, long long size, long long resolution);
+
+		friend class Quadtree;
+};
+
+#endif // QUADTREE_DELTA_H
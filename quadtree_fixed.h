@@ -0,0 +1,404 @@
+/**
+ * @file quadtree_fixed.h
+ * Definition of the FixedQuadtree class template, a Quadtree whose
+ * resolution is fixed at compile time and whose nodes live in one flat
+ * array.
+ */
+
+#ifndef QUADTREE_FIXED_H
+#define QUADTREE_FIXED_H
+
+#include <bitset>
+
+#include "colormetric.h"
+#include "idealprune.h"
+#include "png.h"
+
+/**
+ * A Quadtree for square tiles of 2^Log2Size pixels a side (16x16, 32x32,
+ * 64x64 sprites and icons), meant to be built and decoded by the million.
+ *
+ * Every node of the full tree is stored inside the object, level by level
+ * from the root, so a tree never allocates: the children of node i are
+ * nodes 4i+1 to 4i+4 (northwest, northeast, southwest, southeast), and
+ * within the pixel level the nodes are in Morton order. Pruning only
+ * clears the split flag of the nodes that become leaves; everything below
+ * them is kept and ignored. The depth is a template parameter, so the
+ * walks below unroll into straight-line code.
+ *
+ * Colors are averaged, compared and pruned exactly as a Quadtree of the
+ * same resolution does with straight alpha and without exact sums, so
+ * both trees give the same pixels, leaf counts and tolerances.
+ *
+ * @tparam Log2Size Base-two logarithm of the resolution, from 0 to 8.
+ */
+template <int Log2Size>
+class FixedQuadtree
+{
+	static_assert(Log2Size >= 0 && Log2Size <= 8, "FixedQuadtree covers tiles of 1x1 to 256x256 pixels");
+
+	public:
+		/** Width and height of the image the tree represents. */
+		static int const Resolution = 1 << Log2Size;
+
+		/** Number of nodes of the unpruned tree. */
+		static int const NodeCount = ((1 << (2 * Log2Size + 2)) - 1) / 3;
+
+		/**
+		 * Creates an empty tree.
+		 */
+		FixedQuadtree() : _built(false)
+		{
+			/* nothing */
+		}
+
+		/**
+		 * Creates the tree of the upper left Resolution x Resolution
+		 * pixels of source.
+		 * @param source The image to compress.
+		 * @param resolution Must be Resolution; taken for compatibility
+		 *  with Quadtree.
+		 */
+		FixedQuadtree(PNG const & source, int resolution = Resolution) : _built(false)
+		{
+			buildTree(source, resolution);
+		}
+
+		/**
+		 * Rebuilds the tree from the upper left Resolution x Resolution
+		 * pixels of source.
+		 * @param source The image to compress.
+		 * @param resolution Must be Resolution; taken for compatibility
+		 *  with Quadtree.
+		 */
+		void buildTree(PNG const & source, int resolution = Resolution)
+		{
+			(void) resolution;
+			buildTile(source, 0, 0);
+		}
+
+		/**
+		 * Rebuilds the tree from the tile of source whose upper left
+		 * corner is (x, y), for instance one cell of a sprite sheet.
+		 * @param source The image holding the tile.
+		 * @param x Left edge of the tile.
+		 * @param y Top edge of the tile.
+		 */
+		void buildTile(PNG const & source, int x, int y)
+		{
+			// the pixel level, in Morton order
+			for(int j = 0; j < Resolution; j++)
+				for(int i = 0; i < Resolution; i++)
+					_colors[levelStart(Log2Size) + morton(i, j)] = *source(x + i, y + j);
+
+			// every other level averages the four consecutive nodes below it
+			for(int level = Log2Size - 1; level >= 0; level--)
+			{
+				int first = levelStart(level);
+				for(int node = first; node < levelStart(level + 1); node++)
+					_colors[node] = average(&_colors[4 * node + 1]);
+			}
+
+			_split.set();
+			_built = true;
+		}
+
+		/**
+		 * Gets the color of a pixel.
+		 * @param x X coordinate of the pixel.
+		 * @param y Y coordinate of the pixel.
+		 * @return The color of the leaf covering (x, y), or a default
+		 *  RGBAPixel outside the tree or when it is empty.
+		 */
+		RGBAPixel getPixel(int x, int y) const
+		{
+			if(!_built || x < 0 || y < 0 || x >= Resolution || y >= Resolution)
+				return RGBAPixel();
+
+			int node = 0;
+			for(int level = 0; level < Log2Size; level++)
+			{
+				if(!_split[node])
+					break;
+
+				int shift = Log2Size - 1 - level;
+				node = 4 * node + 1 + (((y >> shift) & 1) << 1 | ((x >> shift) & 1));
+			}
+
+			return _colors[node];
+		}
+
+		/**
+		 * @return The image the tree represents, or an empty PNG when
+		 *  the tree is empty.
+		 */
+		PNG decompress() const
+		{
+			if(!_built)
+				return PNG();
+
+			PNG image(Resolution, Resolution);
+			paint<0>(0, 0, 0, image);
+			return image;
+		}
+
+		/**
+		 * Collapses every subtree whose leaves are all within tolerance
+		 * of its color, as Quadtree::prune() does.
+		 * @param tolerance Largest squared Metric distance (alpha
+		 *  included) a leaf may have from the collapsed color.
+		 */
+		template <class Metric = RgbMetric>
+		void prune(int tolerance)
+		{
+			if(_built)
+				prune<Metric, 0>(0, tolerance);
+		}
+
+		/**
+		 * @param tolerance The tolerance to simulate.
+		 * @return The number of leaves prune(tolerance) would leave, as
+		 *  Quadtree::pruneSize() counts them (0 when the tree is empty
+		 *  or tolerance is negative).
+		 */
+		template <class Metric = RgbMetric>
+		int pruneSize(int tolerance) const
+		{
+			if(!_built || tolerance < 0)
+				return 0;
+
+			return pruneSize<Metric, 0>(0, tolerance);
+		}
+
+		/**
+		 * @param numLeaves The number of leaves wanted.
+		 * @return The tolerance Quadtree::idealPrune() would find for the
+		 *  same tree.
+		 */
+		template <class Metric = RgbMetric>
+		int idealPrune(int numLeaves) const
+		{
+			if(!_built)
+				return 0;
+
+			auto leaves = [this](int tolerance) { return pruneSize<Metric>(tolerance); };
+			return idealPruneSearch(leaves, 0, Metric::maxDistance + 255 * 255, numLeaves);
+		}
+
+		/**
+		 * @return Resolution, or 0 when the tree is empty.
+		 */
+		int getResolution() const
+		{
+			return _built ? Resolution : 0;
+		}
+
+		/**
+		 * @return The number of leaves of the (possibly pruned) tree.
+		 */
+		int leafCount() const
+		{
+			return _built ? leafCount<0>(0) : 0;
+		}
+
+		/**
+		 * @return The number of nodes of the (possibly pruned) tree.
+		 */
+		int nodeCount() const
+		{
+			return _built ? nodeCount<0>(0) : 0;
+		}
+
+		/**
+		 * Compares the leaves of two trees, as Quadtree::operator== does.
+		 * @param other The tree to compare with.
+		 * @return Whether both trees have the same shape and leaf colors.
+		 */
+		bool operator==(FixedQuadtree const & other) const
+		{
+			if(!_built || !other._built)
+				return _built == other._built;
+
+			return equal<0>(other, 0);
+		}
+
+	private:
+		/** Number of nodes that have children in the unpruned tree. */
+		static int const InternalCount = NodeCount - (1 << (2 * Log2Size));
+
+		RGBAPixel _colors[NodeCount];     /**< every node's color, level by level */
+		std::bitset<InternalCount> _split; /**< whether each node above the pixel level still has its children */
+		bool _built;                       /**< false until the first build */
+
+		// index of the first node of a level
+		static constexpr int levelStart(int level)
+		{
+			return ((1 << (2 * level)) - 1) / 3;
+		}
+
+		// interleaves the bits of x and y (x in the even bits), giving the
+		// pixel's position within the pixel level
+		static int morton(int x, int y)
+		{
+			int code = 0;
+			for(int bit = 0; bit < Log2Size; bit++)
+				code |= ((x >> bit) & 1) << (2 * bit) | ((y >> bit) & 1) << (2 * bit + 1);
+			return code;
+		}
+
+		// the truncated average of four consecutive colors, as Quadtree
+		// averages its children with straight alpha
+		static RGBAPixel average(RGBAPixel const * colors)
+		{
+			RGBAPixel result;
+			result.red = (colors[0].red + colors[1].red + colors[2].red + colors[3].red) / 4;
+			result.green = (colors[0].green + colors[1].green + colors[2].green + colors[3].green) / 4;
+			result.blue = (colors[0].blue + colors[1].blue + colors[2].blue + colors[3].blue) / 4;
+			result.alpha = (colors[0].alpha + colors[1].alpha + colors[2].alpha + colors[3].alpha) / 4;
+			return result;
+		}
+
+		// the squared Metric distance plus the squared alpha difference
+		template <class Metric>
+		static int distance(RGBAPixel const & first, RGBAPixel const & second)
+		{
+			int alpha = first.alpha - second.alpha;
+			return Metric::distance(first, second) + alpha * alpha;
+		}
+
+		// whether a node of the given level is a leaf of the current tree
+		template <int Level>
+		bool isLeaf(int node) const
+		{
+			if constexpr (Level == Log2Size)
+				return true;
+			else
+				return !_split[node];
+		}
+
+		template <int Level>
+		void paint(int node, int x, int y, PNG & image) const
+		{
+			if constexpr (Level < Log2Size)
+			{
+				if(_split[node])
+				{
+					int half = Resolution >> (Level + 1);
+					paint<Level + 1>(4 * node + 1, x, y, image);
+					paint<Level + 1>(4 * node + 2, x + half, y, image);
+					paint<Level + 1>(4 * node + 3, x, y + half, image);
+					paint<Level + 1>(4 * node + 4, x + half, y + half, image);
+					return;
+				}
+			}
+
+			int size = Resolution >> Level;
+			for(int j = y; j < y + size; j++)
+				for(int i = x; i < x + size; i++)
+					*image(i, j) = _colors[node];
+		}
+
+		// whether every leaf below node is within tolerance of color
+		template <class Metric, int Level>
+		bool withinTolerance(int node, RGBAPixel const & color, int tolerance) const
+		{
+			if(isLeaf<Level>(node))
+				return distance<Metric>(_colors[node], color) <= tolerance;
+
+			if constexpr (Level < Log2Size)
+			{
+				return withinTolerance<Metric, Level + 1>(4 * node + 1, color, tolerance)
+					&& withinTolerance<Metric, Level + 1>(4 * node + 2, color, tolerance)
+					&& withinTolerance<Metric, Level + 1>(4 * node + 3, color, tolerance)
+					&& withinTolerance<Metric, Level + 1>(4 * node + 4, color, tolerance);
+			}
+			else
+				return true;
+		}
+
+		template <class Metric, int Level>
+		void prune(int node, int tolerance)
+		{
+			if constexpr (Level < Log2Size)
+			{
+				if(!_split[node])
+					return;
+
+				if(withinTolerance<Metric, Level>(node, _colors[node], tolerance))
+				{
+					_split[node] = false;
+					return;
+				}
+
+				for(int child = 4 * node + 1; child <= 4 * node + 4; child++)
+					prune<Metric, Level + 1>(child, tolerance);
+			}
+		}
+
+		template <class Metric, int Level>
+		int pruneSize(int node, int tolerance) const
+		{
+			if(isLeaf<Level>(node) || withinTolerance<Metric, Level>(node, _colors[node], tolerance))
+				return 1;
+
+			if constexpr (Level < Log2Size)
+			{
+				int leaves = 0;
+				for(int child = 4 * node + 1; child <= 4 * node + 4; child++)
+					leaves += pruneSize<Metric, Level + 1>(child, tolerance);
+				return leaves;
+			}
+			else
+				return 1;
+		}
+
+		template <int Level>
+		int leafCount(int node) const
+		{
+			if constexpr (Level < Log2Size)
+			{
+				if(_split[node])
+					return leafCount<Level + 1>(4 * node + 1) + leafCount<Level + 1>(4 * node + 2)
+						+ leafCount<Level + 1>(4 * node + 3) + leafCount<Level + 1>(4 * node + 4);
+			}
+
+			return 1;
+		}
+
+		template <int Level>
+		int nodeCount(int node) const
+		{
+			if constexpr (Level < Log2Size)
+			{
+				if(_split[node])
+					return 1 + nodeCount<Level + 1>(4 * node + 1) + nodeCount<Level + 1>(4 * node + 2)
+						+ nodeCount<Level + 1>(4 * node + 3) + nodeCount<Level + 1>(4 * node + 4);
+			}
+
+			return 1;
+		}
+
+		template <int Level>
+		bool equal(FixedQuadtree const & other, int node) const
+		{
+			bool leaf = isLeaf<Level>(node);
+			if(leaf != other.isLeaf<Level>(node))
+				return false;
+
+			if(leaf)
+				return _colors[node] == other._colors[node];
+
+			if constexpr (Level < Log2Size)
+			{
+				for(int child = 4 * node + 1; child <= 4 * node + 4; child++)
+				{
+					if(!equal<Level + 1>(other, child))
+						return false;
+				}
+			}
+
+			return true;
+		}
+};
+
+#endif // QUADTREE_FIXED_H
@@ -96,13 +96,22 @@ bool Quadtree::compareTrees(QuadtreeNode const* firstPtr,
     if (firstPtr == NULL || secondPtr == NULL)
         return false;
 
+    // a shared subtree is equal to itself, and subtrees whose hashes
+    // differ cannot be equal, so neither needs to be walked
+    if (firstPtr == secondPtr)
+        return true;
+
+    if (firstPtr->hash != secondPtr->hash)
+        return false;
+
     // if they're both leaves, see if their elements are equal
     // note: child pointers should _all_ either be NULL or non-NULL,
     // so it suffices to check only one of each
     if (firstPtr->neChild == NULL && secondPtr->neChild == NULL) {
         if (firstPtr->element.red != secondPtr->element.red
             || firstPtr->element.green != secondPtr->element.green
-            || firstPtr->element.blue != secondPtr->element.blue)
+            || firstPtr->element.blue != secondPtr->element.blue
+            || firstPtr->element.alpha != secondPtr->element.alpha)
             return false;
         else
             return true;
@@ -0,0 +1,306 @@
+/**
+ * @file quadtree_progressive.cpp
+ * Implementation of the progressive format: Quadtree::writeProgressive()
+ * and the QuadtreeProgressiveReader class.
+ */
+
+#include <cstring>
+#include <queue>
+#include <utility>
+
+#include "quadtree_progressive.h"
+
+using namespace std;
+
+//record sizes after the 8-byte header: the root's color and split flag, and a family's four colors and split bits
+size_t const rootBytes = 5;
+size_t const familyBytes = 17;
+
+static RGBAPixel color(unsigned char const * bytes)
+{
+	return RGBAPixel(bytes[0], bytes[1], bytes[2], bytes[3]);
+}
+
+static void putColor(char * bytes, RGBAPixel const & color)
+{
+	bytes[0] = (char) color.red;
+	bytes[1] = (char) color.green;
+	bytes[2] = (char) color.blue;
+	bytes[3] = (char) color.alpha;
+}
+
+QuadtreeProgressiveReader::QuadtreeProgressiveReader(bool withImage, int maxResolution)
+	: _withImage(withImage), _maxResolution(maxResolution), _header(false), _failed(false), _resolution(0), _levels(0), _levelRemaining(0), _nextLevel(0)
+{
+	/* nothing */
+}
+
+bool QuadtreeProgressiveReader::feed(char const * data, size_t size)
+{
+	if(_failed || complete())
+		return !_failed;
+
+	_buffer.append(data, size);
+
+	size_t offset = 0;
+	size_t used = 0;
+	while(!_failed && !complete()
+		&& decode((unsigned char const *) _buffer.data() + offset, _buffer.size() - offset, used))
+		offset += used;
+
+	_buffer.erase(0, offset);
+	if(complete())
+		_buffer.clear();
+
+	return !_failed;
+}
+
+bool QuadtreeProgressiveReader::complete() const
+{
+	if(!_header)
+		return false;
+
+	return _resolution == 0 || (_levels > 0 && _pending.empty());
+}
+
+bool QuadtreeProgressiveReader::failed() const
+{
+	return _failed;
+}
+
+int QuadtreeProgressiveReader::levels() const
+{
+	return _levels;
+}
+
+int QuadtreeProgressiveReader::getResolution() const
+{
+	return _resolution;
+}
+
+PNG const & QuadtreeProgressiveReader::image() const
+{
+	return _image;
+}
+
+Quadtree QuadtreeProgressiveReader::tree() const
+{
+	Quadtree result;
+	if(_records.empty())
+		return result;
+
+	result.root = build(0);
+	result.rootResolution = _resolution;
+
+	// the internal nodes take the averages of their children, as in any tree of the default modes
+	result.recompute(result.root, _resolution);
+	return result;
+}
+
+// decodes the next record if size bytes hold all of it, setting used to
+// its length; returns false when more bytes are needed or the record is
+// malformed (which also sets _failed)
+bool QuadtreeProgressiveReader::decode(unsigned char const * data, size_t size, size_t & used)
+{
+	if(!_header)
+	{
+		if(size < 8)
+			return false;
+
+		used = 8;
+		_header = true;
+		_resolution = data[4] | (data[5] << 8) | (data[6] << 16) | (data[7] << 24);
+		// checked before the image is sized for it: a corrupt header can ask for 2^30 pixels a side
+		if(memcmp(data, "QTP1", 4) != 0 || _resolution < 0 || _resolution > _maxResolution
+			|| (_resolution & (_resolution - 1)) != 0)
+		{
+			_failed = true;
+			return false;
+		}
+
+		if(_withImage && _resolution > 0)
+			_image.resize(_resolution, _resolution);
+		return true;
+	}
+
+	if(_records.empty())
+	{
+		if(size < rootBytes)
+			return false;
+
+		used = rootBytes;
+		bool split = data[4] == 1;
+		if(data[4] > 1 || (split && _resolution == 1))
+		{
+			_failed = true;
+			return false;
+		}
+
+		Record root = {color(data), -1};
+		_records.push_back(root);
+		paint(root.color, 0, 0, _resolution);
+		if(split)
+		{
+			Pending pending = {0, 0, 0, _resolution};
+			_pending.push_back(pending);
+		}
+
+		_levels = 1;
+		_levelRemaining = _pending.size();
+		return true;
+	}
+
+	if(size < familyBytes)
+		return false;
+
+	used = familyBytes;
+	Pending parent = _pending.front();
+	int half = parent.resolution / 2;
+	unsigned char splits = data[16];
+	if(splits > 15 || (splits != 0 && half == 1))
+	{
+		_failed = true;
+		return false;
+	}
+	_pending.pop_front();
+
+	int first = _records.size();
+	_records[parent.record].children = first;
+
+	int const xs[4] = {parent.x, parent.x + half, parent.x, parent.x + half};
+	int const ys[4] = {parent.y, parent.y, parent.y + half, parent.y + half};
+	for(int i = 0; i < 4; i++)
+	{
+		Record child = {color(data + 4 * i), -1};
+		_records.push_back(child);
+		paint(child.color, xs[i], ys[i], half);
+
+		if(splits & (1 << i))
+		{
+			Pending pending = {first + i, xs[i], ys[i], half};
+			_pending.push_back(pending);
+			_nextLevel++;
+		}
+	}
+
+	// the last family of a level starts the next one
+	if(--_levelRemaining == 0)
+	{
+		_levels++;
+		_levelRemaining = _nextLevel;
+		_nextLevel = 0;
+	}
+	return true;
+}
+
+void QuadtreeProgressiveReader::paint(RGBAPixel const & color, int x, int y, int resolution)
+{
+	if(!_withImage)
+		return;
+
+	for(int j = y; j < y + resolution; j++)
+	{
+		for(int i = x; i < x + resolution; i++)
+			*_image(i, j) = color;
+	}
+}
+
+Quadtree::QuadtreeNode * QuadtreeProgressiveReader::build(int record) const
+{
+	Quadtree::QuadtreeNode * node = new Quadtree::QuadtreeNode(_records[record].color);
+	int children = _records[record].children;
+	if(children >= 0)
+	{
+		node->nwChild = build(children);
+		node->neChild = build(children + 1);
+		node->swChild = build(children + 2);
+		node->seChild = build(children + 3);
+	}
+
+	Quadtree::rehash(node);
+	return node;
+}
+
+
+
+
+/*
+*Writes the Quadtree to a stream in breadth-first order, so that any prefix of it decodes into a coarser *version of the tree (see QuadtreeProgressiveReader):
+*
+*  4 bytes   magic "QTP1"
+*  4 bytes   resolution, little endian (0 for an empty tree)
+*  5 bytes   the root's red, green, blue and alpha, then 1 if it is split or 0 if it is a leaf
+*  17 bytes  for every split node, level by level from the root down and in stream order within a *level: the colors of its nw, ne, sw and se children, then a byte whose bits 0 to 3 are set for the *children that are split.
+*
+*Every node carries the color the tree stores for it, the average of the pixels below it. A positive *maxLevels stops the stream after that many levels (1 sends the root alone), with the nodes of the last *level sent as leaves. read() also accepts the format.
+*/
+void Quadtree::writeProgressive(ostream & out, int maxLevels) const{
+	int resolution = getResolution();
+	char header[8] = {'Q', 'T', 'P', '1',
+					  (char)(resolution & 0xff), (char)((resolution >> 8) & 0xff),
+					  (char)((resolution >> 16) & 0xff), (char)((resolution >> 24) & 0xff)};
+	out.write(header, 8);
+
+	if(root == NULL){
+		return;
+	}
+
+	//a node at depth d may only be sent as split if its children's level, d + 1, is still within the budget
+	char record[familyBytes];
+	putColor(record, root->element);
+	record[4] = (root->nwChild != NULL && maxLevels != 1) ? 1 : 0;
+	out.write(record, rootBytes);
+
+	queue<pair<QuadtreeNode *, int> > split;
+	if(record[4] == 1){
+		split.push(make_pair(root, 0));
+	}
+
+	while(!split.empty()){
+		QuadtreeNode * node = split.front().first;
+		int depth = split.front().second + 1;
+		split.pop();
+
+		QuadtreeNode * const children[4] = {node->nwChild, node->neChild, node->swChild, node->seChild};
+		bool deeper = maxLevels <= 0 || depth + 1 < maxLevels;
+		record[16] = 0;
+		for(int i = 0; i < 4; i++){
+			putColor(record + 4 * i, children[i]->element);
+			if(deeper && children[i]->nwChild != NULL){
+				record[16] |= 1 << i;
+				split.push(make_pair(children[i], depth));
+			}
+		}
+		out.write(record, familyBytes);
+	}
+}
+
+//progressive format helper function, the tree read() builds from the records after the header
+Quadtree::QuadtreeNode * Quadtree::readProgressive(istream & in, int resolution){
+	//only the tree is wanted, so the reader keeps no image; read() has already held resolution to its own cap
+	QuadtreeProgressiveReader reader(false, resolution);
+	char record[familyBytes] = {'Q', 'T', 'P', '1',
+								(char)(resolution & 0xff), (char)((resolution >> 8) & 0xff),
+								(char)((resolution >> 16) & 0xff), (char)((resolution >> 24) & 0xff)};
+	reader.feed(record, 8);
+
+	//one record at a time, so nothing after the stream is consumed
+	size_t size = rootBytes;
+	while(!reader.complete() && !reader.failed()){
+		if(!in.read(record, size)){
+			return NULL;
+		}
+		reader.feed(record, size);
+		size = familyBytes;
+	}
+
+	if(reader.failed()){
+		return NULL;
+	}
+
+	//take the raw nodes rather than tree(), which would recolor them for the default modes first, then recolor
+	//them once and set their sums for this tree's modes, as read() does
+	QuadtreeNode * result = reader.build(0);
+	recompute(result, resolution);
+	return result;
+}
@@ -0,0 +1,136 @@
+/**
+ * @file quadtree_progressive.h
+ * Definition of the QuadtreeProgressiveReader class, which decodes the
+ * breadth-first stream Quadtree::writeProgressive() writes as its bytes
+ * arrive.
+ */
+
+#ifndef QUADTREE_PROGRESSIVE_H
+#define QUADTREE_PROGRESSIVE_H
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "png.h"
+#include "quadtree.h"
+
+/**
+ * Incremental decoder of the progressive format. The stream sends the
+ * root, then the children of every split node level by level, and every
+ * node carries the average color the tree stores for it, so whatever
+ * prefix has arrived describes a valid coarser tree: nodes whose children
+ * are still on their way are leaves of their average color.
+ *
+ * Bytes may be fed in pieces of any size. The image is refined in place as
+ * each family of four children arrives, so a viewer can show it after
+ * every feed; the first image is ready as soon as the 13 bytes of the
+ * header and root are in, and each further level costs four times as many
+ * records as the one before at most.
+ */
+class QuadtreeProgressiveReader
+{
+	public:
+		/**
+		 * Creates a reader waiting for the start of a stream.
+		 * @param withImage Whether to keep the image up to date. A reader
+		 *  that only builds the tree passes false and never allocates it.
+		 * @param maxResolution The largest resolution accepted; a header
+		 *  asking for more fails the stream before anything is allocated.
+		 */
+		explicit QuadtreeProgressiveReader(bool withImage = true, int maxResolution = 1 << 14);
+
+		/**
+		 * Decodes as much of the stream as the bytes received so far
+		 * allow. Bytes after the end of the stream are ignored.
+		 * @param data The next bytes of the stream.
+		 * @param size The number of bytes.
+		 * @return False once the stream has turned out to be malformed.
+		 */
+		bool feed(char const * data, size_t size);
+
+		/**
+		 * @return Whether the whole stream has been decoded.
+		 */
+		bool complete() const;
+
+		/**
+		 * @return Whether the stream is malformed; nothing more is
+		 *  decoded after that.
+		 */
+		bool failed() const;
+
+		/**
+		 * @return The number of levels received in full: 0 before the
+		 *  root arrives, 1 with the root alone, and so on.
+		 */
+		int levels() const;
+
+		/**
+		 * @return The resolution from the header, or 0 before it arrives
+		 *  (and for an empty tree).
+		 */
+		int getResolution() const;
+
+		/**
+		 * @return The image decoded so far: resolution x resolution from
+		 *  the header on, uniform until the root arrives, then refined
+		 *  family by family. A reader created without the image returns
+		 *  the default PNG.
+		 */
+		PNG const & image() const;
+
+		/**
+		 * Builds the tree decoded so far. Leaves keep the colors the
+		 * stream sent, so the result is the sender's tree cut at the
+		 * nodes not yet refined; internal nodes are recolored with the
+		 * averages of their children, as read() does.
+		 * @return The tree, empty before the root arrives.
+		 */
+		Quadtree tree() const;
+
+	private:
+		/**
+		 * A decoded node; its children, once they arrive, are four
+		 * consecutive records.
+		 */
+		struct Record
+		{
+			RGBAPixel color;
+			int children; /**< index of the northwest child, or -1 for a leaf so far */
+		};
+
+		/**
+		 * A split node whose children have not arrived yet.
+		 */
+		struct Pending
+		{
+			int record;
+			int x;
+			int y;
+			int resolution;
+		};
+
+		std::string _buffer;           /**< bytes received but not decoded yet */
+		bool _withImage;               /**< whether _image is allocated and painted */
+		int _maxResolution;            /**< largest resolution a header may give */
+		bool _header;                  /**< whether the header has been decoded */
+		bool _failed;
+		int _resolution;
+		std::vector<Record> _records;  /**< the nodes in breadth-first order */
+		std::deque<Pending> _pending;  /**< split nodes waiting for their children, in stream order */
+		int _levels;
+		size_t _levelRemaining;        /**< families still to come in the level being received */
+		size_t _nextLevel;             /**< families announced so far for the level after it */
+		PNG _image;
+
+		bool decode(unsigned char const * data, size_t size, size_t & used);
+		void paint(RGBAPixel const & color, int x, int y, int resolution);
+		Quadtree::QuadtreeNode * build(int record) const;
+
+		// Quadtree::read takes the raw nodes and recolors them once, for its own modes
+		friend class Quadtree;
+};
+
+#endif // QUADTREE_PROGRESSIVE_H
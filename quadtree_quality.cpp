@@ -0,0 +1,203 @@
+/**
+ * @file quadtree_quality.cpp
+ * Implementation of the QuadtreeQuality metrics and of the Quadtree
+ * functions that compute them.
+ *
+ * The tree is compared with the source one leaf at a time: every pixel of
+ * a leaf's square is reconstructed as the leaf's color, so no decompressed
+ * image is ever built. SSIM uses windows aligned with the tree, so a
+ * window is either inside one leaf (its reconstruction is flat) or is a
+ * node whose few leaves are painted into a small buffer.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+
+#include "quadtree.h"
+
+using namespace std;
+
+//SSIM window size and stabilizing constants for 8-bit luma
+int const ssimWindow = 8;
+double const ssimC1 = (0.01 * 255) * (0.01 * 255);
+double const ssimC2 = (0.03 * 255) * (0.03 * 255);
+
+//running totals for one measurement
+struct Quadtree::QualitySums{
+	double squaredError;
+	int maxError;
+	double ssim;
+	long windows;
+};
+
+QuadtreeQuality::QuadtreeQuality() : pixels(0), mse(0), psnr(0), maxError(0), ssim(0)
+{
+	/* nothing */
+}
+
+ostream & operator<<(ostream & out, QuadtreeQuality const & quality)
+{
+	// keep the caller's number formatting intact
+	ios::fmtflags flags = out.flags();
+	streamsize precision = out.precision();
+	out << fixed << setprecision(4);
+
+	out << "mse " << quality.mse << ", psnr " << quality.psnr << " dB, max error "
+		<< quality.maxError << ", ssim " << quality.ssim << " (" << quality.pixels << " pixels)";
+
+	out.flags(flags);
+	out.precision(precision);
+	return out;
+}
+
+static double luma(RGBAPixel const & pixel)
+{
+	return 0.299 * pixel.red + 0.587 * pixel.green + 0.114 * pixel.blue;
+}
+
+
+
+
+/*
+*Compares the image the Quadtree represents with source, the image it was built from (the tree covers *the upper left resolution by resolution square of source).
+*Returns empty metrics if the tree is empty or source is smaller than the tree. SSIM is only computed *when withSsim is true, since it costs a second pass over the image.
+*/
+QuadtreeQuality Quadtree::quality(PNG const & source, bool withSsim) const{
+	return pruneQuality(source, -1, withSsim);
+}
+
+/*
+*Compares source with the image the Quadtree would represent after prune(tolerance), without pruning *it: nodes prune would collapse are measured as leaves of their own color. A negative tolerance *measures the tree as it is.
+*/
+QuadtreeQuality Quadtree::pruneQuality(PNG const & source, int tolerance, bool withSsim) const{
+	QuadtreeQuality result;
+	if(root == NULL || source.width() < (size_t) rootResolution || source.height() < (size_t) rootResolution){
+		return result;
+	}
+
+	QualitySums sums = {0, 0, 0, 0};
+	measure(source, root, 0, 0, rootResolution, tolerance, sums);
+
+	result.pixels = (long) rootResolution * rootResolution;
+	result.mse = sums.squaredError / (3.0 * result.pixels);
+	result.psnr = (sums.squaredError == 0) ? numeric_limits<double>::infinity() : 10 * log10(255.0 * 255.0 / result.mse);
+	result.maxError = sums.maxError;
+
+	if(withSsim){
+		measureSsim(source, root, 0, 0, rootResolution, tolerance, sums);
+		result.ssim = sums.ssim / sums.windows;
+	}
+
+	return result;
+}
+
+//quality helper function, whether root is a leaf once the tree is pruned with tolerance
+bool Quadtree::measuredAsLeaf(QuadtreeNode * root, int tolerance) const{
+	return root->nwChild == NULL || (tolerance >= 0 && checkTolerance(root, root, tolerance));
+}
+
+//quality helper function, adds the error of every pixel of root's square
+void Quadtree::measure(PNG const & source, QuadtreeNode * root, int x, int y, int resolution, int tolerance, QualitySums & sums) const{
+	//base case, every pixel of the square is reconstructed as the leaf's color
+	if(measuredAsLeaf(root, tolerance)){
+		RGBAPixel const & color = root->element;
+		for(int j = y; j < y + resolution; j++){
+			for(int i = x; i < x + resolution; i++){
+				RGBAPixel const * pixel = source(i, j);
+				int red = abs(pixel->red - color.red);
+				int green = abs(pixel->green - color.green);
+				int blue = abs(pixel->blue - color.blue);
+				sums.squaredError += red * red + green * green + blue * blue;
+				sums.maxError = max(sums.maxError, max(red, max(green, blue)));
+			}
+		}
+		return;
+	}
+
+	//recursive call to each child with its upper left corner
+	int half = resolution/2;
+	measure(source, root->nwChild, x, y, half, tolerance, sums);
+	measure(source, root->neChild, x + half, y, half, tolerance, sums);
+	measure(source, root->swChild, x, y + half, half, tolerance, sums);
+	measure(source, root->seChild, x + half, y + half, half, tolerance, sums);
+}
+
+//quality helper function, adds the SSIM of every window in root's square
+void Quadtree::measureSsim(PNG const & source, QuadtreeNode * root, int x, int y, int resolution, int tolerance, QualitySums & sums) const{
+	int window = min(ssimWindow, rootResolution);
+	double reconstructed[ssimWindow * ssimWindow];
+
+	//a leaf at least as large as a window reconstructs every window inside it as flat
+	if(measuredAsLeaf(root, tolerance)){
+		fill(reconstructed, reconstructed + window * window, luma(root->element));
+		for(int j = y; j < y + resolution; j += window){
+			for(int i = x; i < x + resolution; i += window){
+				sums.ssim += ssim(source, i, j, window, reconstructed);
+				sums.windows++;
+			}
+		}
+		return;
+	}
+
+	//a node the size of a window has its leaves painted into the window
+	if(resolution == window){
+		paintLuma(root, 0, 0, resolution, tolerance, reconstructed, window);
+		sums.ssim += ssim(source, x, y, window, reconstructed);
+		sums.windows++;
+		return;
+	}
+
+	//recursive call to each child with its upper left corner
+	int half = resolution/2;
+	measureSsim(source, root->nwChild, x, y, half, tolerance, sums);
+	measureSsim(source, root->neChild, x + half, y, half, tolerance, sums);
+	measureSsim(source, root->swChild, x, y + half, half, tolerance, sums);
+	measureSsim(source, root->seChild, x + half, y + half, half, tolerance, sums);
+}
+
+//quality helper function, writes the luma of root's square (x and y relative to the window) into a window-wide buffer
+void Quadtree::paintLuma(QuadtreeNode * root, int x, int y, int resolution, int tolerance, double * buffer, int stride) const{
+	//base case, the leaf's square is flat
+	if(measuredAsLeaf(root, tolerance)){
+		double value = luma(root->element);
+		for(int j = y; j < y + resolution; j++){
+			fill(buffer + j * stride + x, buffer + j * stride + x + resolution, value);
+		}
+		return;
+	}
+
+	//recursive call to each child with its upper left corner
+	int half = resolution/2;
+	paintLuma(root->nwChild, x, y, half, tolerance, buffer, stride);
+	paintLuma(root->neChild, x + half, y, half, tolerance, buffer, stride);
+	paintLuma(root->swChild, x, y + half, half, tolerance, buffer, stride);
+	paintLuma(root->seChild, x + half, y + half, half, tolerance, buffer, stride);
+}
+
+//quality helper function, SSIM between the window of source at x, y and its reconstruction
+double Quadtree::ssim(PNG const & source, int x, int y, int window, double const * reconstructed) const{
+	double sourceSum = 0, sourceSquares = 0, treeSum = 0, treeSquares = 0, products = 0;
+	for(int j = 0; j < window; j++){
+		for(int i = 0; i < window; i++){
+			double a = luma(*source(x + i, y + j));
+			double b = reconstructed[j * window + i];
+			sourceSum += a;
+			sourceSquares += a * a;
+			treeSum += b;
+			treeSquares += b * b;
+			products += a * b;
+		}
+	}
+
+	double count = window * window;
+	double sourceMean = sourceSum / count;
+	double treeMean = treeSum / count;
+	double sourceVariance = sourceSquares / count - sourceMean * sourceMean;
+	double treeVariance = treeSquares / count - treeMean * treeMean;
+	double covariance = products / count - sourceMean * treeMean;
+
+	return ((2 * sourceMean * treeMean + ssimC1) * (2 * covariance + ssimC2))
+		/ ((sourceMean * sourceMean + treeMean * treeMean + ssimC1) * (sourceVariance + treeVariance + ssimC2));
+}
@@ -0,0 +1,39 @@
+/**
+ * @file quadtree_quality.h
+ * Definition of the QuadtreeQuality metrics that compare a Quadtree with
+ * the image it was built from.
+ */
+
+#ifndef QUADTREE_QUALITY_H
+#define QUADTREE_QUALITY_H
+
+#include <ostream>
+
+/**
+ * Distortion of a Quadtree against its source image, as returned by
+ * Quadtree::quality() and Quadtree::pruneQuality(). Errors are measured
+ * over the red, green and blue channels; alpha is ignored.
+ */
+struct QuadtreeQuality
+{
+	long pixels;   /**< Pixels compared (0 if nothing could be compared). */
+	double mse;    /**< Mean squared error per channel. */
+	double psnr;   /**< Peak signal-to-noise ratio in dB (infinite for an exact match). */
+	int maxError;  /**< Largest absolute difference in any channel of any pixel. */
+	double ssim;   /**< Mean SSIM of the luma over 8x8 windows, or 0 if it was not requested. */
+
+	/**
+	 * Creates an empty set of metrics.
+	 */
+	QuadtreeQuality();
+};
+
+/**
+ * Stream operator that writes the metrics on one line.
+ *
+ * @param out Stream to write to.
+ * @param quality Metrics to write.
+ */
+std::ostream & operator<<(std::ostream & out, QuadtreeQuality const & quality);
+
+#endif // QUADTREE_QUALITY_H
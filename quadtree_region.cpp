@@ -0,0 +1,126 @@
+/**
+ * @file quadtree_region.cpp
+ * Implementation of the QuadtreeRegionStats and of the Quadtree rectangle
+ * queries that compute them.
+ *
+ * A node entirely inside the rectangle contributes the totals it already
+ * stores (its sums in exact mode, otherwise its color times its area), so
+ * the walk only descends into the nodes the rectangle's edges cut: the
+ * cost follows the perimeter of the rectangle rather than its area. A leaf
+ * the edges cut counts as a square of its own color.
+ */
+
+#include <algorithm>
+#include <iomanip>
+
+#include "quadtree.h"
+
+using namespace std;
+
+QuadtreeRegionStats::QuadtreeRegionStats() : pixels(0), mean{0, 0, 0, 0}, exact(false), minimum(0, 0, 0, 0),
+	maximum(0, 0, 0, 0), variance(0)
+{
+	/* nothing */
+}
+
+ostream & operator<<(ostream & out, QuadtreeRegionStats const & stats)
+{
+	// keep the caller's number formatting intact
+	ios::fmtflags flags = out.flags();
+	streamsize precision = out.precision();
+	out << fixed << setprecision(2);
+
+	out << "mean (" << stats.mean[0] << ", " << stats.mean[1] << ", " << stats.mean[2] << ", " << stats.mean[3] << ")";
+	if(stats.exact)
+	{
+		out << ", min " << stats.minimum << ", max " << stats.maximum << ", variance " << stats.variance;
+	}
+	out << " (" << stats.pixels << " pixels)";
+
+	out.flags(flags);
+	out.precision(precision);
+	return out;
+}
+
+
+
+
+/*
+*Returns the truncated mean color of the pixels inside the width by height rectangle whose upper left *corner is at x, y (clipped to the tree), the color a single leaf over the rectangle would have. In *exact mode this is the mean of the source pixels; otherwise it is built from the stored averages, which *truncate at every level as the internal nodes' colors do.
+*Returns RGBAPixel() if the rectangle misses the tree or the tree is empty.
+*/
+RGBAPixel Quadtree::regionAverage(int x, int y, int width, int height) const{
+	if(root == NULL){
+		return RGBAPixel();
+	}
+
+	NodeSums totals = emptySums();
+	regionSums(root, 0, 0, rootResolution, x, y, x + width, y + height, totals);
+	if(totals.count == 0){
+		return RGBAPixel();
+	}
+
+	return meanColor(totals);
+}
+
+/*
+*Returns the statistics of the pixels inside the width by height rectangle whose upper left corner is at *x, y (clipped to the tree): their unrounded mean, and in exact mode their per-channel bounds and their *variance. Returns empty statistics if the rectangle misses the tree or the tree is empty.
+*/
+QuadtreeRegionStats Quadtree::regionStats(int x, int y, int width, int height) const{
+	QuadtreeRegionStats result;
+	if(root == NULL){
+		return result;
+	}
+
+	NodeSums totals = emptySums();
+	regionSums(root, 0, 0, rootResolution, x, y, x + width, y + height, totals);
+	if(totals.count == 0){
+		return result;
+	}
+
+	//premultiplied sums divide by the total alpha instead of the pixel count, as meanColor does
+	uint64_t weight = premultiplied ? totals.sum[3] : totals.count;
+	result.pixels = totals.count;
+	for(int c = 0; c < 3; c++){
+		result.mean[c] = (weight > 0) ? (double) totals.sum[c] / weight : 0;
+	}
+	result.mean[3] = (double) totals.sum[3] / totals.count;
+
+	if(exactSums){
+		result.exact = true;
+		result.minimum = RGBAPixel(totals.low[0], totals.low[1], totals.low[2], totals.low[3]);
+		result.maximum = RGBAPixel(totals.high[0], totals.high[1], totals.high[2], totals.high[3]);
+		result.variance = variance(totals);
+	}
+
+	return result;
+}
+
+//rectangle query helper function, adds the pixels of root's square that lie inside the rectangle
+void Quadtree::regionSums(QuadtreeNode * root, int x, int y, int resolution, int left, int top, int right, int bottom, NodeSums & totals) const{
+	int overlapLeft = max(x, left);
+	int overlapTop = max(y, top);
+	int overlapRight = min(x + resolution, right);
+	int overlapBottom = min(y + resolution, bottom);
+	if(overlapLeft >= overlapRight || overlapTop >= overlapBottom){
+		return;
+	}
+
+	bool covered = overlapLeft == x && overlapTop == y && overlapRight == x + resolution && overlapBottom == y + resolution;
+	if(covered && root->sums != NULL){
+		addSums(totals, *root->sums);
+		return;
+	}
+
+	if(covered || root->nwChild == NULL){
+		uint64_t area = (uint64_t) (overlapRight - overlapLeft) * (overlapBottom - overlapTop);
+		addSums(totals, flatTotals(root->element, area));
+		return;
+	}
+
+	int half = resolution/2;
+	regionSums(root->nwChild, x, y, half, left, top, right, bottom, totals);
+	regionSums(root->neChild, x + half, y, half, left, top, right, bottom, totals);
+	regionSums(root->swChild, x, y + half, half, left, top, right, bottom, totals);
+	regionSums(root->seChild, x + half, y + half, half, left, top, right, bottom, totals);
+}
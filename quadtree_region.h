@@ -0,0 +1,43 @@
+/**
+ * @file quadtree_region.h
+ * Definition of the QuadtreeRegionStats a Quadtree reports for a
+ * rectangle of its image.
+ */
+
+#ifndef QUADTREE_REGION_H
+#define QUADTREE_REGION_H
+
+#include <ostream>
+
+#include "rgbapixel.h"
+
+/**
+ * Statistics of the pixels inside a rectangle, as returned by
+ * Quadtree::regionStats(). The mean is always filled in; the bounds and
+ * the variance need the sums of exact mode and are only filled in when
+ * exact is set.
+ */
+struct QuadtreeRegionStats
+{
+	long pixels;       /**< Pixels inside both the rectangle and the tree (0 if none). */
+	double mean[4];    /**< Mean red, green, blue and alpha; colors are weighted by alpha in premultiplied mode. */
+	bool exact;        /**< Whether minimum, maximum and variance were filled in. */
+	RGBAPixel minimum; /**< Smallest value of each channel. */
+	RGBAPixel maximum; /**< Largest value of each channel. */
+	double variance;   /**< Mean squared distance from the mean, summed over the channels as pruneByVariance measures it. */
+
+	/**
+	 * Creates the statistics of an empty region.
+	 */
+	QuadtreeRegionStats();
+};
+
+/**
+ * Stream operator that writes the statistics on one line.
+ *
+ * @param out Stream to write to.
+ * @param stats Statistics to write.
+ */
+std::ostream & operator<<(std::ostream & out, QuadtreeRegionStats const & stats);
+
+#endif // QUADTREE_REGION_H
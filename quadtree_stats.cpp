@@ -0,0 +1,73 @@
+/**
+ * @file quadtree_stats.cpp
+ * Implementation of the QuadtreeStats counters.
+ */
+
+#include <iomanip>
+
+#include "quadtree_stats.h"
+
+QuadtreeStats::QuadtreeStats()
+{
+	reset();
+}
+
+void QuadtreeStats::reset()
+{
+	getPixelCalls = 0;
+	getPixelNodesVisited = 0;
+	checkToleranceCalls = 0;
+	checkToleranceMaxDepth = 0;
+	pruneSizeCalls = 0;
+	idealPruneCalls = 0;
+	lastIdealPrunePruneSizeCalls = 0;
+	maxIdealPrunePruneSizeCalls = 0;
+	nodesAllocated = 0;
+	nodesFreed = 0;
+	nodesCopied = 0;
+
+	buildSeconds = 0;
+	updateSeconds = 0;
+	pruneSeconds = 0;
+	pruneSizeSeconds = 0;
+	idealPruneSeconds = 0;
+	decompressSeconds = 0;
+	rotateSeconds = 0;
+	copySeconds = 0;
+}
+
+double QuadtreeStats::nodesPerGetPixel() const
+{
+	return getPixelCalls == 0 ? 0.0 : (double) getPixelNodesVisited / getPixelCalls;
+}
+
+std::ostream & operator<<(std::ostream & out, QuadtreeStats const & stats)
+{
+	// keep the caller's number formatting intact
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+	out.unsetf(std::ios::floatfield);
+	out << std::setprecision(4);
+
+	out << "getPixel:       " << stats.getPixelCalls << " calls, "
+		<< stats.nodesPerGetPixel() << " nodes/call\n"
+		<< "checkTolerance: " << stats.checkToleranceCalls << " calls, max depth "
+		<< stats.checkToleranceMaxDepth << "\n"
+		<< "pruneSize:      " << stats.pruneSizeCalls << " calls\n"
+		<< "idealPrune:     " << stats.idealPruneCalls << " calls, pruneSize calls last "
+		<< stats.lastIdealPrunePruneSizeCalls << " / max " << stats.maxIdealPrunePruneSizeCalls << "\n"
+		<< "nodes:          " << stats.nodesAllocated << " allocated, "
+		<< stats.nodesFreed << " freed, " << stats.nodesCopied << " copied on write\n"
+		<< "seconds:        build " << stats.buildSeconds
+		<< ", update " << stats.updateSeconds
+		<< ", prune " << stats.pruneSeconds
+		<< ", pruneSize " << stats.pruneSizeSeconds
+		<< ", idealPrune " << stats.idealPruneSeconds
+		<< ", decompress " << stats.decompressSeconds
+		<< ", rotate " << stats.rotateSeconds
+		<< ", copy " << stats.copySeconds << "\n";
+
+	out.flags(flags);
+	out.precision(precision);
+	return out;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file quadtree_stats.h
+ * Definition of the QuadtreeStats counters and the macros that update
+ * them. Instrumentation is compiled in only when QUADTREE_STATS is
+ * defined (the QUADTREE_STATS CMake option); otherwise every macro below
+ * expands to nothing and Quadtree carries no counters at all.
+ */
+
+#ifndef QUADTREE_STATS_H
+#define QUADTREE_STATS_H
+
+#include <chrono>
+#include <ostream>
+
+/**
+ * Counters describing the work done by one Quadtree. All times are
+ * inclusive wall-clock seconds, so phases that call each other (for
+ * instance idealPrune and pruneSize) overlap.
+ */
+struct QuadtreeStats
+{
+	long getPixelCalls;           /**< Public getPixel calls. */
+	long getPixelNodesVisited;    /**< Nodes visited by those calls. */
+	long checkToleranceCalls;     /**< checkTolerance invocations, recursive ones included. */
+	int checkToleranceMaxDepth;   /**< Deepest level below the tested node that checkTolerance reached. */
+	long pruneSizeCalls;          /**< Public pruneSize calls, including those made by idealPrune. */
+	long idealPruneCalls;         /**< Public idealPrune calls. */
+	long lastIdealPrunePruneSizeCalls; /**< pruneSize calls made by the most recent idealPrune. */
+	long maxIdealPrunePruneSizeCalls;  /**< Largest pruneSize call count of any single idealPrune. */
+	long nodesAllocated;          /**< QuadtreeNodes created by this tree. */
+	long nodesFreed;              /**< QuadtreeNodes deleted by this tree. */
+	long nodesCopied;             /**< Shared QuadtreeNodes copied because this tree changed them (included in nodesAllocated). */
+
+	double buildSeconds;          /**< Time spent in buildTree. */
+	double updateSeconds;         /**< Time spent in updateRegion. */
+	double pruneSeconds;          /**< Time spent in prune. */
+	double pruneSizeSeconds;      /**< Time spent in pruneSize. */
+	double idealPruneSeconds;     /**< Time spent in idealPrune. */
+	double decompressSeconds;     /**< Time spent in decompress. */
+	double rotateSeconds;         /**< Time spent in rotations and flips. */
+	double copySeconds;           /**< Time spent copying another tree into this one. */
+
+	/**
+	 * Creates a set of zeroed counters.
+	 */
+	QuadtreeStats();
+
+	/**
+	 * Sets every counter back to zero.
+	 */
+	void reset();
+
+	/**
+	 * @return The mean number of nodes visited per getPixel call.
+	 */
+	double nodesPerGetPixel() const;
+};
+
+/**
+ * Stream operator that writes a human-readable report of the counters.
+ *
+ * @param out Stream to write to.
+ * @param stats Counters to write.
+ */
+std::ostream & operator<<(std::ostream & out, QuadtreeStats const & stats);
+
+#ifdef QUADTREE_STATS
+
+/**
+ * Adds the lifetime of a scope to one of the time counters.
+ */
+class QuadtreePhaseTimer
+{
+	public:
+		QuadtreePhaseTimer(double & seconds)
+			: _seconds(seconds), _start(std::chrono::steady_clock::now())
+		{
+			/* nothing */
+		}
+
+		~QuadtreePhaseTimer()
+		{
+			_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+		}
+
+	private:
+		double & _seconds;
+		std::chrono::steady_clock::time_point _start;
+};
+
+#define QT_STAT(statement) do { statement; } while (0)
+#define QT_TIME_PHASE(counter) QuadtreePhaseTimer qt_phase_timer_(counter)
+
+#else
+
+#define QT_STAT(statement) do { } while (0)
+#define QT_TIME_PHASE(counter) do { } while (0)
+
+#endif // QUADTREE_STATS
+
+#endif // QUADTREE_STATS_H
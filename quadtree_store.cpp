@@ -0,0 +1,174 @@
+/**
+ * @file quadtree_store.cpp
+ * Implementation of the QuadtreeStore class.
+ */
+
+#include "quadtree_store.h"
+
+using namespace std;
+
+QuadtreeStore::QuadtreeStore()
+{
+	/* nothing */
+}
+
+QuadtreeStore::~QuadtreeStore()
+{
+	clear();
+}
+
+void QuadtreeStore::intern(Quadtree & tree)
+{
+	if(tree.root == NULL)
+		return;
+
+	Node * stored = intern(tree, tree.root, true);
+	if(stored != tree.root)
+	{
+		Quadtree::share(stored);
+		tree.clear(tree.root);
+		tree.root = stored;
+	}
+}
+
+size_t QuadtreeStore::size() const
+{
+	return _nodes.size();
+}
+
+void QuadtreeStore::purge()
+{
+	// dropping a node releases its children, which may leave them unused
+	// in turn, so sweep until nothing more goes
+	bool dropped = true;
+	while(dropped)
+	{
+		dropped = false;
+		for(auto it = _nodes.begin(); it != _nodes.end();)
+		{
+			if(it->second->refs == 1)
+			{
+				Node * node = it->second;
+				it = _nodes.erase(it);
+				_owner.clear(node);
+				dropped = true;
+			}
+			else
+				it++;
+		}
+	}
+}
+
+void QuadtreeStore::clear()
+{
+	for(auto & entry : _nodes)
+		_owner.clear(entry.second);
+	_nodes.clear();
+}
+
+// deduplicates the subtree below node bottom up and returns the stored node
+// equal to it, which the caller puts in place of node; owned tells whether
+// the path down to node belongs to tree alone, so that node may be changed
+Quadtree::QuadtreeNode * QuadtreeStore::intern(Quadtree & tree, Node * node, bool owned)
+{
+	// a stored node's subtree was deduplicated when it was stored
+	if(contains(node))
+		return node;
+
+	owned = owned && node->refs == 1;
+
+	Node * children[4] = {node->nwChild, node->neChild, node->swChild, node->seChild};
+	if(node->nwChild != NULL)
+	{
+		for(int i = 0; i < 4; i++)
+			children[i] = intern(tree, children[i], owned);
+	}
+
+	Node * stored = find(node, children);
+	if(stored != NULL)
+		return stored;
+
+	// nothing equal is stored yet, so node becomes the stored copy once it
+	// points at the stored children; other trees never see it change
+	Node ** slots[4] = {&node->nwChild, &node->neChild, &node->swChild, &node->seChild};
+	bool changed = false;
+	for(int i = 0; i < 4; i++)
+		changed = changed || *slots[i] != children[i];
+
+	if(changed && !owned)
+	{
+		Node * copy = new Node(node->element);
+		QT_STAT(tree.counters.nodesAllocated++; tree.counters.nodesCopied++);
+		Quadtree::copySums(copy, node);
+		copy->hash = node->hash;
+		copy->nwChild = Quadtree::share(children[0]);
+		copy->neChild = Quadtree::share(children[1]);
+		copy->swChild = Quadtree::share(children[2]);
+		copy->seChild = Quadtree::share(children[3]);
+
+		// the copy's only reference so far is the store's
+		_nodes.insert(make_pair(copy->hash, copy));
+		return copy;
+	}
+
+	for(int i = 0; i < 4; i++)
+	{
+		if(*slots[i] != children[i])
+		{
+			Quadtree::share(children[i]);
+			tree.clear(*slots[i]);
+			*slots[i] = children[i];
+		}
+	}
+
+	_nodes.insert(make_pair(node->hash, Quadtree::share(node)));
+	return node;
+}
+
+// the stored node with node's color and sums and the given children, or
+// NULL if there is none
+Quadtree::QuadtreeNode * QuadtreeStore::find(Node const * node, Node * const children[4]) const
+{
+	auto range = _nodes.equal_range(node->hash);
+	for(auto it = range.first; it != range.second; it++)
+	{
+		Node const * stored = it->second;
+		if(!(stored->element == node->element)
+			|| stored->nwChild != children[0] || stored->neChild != children[1]
+			|| stored->swChild != children[2] || stored->seChild != children[3])
+			continue;
+
+		// exact sums hold the pixel count, so they also tell squares of
+		// different sizes apart
+		if((stored->sums == NULL) != (node->sums == NULL))
+			continue;
+
+		if(stored->sums != NULL)
+		{
+			Quadtree::NodeSums const & a = *stored->sums;
+			Quadtree::NodeSums const & b = *node->sums;
+			bool same = a.count == b.count;
+			for(int c = 0; c < 4; c++)
+				same = same && a.sum[c] == b.sum[c] && a.squares[c] == b.squares[c]
+					&& a.low[c] == b.low[c] && a.high[c] == b.high[c];
+			if(!same)
+				continue;
+		}
+
+		return it->second;
+	}
+
+	return NULL;
+}
+
+bool QuadtreeStore::contains(Node const * node) const
+{
+	auto range = _nodes.equal_range(node->hash);
+	for(auto it = range.first; it != range.second; it++)
+	{
+		if(it->second == node)
+			return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file quadtree_store.h
+ * Definition of the QuadtreeStore class, which deduplicates identical
+ * subtrees within and across Quadtrees.
+ */
+
+#ifndef QUADTREE_STORE_H
+#define QUADTREE_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+#include "quadtree.h"
+
+/**
+ * Turns the Quadtrees given to it into one DAG: every subtree equal to
+ * one already seen, in the same tree or in another, is replaced by a
+ * reference to the node seen first. Repetitive content (screenshots, UI
+ * captures, runs of similar frames) then takes one node per distinct
+ * subtree, and comparing or diffing two stored trees stops at the first
+ * shared node. Nodes are found by their content hash and confirmed by
+ * comparing colors, sums and (already deduplicated) children.
+ *
+ * Stored nodes are shared through the trees' copy-on-write references, so
+ * a stored tree can still be edited: the nodes it changes are copied and
+ * the store keeps the originals. Edits are not deduplicated until the tree
+ * is stored again. A store must not be used from several threads at once,
+ * nor while another thread edits a tree it has stored.
+ */
+class QuadtreeStore
+{
+	public:
+		/**
+		 * Creates an empty store.
+		 */
+		QuadtreeStore();
+
+		/**
+		 * Drops the store's references; trees it deduplicated keep their
+		 * nodes.
+		 */
+		~QuadtreeStore();
+
+		QuadtreeStore(QuadtreeStore const & other) = delete;
+		QuadtreeStore & operator=(QuadtreeStore const & other) = delete;
+
+		/**
+		 * Deduplicates tree against itself and every tree stored before
+		 * it, adding its new subtrees to the store. The image tree holds
+		 * does not change.
+		 * @param tree The tree to store.
+		 */
+		void intern(Quadtree & tree);
+
+		/**
+		 * @return The number of distinct nodes held by the store.
+		 */
+		size_t size() const;
+
+		/**
+		 * Drops the nodes that no tree uses any more.
+		 */
+		void purge();
+
+		/**
+		 * Drops every stored node. Trees stored before keep their nodes
+		 * but are no longer deduplicated against later ones.
+		 */
+		void clear();
+
+	private:
+		typedef Quadtree::QuadtreeNode Node;
+
+		Quadtree _owner; /**< empty tree whose helpers take and drop the store's references */
+		std::unordered_multimap<uint64_t, Node *> _nodes; /**< stored nodes by hash, one reference each */
+
+		Node * intern(Quadtree & tree, Node * node, bool owned);
+		Node * find(Node const * node, Node * const children[4]) const;
+		bool contains(Node const * node) const;
+};
+
+#endif // QUADTREE_STORE_H
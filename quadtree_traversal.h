@@ -0,0 +1,344 @@
+/**
+ * @file quadtree_traversal.h
+ * Definition of the QuadtreeLeaves range, its QuadtreeLeafIterator, and
+ * the QuadtreeTraversal visitors: non-recursive walks over the nodes of a
+ * Quadtree for code outside the library.
+ */
+
+#ifndef QUADTREE_TRAVERSAL_H
+#define QUADTREE_TRAVERSAL_H
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#include "quadtree.h"
+
+/**
+ * One node of a Quadtree as a traversal reports it: the square it covers
+ * and the color the tree stores for it (for an internal node, the average
+ * of its children).
+ */
+struct QuadtreeBlock
+{
+	int x;             /**< Left edge of the node's square. */
+	int y;             /**< Top edge of the node's square. */
+	int resolution;    /**< Width and height of the node's square. */
+	RGBAPixel element; /**< Color of the node. */
+	int depth;         /**< Distance from the root, which is at depth 0. */
+	bool leaf;         /**< Whether the node has no children. */
+};
+
+/**
+ * Forward iterator over the leaves of a Quadtree, northwest, northeast,
+ * southwest, then southeast at every level (the order of
+ * Quadtree::printTree() and of the serialized formats). The nodes still to
+ * be visited are kept on an explicit stack of at most three per level, so
+ * iterating costs no recursion, and the leaves together tile the tree's
+ * square exactly.
+ *
+ * The iterator reads the tree's nodes directly: it is invalidated by any
+ * change to the tree, which may release or replace them.
+ */
+class QuadtreeLeafIterator
+{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef QuadtreeBlock value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef QuadtreeBlock const * pointer;
+		typedef QuadtreeBlock const & reference;
+
+		/**
+		 * Creates the past-the-end iterator.
+		 */
+		QuadtreeLeafIterator() : _node(NULL)
+		{
+			/* nothing */
+		}
+
+		/**
+		 * Creates an iterator at the first leaf of tree, or past the end
+		 * if the tree is empty.
+		 * @param tree The tree whose leaves are visited.
+		 */
+		explicit QuadtreeLeafIterator(Quadtree const & tree) : _node(NULL)
+		{
+			if(tree.root == NULL)
+				return;
+
+			int depth = 0;
+			while((1 << depth) < tree.rootResolution)
+				depth++;
+			_stack.reserve(3 * depth + 1);
+
+			Frame root = {tree.root, 0, 0, tree.rootResolution, 0};
+			_stack.push_back(root);
+			advance();
+		}
+
+		reference operator*() const
+		{
+			return _block;
+		}
+
+		pointer operator->() const
+		{
+			return &_block;
+		}
+
+		QuadtreeLeafIterator & operator++()
+		{
+			advance();
+			return *this;
+		}
+
+		QuadtreeLeafIterator operator++(int)
+		{
+			QuadtreeLeafIterator previous(*this);
+			advance();
+			return previous;
+		}
+
+		/**
+		 * Iterators are equal at the same leaf of the same walk, or when
+		 * both are past the end. Shared subtrees may put one node at
+		 * several places, so the position is compared as well.
+		 */
+		bool operator==(QuadtreeLeafIterator const & other) const
+		{
+			if(_node == NULL || other._node == NULL)
+				return _node == other._node;
+
+			return _node == other._node && _block.x == other._block.x && _block.y == other._block.y;
+		}
+
+		bool operator!=(QuadtreeLeafIterator const & other) const
+		{
+			return !(*this == other);
+		}
+
+	private:
+		/**
+		 * A node waiting to be visited, with the square it covers.
+		 */
+		struct Frame
+		{
+			Quadtree::QuadtreeNode const * node;
+			int x;
+			int y;
+			int resolution;
+			int depth;
+		};
+
+		Quadtree::QuadtreeNode const * _node; /**< current leaf, NULL past the end */
+		QuadtreeBlock _block;
+		std::vector<Frame> _stack;            /**< nodes still to visit, the next one on top */
+
+		// moves to the next leaf: from the node on top of the stack, goes
+		// down northwest children, leaving their siblings on the stack last
+		// one first so that they come out in order
+		void advance()
+		{
+			if(_stack.empty())
+			{
+				_node = NULL;
+				return;
+			}
+
+			Frame frame = _stack.back();
+			_stack.pop_back();
+
+			Quadtree::QuadtreeNode const * node = frame.node;
+			while(node->nwChild != NULL)
+			{
+				int half = frame.resolution / 2;
+				frame.depth++;
+				Frame se = {node->seChild, frame.x + half, frame.y + half, half, frame.depth};
+				Frame sw = {node->swChild, frame.x, frame.y + half, half, frame.depth};
+				Frame ne = {node->neChild, frame.x + half, frame.y, half, frame.depth};
+				_stack.push_back(se);
+				_stack.push_back(sw);
+				_stack.push_back(ne);
+
+				node = node->nwChild;
+				frame.node = node;
+				frame.resolution = half;
+			}
+
+			_node = node;
+			QuadtreeBlock block = {frame.x, frame.y, frame.resolution, node->element, frame.depth, true};
+			_block = block;
+		}
+};
+
+/**
+ * The leaves of a Quadtree as a range, for range-based for loops:
+ *
+ *   for(QuadtreeBlock const & leaf : QuadtreeLeaves(tree))
+ *       fill(leaf.x, leaf.y, leaf.resolution, leaf.element);
+ *
+ * The range holds a reference to the tree, which must outlive it and stay
+ * unchanged while it is iterated.
+ */
+class QuadtreeLeaves
+{
+	public:
+		typedef QuadtreeLeafIterator iterator;
+		typedef QuadtreeLeafIterator const_iterator;
+
+		/**
+		 * Creates the range of tree's leaves.
+		 * @param tree The tree whose leaves are visited.
+		 */
+		explicit QuadtreeLeaves(Quadtree const & tree) : _tree(tree)
+		{
+			/* nothing */
+		}
+
+		/** @return An iterator at the first leaf. */
+		iterator begin() const
+		{
+			return iterator(_tree);
+		}
+
+		/** @return The past-the-end iterator. */
+		iterator end() const
+		{
+			return iterator();
+		}
+
+	private:
+		Quadtree const & _tree;
+};
+
+/**
+ * Depth-first walks over every node of a Quadtree, calling a visitor with
+ * each node's QuadtreeBlock. The visitor is a template parameter, so a
+ * lambda or function object is called directly and inlines into the walk;
+ * the walk keeps its own stack instead of recursing.
+ *
+ * Children are visited northwest, northeast, southwest, then southeast.
+ * The walks read the tree's nodes directly, so the visitor must not
+ * change the tree.
+ */
+class QuadtreeTraversal
+{
+	public:
+		/**
+		 * Visits every node before its children. If the visitor returns
+		 * bool, returning false skips the node's children, which prunes
+		 * the walk (for instance to the nodes over a rectangle, or to a
+		 * maximum depth).
+		 * @param tree The tree to walk.
+		 * @param visitor Called as visitor(QuadtreeBlock const &).
+		 */
+		template <class Visitor>
+		static void preorder(Quadtree const & tree, Visitor && visitor)
+		{
+			std::vector<Frame> stack;
+			start(tree, stack);
+			while(!stack.empty())
+			{
+				Frame frame = stack.back();
+				stack.pop_back();
+
+				QuadtreeBlock block = blockOf(frame);
+				if constexpr(std::is_convertible<decltype(visitor(block)), bool>::value)
+				{
+					if(!visitor(block))
+						continue;
+				}
+				else
+				{
+					visitor(block);
+				}
+
+				if(!block.leaf)
+					pushChildren(frame, stack);
+			}
+		}
+
+		/**
+		 * Visits every node after its children, so a node's visit can
+		 * use whatever the visitor gathered from its subtree.
+		 * @param tree The tree to walk.
+		 * @param visitor Called as visitor(QuadtreeBlock const &).
+		 */
+		template <class Visitor>
+		static void postorder(Quadtree const & tree, Visitor && visitor)
+		{
+			std::vector<Frame> stack;
+			start(tree, stack);
+			while(!stack.empty())
+			{
+				Frame & top = stack.back();
+				if(top.node->nwChild == NULL || top.expanded)
+				{
+					QuadtreeBlock block = blockOf(top);
+					stack.pop_back();
+					visitor(block);
+					continue;
+				}
+
+				// leave the node on the stack below its children, to be visited once they are done
+				top.expanded = true;
+				Frame frame = top;
+				pushChildren(frame, stack);
+			}
+		}
+
+	private:
+		/**
+		 * A node on the walk's stack, with the square it covers.
+		 */
+		struct Frame
+		{
+			Quadtree::QuadtreeNode const * node;
+			int x;
+			int y;
+			int resolution;
+			int depth;
+			bool expanded; /**< whether its children have been pushed (postorder only) */
+		};
+
+		static void start(Quadtree const & tree, std::vector<Frame> & stack)
+		{
+			if(tree.root == NULL)
+				return;
+
+			int depth = 0;
+			while((1 << depth) < tree.rootResolution)
+				depth++;
+			stack.reserve(4 * depth + 1);
+
+			Frame root = {tree.root, 0, 0, tree.rootResolution, 0, false};
+			stack.push_back(root);
+		}
+
+		static QuadtreeBlock blockOf(Frame const & frame)
+		{
+			QuadtreeBlock block = {frame.x, frame.y, frame.resolution, frame.node->element, frame.depth,
+								   frame.node->nwChild == NULL};
+			return block;
+		}
+
+		// pushes the children of frame's node, last one first so that northwest is visited next
+		static void pushChildren(Frame const & frame, std::vector<Frame> & stack)
+		{
+			Quadtree::QuadtreeNode const * node = frame.node;
+			int half = frame.resolution / 2;
+			int depth = frame.depth + 1;
+			Frame se = {node->seChild, frame.x + half, frame.y + half, half, depth, false};
+			Frame sw = {node->swChild, frame.x, frame.y + half, half, depth, false};
+			Frame ne = {node->neChild, frame.x + half, frame.y, half, depth, false};
+			Frame nw = {node->nwChild, frame.x, frame.y, half, depth, false};
+			stack.push_back(se);
+			stack.push_back(sw);
+			stack.push_back(ne);
+			stack.push_back(nw);
+		}
+};
+
+#endif // QUADTREE_TRAVERSAL_H
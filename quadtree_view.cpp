@@ -0,0 +1,173 @@
+/**
+ * @file quadtree_view.cpp
+ * Implementation of the QuadtreeView class.
+ */
+
+#include "quadtree_view.h"
+
+using namespace std;
+
+QuadtreeView::QuadtreeView() : _tolerance(0), _leafCount(0)
+{
+	/* nothing */
+}
+
+QuadtreeView::QuadtreeView(Quadtree const & tree, int tolerance)
+	: _tree(tree), _tolerance(tolerance), _leafCount(0)
+{
+	if(_tree.root != NULL)
+		_leafCount = findCut<RgbMetric>(_tree.root);
+}
+
+template <class Metric>
+QuadtreeView QuadtreeView::withTolerance(Quadtree const & tree, int tolerance)
+{
+	QuadtreeView view;
+	view._tree = tree;
+	view._tolerance = tolerance;
+	if(view._tree.root != NULL)
+		view._leafCount = view.findCut<Metric>(view._tree.root);
+	return view;
+}
+
+template <class Metric>
+QuadtreeView QuadtreeView::withLeafBudget(Quadtree const & tree, int numLeaves)
+{
+	return withTolerance<Metric>(tree, tree.idealPrune<Metric>(numLeaves));
+}
+
+int QuadtreeView::getTolerance() const
+{
+	return _tolerance;
+}
+
+int QuadtreeView::getResolution() const
+{
+	return _tree.getResolution();
+}
+
+int QuadtreeView::leafCount() const
+{
+	return _leafCount;
+}
+
+RGBAPixel QuadtreeView::getPixel(int x, int y) const
+{
+	int resolution = _tree.getResolution();
+	if(_tree.root == NULL || x < 0 || y < 0 || x >= resolution || y >= resolution)
+		return RGBAPixel();
+
+	return getPixel(x, y, _tree.root, resolution);
+}
+
+PNG QuadtreeView::decompress() const
+{
+	if(_tree.root == NULL)
+		return PNG();
+
+	int resolution = _tree.getResolution();
+	PNG image(resolution, resolution);
+	decompress(_tree.root, 0, 0, resolution, image);
+	return image;
+}
+
+vector<QuadtreeView::Leaf> QuadtreeView::leaves() const
+{
+	vector<Leaf> out;
+	out.reserve(_leafCount);
+	if(_tree.root != NULL)
+		leaves(_tree.root, 0, 0, _tree.getResolution(), out);
+	return out;
+}
+
+// walks the tree top down the way Quadtree::prune() does, stopping at the
+// first node on each path that prune would collapse; returns the number of
+// leaves below node after the prune
+template <class Metric>
+int QuadtreeView::findCut(Node * node)
+{
+	if(node->nwChild == NULL)
+		return 1;
+
+	// a collapsed node keeps its element: it already holds the average of
+	// its children, which is what prune stores in the new leaf
+	if(_tree.checkTolerance<Metric>(node, node, _tolerance))
+	{
+		_cut.insert(node);
+		return 1;
+	}
+
+	return findCut<Metric>(node->nwChild) + findCut<Metric>(node->neChild)
+		+ findCut<Metric>(node->swChild) + findCut<Metric>(node->seChild);
+}
+
+bool QuadtreeView::isLeaf(Node const * node) const
+{
+	return node->nwChild == NULL || _cut.count(node) != 0;
+}
+
+RGBAPixel QuadtreeView::getPixel(int x, int y, Node const * node, int resolution) const
+{
+	while(!isLeaf(node))
+	{
+		resolution /= 2;
+		if(y < resolution)
+		{
+			node = (x < resolution) ? node->nwChild : node->neChild;
+		}
+		else
+		{
+			node = (x < resolution) ? node->swChild : node->seChild;
+			y -= resolution;
+		}
+		if(x >= resolution)
+			x -= resolution;
+	}
+
+	return node->element;
+}
+
+void QuadtreeView::decompress(Node const * node, int x, int y, int resolution, PNG & image) const
+{
+	if(isLeaf(node))
+	{
+		for(int j = y; j < y + resolution; j++)
+			for(int i = x; i < x + resolution; i++)
+				*image(i, j) = node->element;
+		return;
+	}
+
+	int half = resolution / 2;
+	decompress(node->nwChild, x, y, half, image);
+	decompress(node->neChild, x + half, y, half, image);
+	decompress(node->swChild, x, y + half, half, image);
+	decompress(node->seChild, x + half, y + half, half, image);
+}
+
+void QuadtreeView::leaves(Node const * node, int x, int y, int resolution, vector<Leaf> & out) const
+{
+	if(isLeaf(node))
+	{
+		Leaf leaf = {x, y, resolution, node->element};
+		out.push_back(leaf);
+		return;
+	}
+
+	int half = resolution / 2;
+	leaves(node->nwChild, x, y, half, out);
+	leaves(node->neChild, x + half, y, half, out);
+	leaves(node->swChild, x, y + half, half, out);
+	leaves(node->seChild, x + half, y + half, half, out);
+}
+
+// the views are compiled once for each metric in colormetric.h, like the prune family
+#define QUADTREE_VIEW_INSTANTIATE_METRIC(Metric) \
+	template QuadtreeView QuadtreeView::withTolerance<Metric>(Quadtree const &, int); \
+	template QuadtreeView QuadtreeView::withLeafBudget<Metric>(Quadtree const &, int);
+
+QUADTREE_VIEW_INSTANTIATE_METRIC(RgbMetric)
+QUADTREE_VIEW_INSTANTIATE_METRIC(LumaRgbMetric)
+QUADTREE_VIEW_INSTANTIATE_METRIC(YCbCrMetric)
+QUADTREE_VIEW_INSTANTIATE_METRIC(LabMetric)
+
+#undef QUADTREE_VIEW_INSTANTIATE_METRIC
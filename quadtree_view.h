@@ -0,0 +1,125 @@
+/**
+ * @file quadtree_view.h
+ * Definition of the QuadtreeView class, a read-only pruned view of a
+ * Quadtree.
+ */
+
+#ifndef QUADTREE_VIEW_H
+#define QUADTREE_VIEW_H
+
+#include <unordered_set>
+#include <vector>
+
+#include "png.h"
+#include "quadtree.h"
+
+/**
+ * Shows a Quadtree as if it had been pruned with a given tolerance and
+ * color metric, without modifying it. Nodes that Quadtree::prune() would turn into
+ * leaves are recorded as a cut; everything below the cut is treated as
+ * absent. The view keeps its own copy of the tree, which shares the
+ * tree's nodes, so it stays valid and unchanged when the tree is later
+ * edited or destroyed, and any number of views at different tolerances
+ * can be served from one built tree.
+ */
+class QuadtreeView
+{
+	public:
+		/**
+		 * One leaf of the pruned tree.
+		 */
+		struct Leaf
+		{
+			int x;             /**< Left edge of the leaf's square. */
+			int y;             /**< Top edge of the leaf's square. */
+			int resolution;    /**< Width and height of the leaf's square. */
+			RGBAPixel element; /**< Color of the square. */
+		};
+
+		/**
+		 * Creates an empty view.
+		 */
+		QuadtreeView();
+
+		/**
+		 * Creates a view of tree as Quadtree::prune(tolerance) would
+		 * leave it, measuring colors with RgbMetric.
+		 * @param tree The tree to view.
+		 * @param tolerance Tolerance passed to the prune being simulated.
+		 */
+		QuadtreeView(Quadtree const & tree, int tolerance);
+
+		/**
+		 * Creates a view of tree as Quadtree::prune<Metric>(tolerance)
+		 * would leave it.
+		 * @param tree The tree to view.
+		 * @param tolerance Tolerance passed to the prune being simulated.
+		 * @return The view.
+		 */
+		template <class Metric = RgbMetric>
+		static QuadtreeView withTolerance(Quadtree const & tree, int tolerance);
+
+		/**
+		 * Creates a view of tree with at most numLeaves leaves, pruned
+		 * with the tolerance Quadtree::idealPrune<Metric>(numLeaves)
+		 * finds.
+		 * @param tree The tree to view.
+		 * @param numLeaves The largest number of leaves the view may have.
+		 * @return The view.
+		 */
+		template <class Metric = RgbMetric>
+		static QuadtreeView withLeafBudget(Quadtree const & tree, int numLeaves);
+
+		/**
+		 * @return The tolerance the view was pruned with.
+		 */
+		int getTolerance() const;
+
+		/**
+		 * @return The resolution of the viewed tree (0 for an empty one).
+		 */
+		int getResolution() const;
+
+		/**
+		 * @return The number of leaves of the pruned tree; equal to
+		 *  Quadtree::pruneSize() for the view's tolerance and metric.
+		 */
+		int leafCount() const;
+
+		/**
+		 * Gets the color of a pixel of the pruned image.
+		 * @param x X coordinate of the pixel.
+		 * @param y Y coordinate of the pixel.
+		 * @return The color Quadtree::getPixel() would return after the
+		 *  prune, or a default RGBAPixel outside the image.
+		 */
+		RGBAPixel getPixel(int x, int y) const;
+
+		/**
+		 * @return The image Quadtree::decompress() would return after the
+		 *  prune.
+		 */
+		PNG decompress() const;
+
+		/**
+		 * @return Every leaf of the pruned tree, in preorder (northwest,
+		 *  northeast, southwest, southeast).
+		 */
+		std::vector<Leaf> leaves() const;
+
+	private:
+		typedef Quadtree::QuadtreeNode Node;
+
+		Quadtree _tree;
+		int _tolerance;
+		int _leafCount;
+		std::unordered_set<Node const *> _cut;
+
+		template <class Metric> int findCut(Node * node);
+		bool isLeaf(Node const * node) const;
+		RGBAPixel getPixel(int x, int y, Node const * node, int resolution) const;
+		void decompress(Node const * node, int x, int y, int resolution, PNG & image) const;
+		void leaves(Node const * node, int x, int y, int resolution, std::vector<Leaf> & out) const;
+};
+
+#endif // QUADTREE_VIEW_H
@@ -0,0 +1,189 @@
+/**
+ * @file test_cache.cpp
+ * Tests of Quadtree::decompressRegion and the QuadtreeTileCache in front
+ * of it.
+ */
+
+#include "test_harness.h"
+
+#include <thread>
+#include <vector>
+
+#include "test_images.h"
+#include "../quadtree_cache.h"
+#include "../quadtree_progressive.h"
+
+using namespace testimages;
+
+namespace
+{
+
+size_t const tileBytes = 64 * 64 * sizeof(RGBAPixel);
+
+Quadtree flatTree(int resolution, int red)
+{
+	PNG source(resolution, resolution);
+	for(int y = 0; y < resolution; y++)
+		for(int x = 0; x < resolution; x++)
+			*source(x, y) = RGBAPixel(red, 0, 0);
+
+	Quadtree tree(source, resolution);
+	tree.prune(0);
+	return tree;
+}
+
+}
+
+TEST(DecompressRegion, SamplesTheNodesOfTheLevel)
+{
+	Quadtree tree(image(PHOTO, 64), 64);
+	tree.prune(500);
+	EXPECT_TRUE(tree.decompressRegion(0, 0, 64, 64) == tree.decompress());
+
+	for(int level = 0; level <= 6; level++)
+	{
+		int step = 1 << level;
+		PNG const full = tree.decompressRegion(0, 0, 64, 64, level);
+		ASSERT_EQ((size_t) (64 / step), full.width());
+
+		// any rectangle, inside the tree or not, samples the same nodes
+		int const rectangles[][4] = { {0, 0, 64, 64}, {5, 9, 30, 17}, {-10, -3, 40, 80}, {60, 60, 20, 20} };
+		for(auto const & rect : rectangles)
+		{
+			PNG const part = tree.decompressRegion(rect[0], rect[1], rect[2], rect[3], level);
+			ASSERT_EQ((size_t) ((rect[2] + step - 1) / step), part.width());
+			ASSERT_EQ((size_t) ((rect[3] + step - 1) / step), part.height());
+			for(size_t j = 0; j < part.height(); j++)
+			{
+				for(size_t i = 0; i < part.width(); i++)
+				{
+					int x = rect[0] + i * step;
+					int y = rect[1] + j * step;
+					RGBAPixel expected = (x >= 0 && y >= 0 && x < 64 && y < 64) ? *full(x / step, y / step) : RGBAPixel();
+					EXPECT_EQ(expected, *part(i, j));
+				}
+			}
+		}
+	}
+}
+
+TEST(TileCache, RepeatedRequestsHitAndOldestEntriesAreEvicted)
+{
+	Quadtree tree(image(PHOTO, 256), 256);
+	QuadtreeTileCache cache(3 * tileBytes);
+
+	auto first = cache.get(tree, 0, 0, 64, 64);
+	EXPECT_EQ(first.get(), cache.get(tree, 0, 0, 64, 64).get());
+	EXPECT_EQ(first.get(), cache.get(Quadtree(tree), 0, 0, 64, 64).get());
+
+	cache.get(tree, 64, 0, 64, 64);
+	cache.get(tree, 128, 0, 64, 64);
+	cache.get(tree, 0, 0, 64, 64);
+	cache.get(tree, 192, 0, 64, 64);
+
+	QuadtreeTileCache::Counters counters = cache.counters();
+	EXPECT_EQ((size_t) 3, counters.hits);
+	EXPECT_EQ((size_t) 4, counters.misses);
+	EXPECT_EQ((size_t) 1, counters.evictions);
+	EXPECT_EQ((size_t) 3, counters.entries);
+	EXPECT_EQ(3 * tileBytes, counters.bytes);
+
+	// the least recently used tile went, the refreshed one stayed
+	cache.get(tree, 0, 0, 64, 64);
+	EXPECT_EQ((size_t) 4, cache.counters().misses);
+	cache.get(tree, 64, 0, 64, 64);
+	EXPECT_EQ((size_t) 5, cache.counters().misses);
+
+	// too large to keep
+	auto whole = cache.get(tree);
+	EXPECT_TRUE(*whole == tree.decompress());
+	EXPECT_EQ((size_t) 1, cache.counters().uncached);
+	EXPECT_LE(cache.counters().bytes, cache.capacity());
+}
+
+TEST(TileCache, KeyCoversTheAlphaMode)
+{
+	Quadtree straight(image(PHOTO, 8, true), 8);
+	Quadtree premultiplied(straight);
+	premultiplied.setPremultipliedAlpha(true);
+	ASSERT_EQ(straight.hash(), premultiplied.hash());
+
+	QuadtreeTileCache cache(1 << 20);
+	cache.get(straight, 0, 0, 8, 8, 1);
+	EXPECT_TRUE(*cache.get(premultiplied, 0, 0, 8, 8, 1) == premultiplied.decompressRegion(0, 0, 8, 8, 1));
+	EXPECT_TRUE(*cache.get(straight, 0, 0, 8, 8, 1) == straight.decompressRegion(0, 0, 8, 8, 1));
+}
+
+TEST(TileCache, KeyCoversTheResolution)
+{
+	Quadtree small = flatTree(2, 10);
+	Quadtree big = flatTree(8, 10);
+	ASSERT_EQ(small.hash(), big.hash());
+
+	QuadtreeTileCache cache(1 << 20);
+	cache.get(small, 0, 0, 8, 8);
+	std::shared_ptr<PNG const> tile = cache.get(big, 0, 0, 8, 8);
+	EXPECT_EQ(10, (*tile)(5, 5)->red);
+	EXPECT_TRUE(*tile == big.decompressRegion(0, 0, 8, 8));
+}
+
+TEST(TileCache, ProgressiveTreesAverageLikeBuiltOnes)
+{
+	// a premultiplied sender's internal colors are not the straight averages
+	Quadtree sender;
+	sender.setPremultipliedAlpha(true);
+	sender.buildTree(image(PHOTO, 16, true), 16);
+	std::ostringstream out;
+	sender.writeProgressive(out);
+
+	QuadtreeProgressiveReader reader;
+	reader.feed(out.str().data(), out.str().size());
+	Quadtree received = reader.tree();
+	Quadtree built(image(PHOTO, 16, true), 16);
+	ASSERT_EQ(built.hash(), received.hash());
+
+	QuadtreeTileCache cache(1 << 20);
+	cache.get(built, 0, 0, 16, 16, 2);
+	EXPECT_TRUE(*cache.get(received, 0, 0, 16, 16, 2) == received.decompressRegion(0, 0, 16, 16, 2));
+}
+
+TEST(TileCache, ExactModeLevelsAreNotCached)
+{
+	PNG source = image(NOISE, 16);
+	Quadtree tree;
+	tree.setExactSums(true);
+	tree.buildTree(source, 16);
+	tree.prune(20000);
+
+	QuadtreeTileCache cache(1 << 20);
+	cache.get(tree, 0, 0, 16, 16, 0);
+	cache.get(tree, 0, 0, 16, 16, 0);
+	EXPECT_TRUE(*cache.get(tree, 0, 0, 16, 16, 2) == tree.decompressRegion(0, 0, 16, 16, 2));
+	EXPECT_EQ((size_t) 1, cache.counters().hits);
+	EXPECT_EQ((size_t) 1, cache.counters().uncached);
+	EXPECT_EQ((size_t) 1, cache.counters().entries);
+}
+
+TEST(TileCache, ConcurrentRequestsRenderEachRegionOnce)
+{
+	Quadtree tree(image(PHOTO, 256), 256);
+	QuadtreeTileCache cache(1 << 24);
+
+	std::vector<std::thread> threads;
+	for(int t = 0; t < 8; t++)
+	{
+		threads.emplace_back([&cache, &tree, t]()
+		{
+			for(int k = 0; k < 100; k++)
+			{
+				int region = (k + t) % 5;
+				cache.get(tree, region * 32, region * 16, 100, 80, region % 3);
+			}
+		});
+	}
+	for(std::thread & thread : threads)
+		thread.join();
+
+	EXPECT_EQ((size_t) 5, cache.counters().misses);
+	EXPECT_EQ((size_t) (8 * 100 - 5), cache.counters().hits);
+}
@@ -0,0 +1,163 @@
+/**
+ * @file test_delta.cpp
+ * Tests of Quadtree::diff and applyDelta, and of the QuadtreeDelta file
+ * format.
+ */
+
+#include "test_harness.h"
+
+#include <initializer_list>
+#include <sstream>
+#include <string>
+
+#include "test_images.h"
+
+using namespace testimages;
+
+namespace
+{
+
+// applies from.diff(to) to a copy of from, through the delta's serialization
+Quadtree patched(Quadtree const & from, Quadtree const & to)
+{
+	QuadtreeDelta delta = from.diff(to);
+
+	std::ostringstream out;
+	delta.write(out);
+	std::istringstream in(out.str());
+	QuadtreeDelta read;
+	EXPECT_TRUE(read.read(in));
+
+	Quadtree result(from);
+	EXPECT_TRUE(result.applyDelta(read));
+	return result;
+}
+
+// a QTD1 stream with the given header words and one change's words, followed by payload
+std::string deltaStream(std::initializer_list<unsigned int> words, std::string const & payload = std::string())
+{
+	std::string result = "QTD1";
+	for(unsigned int word : words)
+	{
+		for(int shift = 0; shift < 32; shift += 8)
+			result += (char)((word >> shift) & 0xff);
+	}
+	return result + payload;
+}
+
+bool reads(std::string const & data)
+{
+	std::istringstream in(data);
+	QuadtreeDelta delta;
+	bool result = delta.read(in);
+	if(!result)
+	{
+		EXPECT_EQ(0, delta.getResolution());
+		EXPECT_TRUE(delta.changes().empty());
+	}
+	return result;
+}
+
+}
+
+TEST(Delta, RoundTripAfterEdits)
+{
+	PNG frame = image(PHOTO, 64);
+	Quadtree from(frame, 64);
+
+	for(int y = 10; y < 20; y++)
+		for(int x = 40; x < 52; x++)
+			*frame(x, y) = RGBAPixel(255, 0, 255);
+	Quadtree to(frame, 64);
+
+	Quadtree result = patched(from, to);
+	EXPECT_TRUE(result == to);
+	EXPECT_TRUE(result.decompress() == to.decompress());
+	EXPECT_LT(from.diff(to).changes().size(), (size_t) 64);
+}
+
+TEST(Delta, RoundTripBetweenPrunedTrees)
+{
+	Quadtree from(image(PHOTO, 64), 64);
+	Quadtree to(image(NOISE, 64), 64);
+	from.prune(1000);
+	to.prune(8000);
+
+	EXPECT_TRUE(patched(from, to) == to);
+	EXPECT_TRUE(patched(to, from) == from);
+}
+
+TEST(Delta, IdenticalTreesNeedNoChanges)
+{
+	Quadtree tree(image(GRADIENT, 32), 32);
+	Quadtree copy(tree);
+	Quadtree rebuilt(image(GRADIENT, 32), 32);
+
+	EXPECT_TRUE(tree.diff(copy).changes().empty());
+	EXPECT_TRUE(tree.diff(rebuilt).changes().empty());
+}
+
+TEST(Delta, ResolutionChangesAndEmptyTargets)
+{
+	Quadtree small(image(PHOTO, 16), 16);
+	Quadtree big(image(PHOTO, 64), 64);
+	Quadtree empty;
+
+	EXPECT_TRUE(patched(small, big) == big);
+	EXPECT_TRUE(patched(empty, big) == big);
+
+	Quadtree emptied = patched(big, empty);
+	EXPECT_EQ(0, emptied.getResolution());
+}
+
+TEST(Delta, ApplyingLeavesOtherCopiesAlone)
+{
+	Quadtree from(image(PHOTO, 32), 32);
+	Quadtree to(image(NOISE, 32), 32);
+	std::string const before = serialized(from);
+
+	Quadtree copy(from);
+	ASSERT_TRUE(copy.applyDelta(from.diff(to)));
+	EXPECT_TRUE(copy == to);
+	EXPECT_EQ(before, serialized(from));
+}
+
+TEST(Delta, MalformedStreamsAreRejected)
+{
+	std::string const leaf("\0\x10\x20\x30\xff", 5);
+
+	// resolution, count, then x y resolution length for each change
+	EXPECT_TRUE(reads(deltaStream({ 4, 1, 2, 0, 1, 5 }, leaf)));
+	EXPECT_FALSE(reads(deltaStream({ 48, 0 })));
+	EXPECT_FALSE(reads(deltaStream({ 0x80000000u, 0 })));
+	EXPECT_FALSE(reads(deltaStream({ 4, 17 })));
+	EXPECT_FALSE(reads(deltaStream({ 4, 1, 4, 0, 1, 5 }, leaf)));
+	EXPECT_FALSE(reads(deltaStream({ 4, 1, 1, 0, 2, 5 }, leaf)));
+	EXPECT_FALSE(reads(deltaStream({ 4, 1, 0, 0, 3, 5 }, leaf)));
+	EXPECT_FALSE(reads(deltaStream({ 4, 1, 0, 0, 8, 5 }, leaf)));
+	EXPECT_FALSE(reads(deltaStream({ 4, 1, 0, 0, 0, 5 }, leaf)));
+
+	// lengths past what a square can encode, or past the end of the stream, allocate nothing up front
+	EXPECT_FALSE(reads(deltaStream({ 4, 1, 2, 0, 1, 0xffffffffu }, leaf)));
+	EXPECT_FALSE(reads(deltaStream({ 1024, 1, 0, 0, 1024, 0x7fffffffu }, leaf)));
+}
+
+TEST(Delta, ApplyingChecksTheSubtrees)
+{
+	Quadtree tree(image(GRADIENT, 4), 4);
+	std::string const before = serialized(tree);
+
+	// the first change is fine, but a square of one pixel cannot be split
+	std::string const leaf("\0\x10\x20\x30\xff", 5);
+	std::string const data = deltaStream({ 4, 2, 2, 0, 1, 5 }, leaf) + deltaStream({ 3, 3, 1, 1 }, "\1").substr(4);
+	std::istringstream in(data);
+	QuadtreeDelta delta;
+	ASSERT_TRUE(delta.read(in));
+	EXPECT_FALSE(tree.applyDelta(delta));
+	EXPECT_EQ(before, serialized(tree));
+
+	std::istringstream good(deltaStream({ 4, 1, 2, 0, 1, 5 }, leaf));
+	ASSERT_TRUE(delta.read(good));
+	ASSERT_TRUE(tree.applyDelta(delta));
+	EXPECT_EQ(RGBAPixel(0x10, 0x20, 0x30, 0xff), tree.getPixel(2, 0));
+}
@@ -0,0 +1,139 @@
+/**
+ * @file test_exact.cpp
+ * Tests of exact mode: true means in the internal nodes and
+ * Quadtree::pruneByVariance.
+ */
+
+#include "test_harness.h"
+
+#include <vector>
+
+#include "test_images.h"
+
+using namespace testimages;
+
+namespace
+{
+
+struct Square
+{
+	int x;
+	int y;
+	int resolution;
+};
+
+// the leaves' squares, read back from the tree's plain serialization
+void leafSquares(std::string const & data, size_t & offset, int x, int y, int resolution, std::vector<Square> & out)
+{
+	if(data[offset] == 0)
+	{
+		offset += 5;
+		out.push_back(Square{x, y, resolution});
+		return;
+	}
+
+	offset++;
+	int half = resolution / 2;
+	leafSquares(data, offset, x, y, half, out);
+	leafSquares(data, offset, x + half, y, half, out);
+	leafSquares(data, offset, x, y + half, half, out);
+	leafSquares(data, offset, x + half, y + half, half, out);
+}
+
+std::vector<Square> leafSquares(Quadtree const & tree)
+{
+	std::vector<Square> squares;
+	size_t offset = 8;
+	leafSquares(serialized(tree), offset, 0, 0, tree.getResolution(), squares);
+	return squares;
+}
+
+// mean squared distance of the square's pixels from their mean, summed over the four channels
+double variance(PNG const & source, Square const & square)
+{
+	double sum[4] = {0, 0, 0, 0};
+	double squares[4] = {0, 0, 0, 0};
+	for(int y = square.y; y < square.y + square.resolution; y++)
+	{
+		for(int x = square.x; x < square.x + square.resolution; x++)
+		{
+			RGBAPixel const & pixel = *source(x, y);
+			double const values[4] = { (double) pixel.red, (double) pixel.green, (double) pixel.blue, (double) pixel.alpha };
+			for(int c = 0; c < 4; c++)
+			{
+				sum[c] += values[c];
+				squares[c] += values[c] * values[c];
+			}
+		}
+	}
+
+	double count = (double) square.resolution * square.resolution;
+	double result = 0;
+	for(int c = 0; c < 4; c++)
+		result += squares[c] / count - (sum[c] / count) * (sum[c] / count);
+	return result;
+}
+
+}
+
+TEST(Exact, PruneByVarianceKeepsEveryLeafWithinTheLimit)
+{
+	for(Content content : { GRADIENT, NOISE, PHOTO })
+	{
+		PNG const source = image(content, 64, true);
+		for(double limit : { 0.0, 10.0, 150.5, 2000.0, 1e9 })
+		{
+			Quadtree tree;
+			tree.setExactSums(true);
+			tree.buildTree(source, 64);
+			tree.pruneByVariance(limit);
+
+			std::vector<Square> const squares = leafSquares(tree);
+			EXPECT_EQ((size_t) tree.leafCount(), squares.size());
+			for(Square const & square : squares)
+			{
+				EXPECT_LE(variance(source, square), limit + 1e-6)
+					<< "content " << content << ", limit " << limit << ", leaf at " << square.x << ", "
+					<< square.y << " of size " << square.resolution;
+			}
+			if(limit >= 1e9)
+			{
+				EXPECT_EQ(1, tree.leafCount());
+			}
+		}
+	}
+}
+
+TEST(Exact, PruneByVarianceNeedsExactMode)
+{
+	Quadtree tree(image(PHOTO, 32), 32);
+	std::string const before = serialized(tree);
+	tree.pruneByVariance(1e9);
+	EXPECT_EQ(before, serialized(tree));
+}
+
+TEST(Exact, InternalNodesHoldTheTrueMean)
+{
+	PNG const source = image(NOISE, 16);
+	Quadtree tree;
+	tree.setExactSums(true);
+	tree.buildTree(source, 16);
+	tree.pruneByVariance(1e9);
+	ASSERT_EQ(1, tree.leafCount());
+
+	long sum[3] = {0, 0, 0};
+	for(int y = 0; y < 16; y++)
+	{
+		for(int x = 0; x < 16; x++)
+		{
+			sum[0] += source(x, y)->red;
+			sum[1] += source(x, y)->green;
+			sum[2] += source(x, y)->blue;
+		}
+	}
+
+	RGBAPixel const mean = tree.getPixel(0, 0);
+	EXPECT_EQ(sum[0] / 256, (long) mean.red);
+	EXPECT_EQ(sum[1] / 256, (long) mean.green);
+	EXPECT_EQ(sum[2] / 256, (long) mean.blue);
+}
@@ -0,0 +1,252 @@
+/**
+ * @file test_formats.cpp
+ * Round-trip tests of the plain (QTR1), compact (QTC1) and progressive
+ * (QTP1) formats.
+ */
+
+#include "test_harness.h"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "test_images.h"
+#include "../quadtree_progressive.h"
+
+using namespace testimages;
+
+namespace
+{
+
+// the trees every format is checked on: full, pruned, with alpha, a single pixel and empty
+std::vector<Quadtree> sampleTrees()
+{
+	std::vector<Quadtree> trees;
+	trees.push_back(Quadtree(image(PHOTO, 64), 64));
+	trees.push_back(Quadtree(image(NOISE, 32), 32));
+
+	Quadtree pruned(image(PHOTO, 64, true), 64);
+	pruned.prune(2000);
+	trees.push_back(pruned);
+
+	trees.push_back(Quadtree(image(GRADIENT, 1), 1));
+	trees.push_back(Quadtree());
+	return trees;
+}
+
+void expectSameTree(Quadtree const & expected, Quadtree const & actual)
+{
+	EXPECT_EQ(expected.getResolution(), actual.getResolution());
+	EXPECT_TRUE(expected == actual);
+	EXPECT_EQ(serialized(expected), serialized(actual));
+	if(expected.getResolution() > 0)
+	{
+		EXPECT_TRUE(expected.decompress() == actual.decompress());
+	}
+}
+
+}
+
+TEST(Formats, PlainRoundTrip)
+{
+	for(Quadtree const & tree : sampleTrees())
+	{
+		std::istringstream in(serialized(tree));
+		Quadtree read;
+		ASSERT_TRUE(read.read(in));
+		expectSameTree(tree, read);
+	}
+}
+
+TEST(Formats, CompactRoundTrip)
+{
+	for(Quadtree const & tree : sampleTrees())
+	{
+		std::ostringstream out;
+		tree.writeCompact(out);
+		std::string const data = out.str();
+		EXPECT_EQ(0, data.compare(0, 4, "QTC1"));
+
+		std::istringstream in(data);
+		Quadtree read;
+		ASSERT_TRUE(read.read(in));
+		expectSameTree(tree, read);
+
+		if(tree.getResolution() > 0)
+		{
+			std::istringstream again(data);
+			PNG decoded;
+			ASSERT_TRUE(Quadtree::readCompactImage(again, decoded));
+			EXPECT_TRUE(decoded == tree.decompress());
+		}
+	}
+}
+
+TEST(Formats, ProgressiveRoundTrip)
+{
+	for(Quadtree const & tree : sampleTrees())
+	{
+		std::ostringstream out;
+		tree.writeProgressive(out);
+		std::string const data = out.str();
+
+		std::istringstream in(data);
+		Quadtree read;
+		ASSERT_TRUE(read.read(in));
+		expectSameTree(tree, read);
+
+		// fed in uneven pieces, the incremental reader ends with the same image
+		QuadtreeProgressiveReader reader;
+		for(size_t offset = 0; offset < data.size(); offset += 7)
+			ASSERT_TRUE(reader.feed(data.data() + offset, std::min<size_t>(7, data.size() - offset)));
+		ASSERT_TRUE(reader.complete());
+		if(tree.getResolution() > 0)
+		{
+			EXPECT_TRUE(reader.image() == tree.decompress());
+		}
+		EXPECT_TRUE(reader.tree() == tree);
+
+		// a reader that only builds the tree never allocates the image
+		QuadtreeProgressiveReader treeOnly(false);
+		ASSERT_TRUE(treeOnly.feed(data.data(), data.size()));
+		ASSERT_TRUE(treeOnly.complete());
+		EXPECT_TRUE(treeOnly.tree() == tree);
+		EXPECT_TRUE(treeOnly.image() == PNG());
+	}
+}
+
+TEST(Formats, ProgressiveStreamsTakeTheReadingTreesModes)
+{
+	Quadtree tree(image(PHOTO, 64, true), 64);
+	tree.prune(500);
+	std::ostringstream plain, progressive;
+	tree.write(plain);
+	tree.writeProgressive(progressive);
+
+	// the nodes are recolored once, for the modes of the tree reading them, as from the plain format
+	for(bool exact : { false, true })
+	{
+		for(bool premultiplied : { false, true })
+		{
+			std::istringstream plainIn(plain.str()), progressiveIn(progressive.str());
+			Quadtree fromPlain, fromProgressive;
+			fromPlain.setExactSums(exact);
+			fromPlain.setPremultipliedAlpha(premultiplied);
+			fromProgressive.setExactSums(exact);
+			fromProgressive.setPremultipliedAlpha(premultiplied);
+			ASSERT_TRUE(fromPlain.read(plainIn));
+			ASSERT_TRUE(fromProgressive.read(progressiveIn));
+
+			EXPECT_TRUE(fromProgressive == fromPlain) << "exact " << exact << ", premultiplied " << premultiplied;
+			EXPECT_EQ(fromPlain.regionStats(5, 9, 30, 17).variance, fromProgressive.regionStats(5, 9, 30, 17).variance);
+		}
+	}
+}
+
+TEST(Formats, ProgressivePrefixIsACoarserTree)
+{
+	Quadtree tree(image(PHOTO, 64), 64);
+	for(int levels = 1; levels <= 7; levels++)
+	{
+		std::ostringstream out;
+		tree.writeProgressive(out, levels);
+
+		std::istringstream in(out.str());
+		Quadtree read;
+		ASSERT_TRUE(read.read(in));
+		EXPECT_EQ(64, read.getResolution());
+		EXPECT_LE(read.leafCount(), 1 << (2 * (levels - 1)));
+	}
+}
+
+TEST(Formats, TruncatedStreamsAreRejected)
+{
+	Quadtree tree(image(PHOTO, 32), 32);
+	std::ostringstream plain, compact, progressive;
+	tree.write(plain);
+	tree.writeCompact(compact);
+	tree.writeProgressive(progressive);
+
+	for(std::string const & data : { plain.str(), compact.str(), progressive.str() })
+	{
+		for(size_t length : { (size_t) 3, (size_t) 8, data.size() / 2, data.size() - 1 })
+		{
+			std::istringstream in(data.substr(0, length));
+			Quadtree read;
+			EXPECT_FALSE(read.read(in)) << data.substr(0, 4) << " cut at " << length;
+			EXPECT_EQ(0, read.getResolution());
+		}
+	}
+}
+
+TEST(Formats, CompactImageHeadersAreCheckedBeforeAllocating)
+{
+	// 2^30 pixels a side would need 4 EiB; 48 is not a power of two
+	for(unsigned char const * header : { (unsigned char const *) "QTC1\0\0\0\x40", (unsigned char const *) "QTC1\x30\0\0\0" })
+	{
+		std::istringstream in(std::string((char const *) header, 8));
+		PNG decoded(1, 1);
+		EXPECT_FALSE(Quadtree::readCompactImage(in, decoded));
+		EXPECT_EQ(1u, decoded.width());
+	}
+
+	Quadtree tree(image(PHOTO, 64), 64);
+	std::ostringstream compact;
+	tree.writeCompact(compact);
+
+	std::istringstream capped(compact.str());
+	PNG decoded;
+	EXPECT_FALSE(Quadtree::readCompactImage(capped, decoded, 32));
+
+	std::istringstream fits(compact.str());
+	ASSERT_TRUE(Quadtree::readCompactImage(fits, decoded, 64));
+	EXPECT_EQ(64u, decoded.width());
+}
+
+TEST(Formats, ProgressiveHeadersAreCheckedBeforeAllocating)
+{
+	// a 2^30-pixel-square header followed by a root leaf
+	std::string const huge("QTP1\0\0\0\x40\x10\x20\x30\xff\0", 13);
+	QuadtreeProgressiveReader reader;
+	EXPECT_FALSE(reader.feed(huge.data(), huge.size()));
+	EXPECT_TRUE(reader.failed());
+	EXPECT_TRUE(reader.image() == PNG());
+
+	std::istringstream in(huge);
+	Quadtree read;
+	EXPECT_FALSE(read.read(in));
+
+	Quadtree tree(image(PHOTO, 64), 64);
+	std::ostringstream progressive;
+	tree.writeProgressive(progressive);
+	std::string const data = progressive.str();
+
+	QuadtreeProgressiveReader capped(true, 32);
+	EXPECT_FALSE(capped.feed(data.data(), data.size()));
+
+	QuadtreeProgressiveReader fits(true, 64);
+	ASSERT_TRUE(fits.feed(data.data(), data.size()));
+	EXPECT_TRUE(fits.complete());
+	EXPECT_TRUE(fits.image() == tree.decompress());
+}
+
+TEST(Formats, TreeHeadersAreCheckedAgainstTheCap)
+{
+	// a 2^30-pixel-square tree of a single leaf reads in 13 bytes, but could not be decompressed
+	std::istringstream huge(std::string("QTR1\0\0\0\x40\0\x10\x20\x30\xff", 13));
+	Quadtree read;
+	EXPECT_FALSE(read.read(huge));
+	EXPECT_EQ(0, read.getResolution());
+
+	Quadtree tree(image(PHOTO, 64), 64);
+	std::ostringstream plain;
+	tree.write(plain);
+
+	std::istringstream capped(plain.str());
+	EXPECT_FALSE(read.read(capped, 32));
+
+	std::istringstream fits(plain.str());
+	ASSERT_TRUE(read.read(fits, 64));
+	EXPECT_TRUE(read == tree);
+}
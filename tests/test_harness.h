@@ -0,0 +1,119 @@
+/**
+ * @file test_harness.h
+ * A minimal unit-test harness, so the tests build wherever the library
+ * does: TEST() registers a case, and the EXPECT and ASSERT macros check
+ * conditions inside it (an ASSERT also ends the case). Any check can be
+ * followed by << and a message printed when it fails.
+ *
+ * The cases of every test file are linked into one runner,
+ * quadtree_tests; given an argument, it runs only the cases whose
+ * "Suite.Name" starts with it.
+ */
+
+#ifndef TEST_HARNESS_H
+#define TEST_HARNESS_H
+
+#include <sstream>
+#include <string>
+
+namespace testharness
+{
+
+/**
+ * Adds a case to the runner's list; used by TEST().
+ */
+struct Registrar
+{
+	Registrar(char const * name, void (*body)());
+};
+
+/**
+ * Thrown by a failed ASSERT to end the case.
+ */
+struct Abort
+{
+};
+
+/**
+ * Reports one failed check when it goes out of scope, with whatever was
+ * streamed into it; a fatal one then ends the case.
+ */
+class Failure
+{
+	public:
+		Failure(char const * file, int line, bool fatal, std::string const & check);
+		~Failure() noexcept(false);
+
+		template <typename T>
+		Failure & operator<<(T const & value)
+		{
+			_message << value;
+			return *this;
+		}
+
+	private:
+		std::string _where;
+		bool _fatal;
+		std::ostringstream _message;
+};
+
+/**
+ * The outcome of a comparison and, when it failed, its description.
+ */
+struct Comparison
+{
+	bool passed;
+	std::string description;
+
+	explicit operator bool() const
+	{
+		return passed;
+	}
+};
+
+template <typename A, typename B, typename Compare>
+Comparison compare(A const & a, B const & b, char const * aText, char const * bText, char const * op, Compare holds)
+{
+	Comparison result = {holds(a, b), std::string()};
+	if(!result.passed)
+	{
+		std::ostringstream out;
+		out << aText << " " << op << " " << bText << " (" << a << " vs " << b << ")";
+		result.description = out.str();
+	}
+	return result;
+}
+
+} // namespace testharness
+
+#define TEST(suite, name) \
+	static void suite##_##name(); \
+	static testharness::Registrar suite##_##name##_registrar(#suite "." #name, suite##_##name); \
+	static void suite##_##name()
+
+#define QT_CHECK(condition, fatal) \
+	if(condition) \
+		; \
+	else \
+		testharness::Failure(__FILE__, __LINE__, fatal, #condition)
+
+#define QT_COMPARE(a, b, op, fatal) \
+	if(testharness::Comparison qtComparison = testharness::compare((a), (b), #a, #b, #op, \
+			[](auto const & x, auto const & y) { return x op y; })) \
+		; \
+	else \
+		testharness::Failure(__FILE__, __LINE__, fatal, qtComparison.description)
+
+#define EXPECT_TRUE(condition) QT_CHECK(condition, false)
+#define EXPECT_FALSE(condition) QT_CHECK(!(condition), false)
+#define ASSERT_TRUE(condition) QT_CHECK(condition, true)
+#define ASSERT_FALSE(condition) QT_CHECK(!(condition), true)
+
+#define EXPECT_EQ(a, b) QT_COMPARE(a, b, ==, false)
+#define EXPECT_NE(a, b) QT_COMPARE(a, b, !=, false)
+#define EXPECT_LT(a, b) QT_COMPARE(a, b, <, false)
+#define EXPECT_LE(a, b) QT_COMPARE(a, b, <=, false)
+#define EXPECT_GT(a, b) QT_COMPARE(a, b, >, false)
+#define ASSERT_EQ(a, b) QT_COMPARE(a, b, ==, true)
+
+#endif // TEST_HARNESS_H
@@ -0,0 +1,97 @@
+/**
+ * @file test_images.h
+ * Deterministic images and tree comparisons shared by the unit tests.
+ */
+
+#ifndef TEST_IMAGES_H
+#define TEST_IMAGES_H
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+#include "../png.h"
+#include "../quadtree.h"
+
+namespace testimages
+{
+
+enum Content { FLAT, GRADIENT, NOISE, PHOTO };
+
+/**
+ * Small xorshift generator, so every run sees the same pixels.
+ */
+struct XorShift
+{
+	uint32_t state;
+
+	explicit XorShift(uint32_t seed) : state(seed)
+	{
+		/* nothing */
+	}
+
+	uint32_t next()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+};
+
+/**
+ * Creates a size x size image. PHOTO mixes smooth areas, hard edges and a
+ * little noise, and varies alpha when withAlpha is set.
+ */
+inline PNG image(Content content, int size, bool withAlpha = false, uint32_t seed = 2463534242u)
+{
+	PNG result(size, size);
+	XorShift rng(seed);
+	for(int y = 0; y < size; y++)
+	{
+		for(int x = 0; x < size; x++)
+		{
+			RGBAPixel & pixel = *result(x, y);
+			switch(content)
+			{
+				case FLAT:
+					pixel = RGBAPixel(90, 140, 200);
+					break;
+				case GRADIENT:
+					pixel = RGBAPixel(x * 255 / size, y * 255 / size, (x + y) * 127 / size);
+					break;
+				case NOISE:
+					pixel = RGBAPixel(rng.next() & 0xff, rng.next() & 0xff, rng.next() & 0xff);
+					break;
+				case PHOTO:
+				{
+					bool inside = (x - size / 3) * (x - size / 3) + (y - size / 2) * (y - size / 2) < size * size / 9;
+					int noise = rng.next() % 9;
+					pixel = inside ? RGBAPixel(200 + noise, 60 + noise, 40)
+								   : RGBAPixel(x * 160 / size + noise, 120, y * 200 / size);
+					if(x > 3 * size / 4 && y < size / 4)
+						pixel = RGBAPixel(20, 20, 20);
+					break;
+				}
+			}
+			if(withAlpha)
+				pixel.alpha = (x * 3 + y * 5) % 256;
+		}
+	}
+	return result;
+}
+
+/**
+ * @return The tree's plain serialization, which covers the resolution,
+ *  the layout and every leaf color.
+ */
+inline std::string serialized(Quadtree const & tree)
+{
+	std::ostringstream out;
+	tree.write(out);
+	return out.str();
+}
+
+} // namespace testimages
+
+#endif // TEST_IMAGES_H
@@ -0,0 +1,89 @@
+/**
+ * @file test_into.cpp
+ * Tests of Quadtree::decompressInto, which paints into a caller's buffer.
+ */
+
+#include "test_harness.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "test_images.h"
+
+using namespace testimages;
+
+namespace
+{
+
+uint8_t const padding = 0xA5;
+
+// paints the tree into a buffer whose rows are extra bytes longer than the pixels, and checks it
+void expectMatchesDecompress(Quadtree const & tree, Quadtree::PixelFormat format, size_t extra)
+{
+	int const size = tree.getResolution();
+	int const bytes = Quadtree::bytesPerPixel(format);
+	size_t const stride = (size_t) size * bytes + extra;
+	std::vector<uint8_t> buffer(stride * size, padding);
+	tree.decompressInto(buffer.data(), stride, format);
+
+	PNG const expected = tree.decompress();
+	for(int y = 0; y < size; y++)
+	{
+		uint8_t const * row = buffer.data() + y * stride;
+		for(int x = 0; x < size; x++)
+		{
+			RGBAPixel const & pixel = *expected(x, y);
+			uint8_t const * out = row + (size_t) x * bytes;
+			int red = format == Quadtree::BGRA8 ? out[2] : out[0];
+			int blue = format == Quadtree::BGRA8 ? out[0] : out[2];
+			ASSERT_TRUE(red == pixel.red && out[1] == pixel.green && blue == pixel.blue)
+				<< "format " << format << " at " << x << ", " << y;
+			if(bytes == 4)
+			{
+				ASSERT_EQ((int) pixel.alpha, (int) out[3]);
+			}
+		}
+
+		// the bytes past the row are the caller's
+		for(size_t i = (size_t) size * bytes; i < stride; i++)
+		{
+			ASSERT_EQ((int) padding, (int) row[i]) << "format " << format << ", row " << y;
+		}
+	}
+}
+
+}
+
+TEST(Into, MatchesDecompressInEveryFormat)
+{
+	for(Content content : { FLAT, GRADIENT, PHOTO })
+	{
+		Quadtree tree(image(content, 32, true), 32);
+		tree.prune(1500);
+		for(Quadtree::PixelFormat format : { Quadtree::RGBA8, Quadtree::BGRA8, Quadtree::RGB8 })
+		{
+			for(size_t extra : { 0, 1, 3, 64 })
+				expectMatchesDecompress(tree, format, extra);
+		}
+	}
+}
+
+TEST(Into, BytesPerPixel)
+{
+	EXPECT_EQ(4, Quadtree::bytesPerPixel(Quadtree::RGBA8));
+	EXPECT_EQ(4, Quadtree::bytesPerPixel(Quadtree::BGRA8));
+	EXPECT_EQ(3, Quadtree::bytesPerPixel(Quadtree::RGB8));
+}
+
+TEST(Into, EmptyTreesWriteNothing)
+{
+	std::vector<uint8_t> buffer(64, padding);
+	Quadtree().decompressInto(buffer.data(), 16, Quadtree::RGBA8);
+	for(uint8_t byte : buffer)
+	{
+		EXPECT_EQ((int) padding, (int) byte);
+	}
+
+	// and a tree with no buffer is left alone
+	Quadtree(image(PHOTO, 4), 4).decompressInto(NULL, 16, Quadtree::RGBA8);
+}
@@ -0,0 +1,120 @@
+/**
+ * @file test_leafbudget.cpp
+ * Tests of Quadtree::pruneToLeafCount, the greedy leaf-budget prune.
+ */
+
+#include "test_harness.h"
+
+#include <algorithm>
+
+#include "test_images.h"
+
+using namespace testimages;
+
+namespace
+{
+
+// the largest squared RGB distance between two images' pixels, as prune measures it
+int maxDistance(PNG const & first, PNG const & second)
+{
+	int result = 0;
+	for(size_t y = 0; y < first.height(); y++)
+	{
+		for(size_t x = 0; x < first.width(); x++)
+		{
+			RGBAPixel const & a = *first(x, y);
+			RGBAPixel const & b = *second(x, y);
+			int red = a.red - b.red;
+			int green = a.green - b.green;
+			int blue = a.blue - b.blue;
+			result = std::max(result, red * red + green * green + blue * blue);
+		}
+	}
+	return result;
+}
+
+}
+
+TEST(LeafBudget, LeafCountLandsJustUnderTheBudget)
+{
+	for(Content content : { GRADIENT, NOISE, PHOTO })
+	{
+		Quadtree const tree(image(content, 64), 64);
+		int const leaves = tree.leafCount();
+		for(int budget : { 1, 2, 4, 5, 7, 50, 333, 1000, 4000, leaves - 1, leaves, leaves + 1, 100000 })
+		{
+			Quadtree pruned(tree);
+			pruned.pruneToLeafCount(budget);
+
+			int expected = std::min(std::max(budget, 1), leaves);
+			EXPECT_LE(pruned.leafCount(), expected) << "content " << content << ", budget " << budget;
+			EXPECT_LE(expected - 3, pruned.leafCount()) << "content " << content << ", budget " << budget;
+			if(budget >= leaves)
+			{
+				EXPECT_EQ(serialized(tree), serialized(pruned));
+			}
+		}
+	}
+
+	// a budget below one still leaves the root
+	Quadtree tree(image(PHOTO, 32), 32);
+	tree.pruneToLeafCount(0);
+	EXPECT_EQ(1, tree.leafCount());
+
+	Quadtree empty;
+	empty.pruneToLeafCount(10);
+	EXPECT_EQ(0, empty.leafCount());
+}
+
+TEST(LeafBudget, NeverWorseThanIdealPruneAtTheSameLeafCount)
+{
+	for(Content content : { GRADIENT, NOISE, PHOTO })
+	{
+		PNG const source = image(content, 64);
+		Quadtree const tree(source, 64);
+		for(int budget : { 1, 10, 64, 300, 1000, 3000 })
+		{
+			Quadtree uniform(tree);
+			uniform.prune(tree.idealPrune(budget));
+
+			// the greedy prune gets the leaves the uniform one ended up with
+			Quadtree greedy(tree);
+			greedy.pruneToLeafCount(uniform.leafCount());
+			EXPECT_LE(greedy.leafCount(), uniform.leafCount());
+			EXPECT_LE(maxDistance(source, greedy.decompress()), maxDistance(source, uniform.decompress()))
+				<< "content " << content << ", budget " << budget;
+		}
+	}
+}
+
+TEST(LeafBudget, PrunesAnAlreadyPrunedTreeAndLeavesCopiesAlone)
+{
+	Quadtree tree(image(PHOTO, 64), 64);
+	tree.prune(500);
+	Quadtree const copy(tree);
+	std::string const before = serialized(copy);
+
+	int budget = tree.leafCount() / 2;
+	tree.pruneToLeafCount(budget);
+	EXPECT_LE(tree.leafCount(), budget);
+	EXPECT_LE(budget - 3, tree.leafCount());
+	EXPECT_EQ(before, serialized(copy));
+}
+
+TEST(LeafBudget, MeasuresColorsWithTheGivenMetric)
+{
+	for(Content content : { GRADIENT, PHOTO })
+	{
+		Quadtree const tree(image(content, 64), 64);
+		for(int tolerance : { 20, 200, 2000 })
+		{
+			Quadtree uniform(tree);
+			uniform.prune<LabMetric>(tolerance);
+
+			// at a leaf count the Lab prune reaches, the greedy one ends on the same tree
+			Quadtree greedy(tree);
+			greedy.pruneToLeafCount<LabMetric>(uniform.leafCount());
+			EXPECT_EQ(serialized(uniform), serialized(greedy)) << "content " << content << ", tolerance " << tolerance;
+		}
+	}
+}
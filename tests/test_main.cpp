@@ -0,0 +1,98 @@
+/**
+ * @file test_main.cpp
+ * Runner for the cases registered with TEST(): runs them in the order
+ * they were linked, reports each failed check, and exits with status 1 if
+ * any failed.
+ */
+
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "test_harness.h"
+
+using namespace std;
+
+namespace
+{
+
+typedef pair<char const *, void (*)()> Case;
+
+vector<Case> & cases()
+{
+	static vector<Case> registered;
+	return registered;
+}
+
+// failed checks of the case being run
+int failures = 0;
+
+}
+
+namespace testharness
+{
+
+Registrar::Registrar(char const * name, void (*body)())
+{
+	cases().push_back(Case(name, body));
+}
+
+Failure::Failure(char const * file, int line, bool fatal, string const & check) : _fatal(fatal)
+{
+	ostringstream where;
+	where << file << ":" << line << ": failed: " << check;
+	_where = where.str();
+}
+
+Failure::~Failure() noexcept(false)
+{
+	cerr << _where;
+	if(!_message.str().empty())
+		cerr << ": " << _message.str();
+	cerr << endl;
+
+	failures++;
+	if(_fatal)
+		throw Abort();
+}
+
+} // namespace testharness
+
+int main(int argc, char ** argv)
+{
+	char const * prefix = (argc > 1) ? argv[1] : "";
+	int run = 0;
+	int failed = 0;
+
+	for(Case const & test : cases())
+	{
+		if(strncmp(test.first, prefix, strlen(prefix)) != 0)
+			continue;
+
+		cout << "[ RUN  ] " << test.first << endl;
+		failures = 0;
+		try
+		{
+			test.second();
+		}
+		catch(testharness::Abort const &)
+		{
+			/* already reported */
+		}
+		catch(exception const & error)
+		{
+			cerr << test.first << ": unexpected exception: " << error.what() << endl;
+			failures++;
+		}
+
+		run++;
+		if(failures > 0)
+			failed++;
+		cout << (failures > 0 ? "[ FAIL ] " : "[  OK  ] ") << test.first << endl;
+	}
+
+	cout << run - failed << " of " << run << " cases passed" << endl;
+	return (failed > 0 || run == 0) ? 1 : 0;
+}
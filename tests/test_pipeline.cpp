@@ -0,0 +1,135 @@
+/**
+ * @file test_pipeline.cpp
+ * Tests of the BatchPipeline against compressing the same images one at a
+ * time.
+ */
+
+#include "test_harness.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../pipeline.h"
+#include "test_images.h"
+
+using namespace testimages;
+namespace fs = std::filesystem;
+
+namespace
+{
+
+int const imageCount = 6;
+
+// a fresh directory holding imageCount PNGs of different contents and sizes
+fs::path makeInputs(char const * name)
+{
+	fs::path directory = fs::temp_directory_path() / name;
+	fs::remove_all(directory);
+	fs::create_directories(directory);
+
+	Content const contents[] = { FLAT, GRADIENT, NOISE, PHOTO };
+	for(int i = 0; i < imageCount; i++)
+	{
+		PNG source = image(contents[i % 4], 16 << (i % 3), i % 2 == 1, 1000 + i);
+		source.writeToFile((directory / ("in" + std::to_string(i) + ".png")).string());
+	}
+	return directory;
+}
+
+std::vector<BatchJob> jobsFor(fs::path const & directory)
+{
+	std::vector<BatchJob> jobs;
+	for(int i = 0; i < imageCount; i++)
+	{
+		BatchJob job;
+		job.input = (directory / ("in" + std::to_string(i) + ".png")).string();
+		job.output = (directory / ("out" + std::to_string(i) + ".png")).string();
+		jobs.push_back(job);
+	}
+	return jobs;
+}
+
+// what the pipeline's build and encode stages should produce for one input
+PNG compressedAlone(std::string const & input, PipelineOptions const & options)
+{
+	PNG source;
+	source.readFromFile(input);
+	Quadtree tree(source, largestResolution(source));
+	if(options.numLeaves > 0)
+		tree.prune(tree.idealPrune(options.numLeaves));
+	else if(options.tolerance >= 0)
+		tree.prune(options.tolerance);
+	return tree.decompress();
+}
+
+void expectPipelineMatches(PipelineOptions const & options)
+{
+	fs::path directory = makeInputs("quadtree_test_pipeline");
+	std::vector<BatchJob> const jobs = jobsFor(directory);
+
+	PipelineStats stats = BatchPipeline(options).run(jobs);
+	EXPECT_EQ((size_t) imageCount, stats.encode.items);
+	EXPECT_EQ(0u, stats.decode.failures + stats.build.failures + stats.encode.failures);
+	EXPECT_LE(stats.decoded.maxDepth, options.queueCapacity);
+	EXPECT_LE(stats.built.maxDepth, options.queueCapacity);
+
+	for(BatchJob const & job : jobs)
+	{
+		PNG output;
+		ASSERT_TRUE(output.readFromFile(job.output)) << job.output;
+		EXPECT_TRUE(output == compressedAlone(job.input, options)) << job.input;
+	}
+
+	fs::remove_all(directory);
+}
+
+}
+
+TEST(Pipeline, OneWorkerPerStageMatchesCompressingAlone)
+{
+	PipelineOptions options;
+	options.queueCapacity = 1;
+	options.tolerance = 2000;
+	expectPipelineMatches(options);
+}
+
+TEST(Pipeline, SeveralWorkersPerStageMatchCompressingAlone)
+{
+	PipelineOptions options;
+	options.decodeWorkers = 3;
+	options.buildWorkers = 4;
+	options.encodeWorkers = 2;
+	options.queueCapacity = 1;
+	options.numLeaves = 40;
+	expectPipelineMatches(options);
+}
+
+TEST(Pipeline, UnreadableInputsAreDroppedAndTheRestComplete)
+{
+	fs::path directory = makeInputs("quadtree_test_pipeline_bad");
+	std::vector<BatchJob> jobs = jobsFor(directory);
+
+	// one file that is not a PNG, and one that does not exist
+	std::ofstream(jobs[1].input) << "not a png";
+	fs::remove(jobs[4].input);
+
+	for(int workers : { 1, 3 })
+	{
+		PipelineOptions options;
+		options.decodeWorkers = workers;
+		options.buildWorkers = workers;
+		options.encodeWorkers = workers;
+		options.queueCapacity = 1;
+
+		PipelineStats stats = BatchPipeline(options).run(jobs);
+		EXPECT_EQ(2u, stats.decode.failures);
+		EXPECT_EQ((size_t) imageCount - 2, stats.encode.items);
+		EXPECT_FALSE(fs::exists(jobs[1].output));
+		EXPECT_FALSE(fs::exists(jobs[4].output));
+		EXPECT_TRUE(fs::exists(jobs[5].output));
+	}
+
+	fs::remove_all(directory);
+}
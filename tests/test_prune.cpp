@@ -0,0 +1,126 @@
+/**
+ * @file test_prune.cpp
+ * Tests of Quadtree::buildPruned against buildTree followed by prune,
+ * and of the prune family's leaf counts and tolerance search.
+ */
+
+#include "test_harness.h"
+
+#include "../basicimage.h"
+#include "../quadtree_basic.h"
+#include "../quadtree_fixed.h"
+#include "test_images.h"
+
+using namespace testimages;
+
+namespace
+{
+
+int const tolerances[] = { 0, 100, 1000, 5000, 20000 };
+Content const contents[] = { FLAT, GRADIENT, NOISE, PHOTO };
+
+// buildPruned must give exactly the tree buildTree + prune<Metric> gives
+template <class Metric>
+void expectBuildPrunedMatches(bool premultiplied)
+{
+	for(Content content : contents)
+	{
+		for(int resolution : { 1, 16, 64 })
+		{
+			PNG const source = image(content, 64, premultiplied);
+			for(int tolerance : tolerances)
+			{
+				Quadtree expected;
+				expected.setPremultipliedAlpha(premultiplied);
+				expected.buildTree(source, resolution);
+				expected.prune<Metric>(tolerance);
+
+				Quadtree built;
+				built.setPremultipliedAlpha(premultiplied);
+				built.buildPruned<Metric>(source, resolution, tolerance);
+
+				EXPECT_EQ(serialized(expected), serialized(built))
+					<< "content " << content << ", resolution " << resolution << ", tolerance " << tolerance;
+			}
+		}
+	}
+}
+
+}
+
+TEST(BuildPruned, MatchesBuildThenPruneRgb)
+{
+	expectBuildPrunedMatches<RgbMetric>(false);
+	expectBuildPrunedMatches<RgbMetric>(true);
+}
+
+TEST(BuildPruned, MatchesBuildThenPruneLuma)
+{
+	expectBuildPrunedMatches<LumaRgbMetric>(false);
+	expectBuildPrunedMatches<LumaRgbMetric>(true);
+}
+
+TEST(BuildPruned, MatchesBuildThenPruneYCbCr)
+{
+	expectBuildPrunedMatches<YCbCrMetric>(false);
+	expectBuildPrunedMatches<YCbCrMetric>(true);
+}
+
+TEST(BuildPruned, MatchesBuildThenPruneLab)
+{
+	expectBuildPrunedMatches<LabMetric>(false);
+	expectBuildPrunedMatches<LabMetric>(true);
+}
+
+TEST(Prune, PruneSizePredictsLeafCount)
+{
+	Quadtree tree(image(PHOTO, 64), 64);
+	for(int tolerance : tolerances)
+	{
+		Quadtree pruned(tree);
+		int predicted = pruned.pruneSize(tolerance);
+		pruned.prune(tolerance);
+		EXPECT_EQ(predicted, pruned.leafCount());
+	}
+}
+
+TEST(Prune, IdealPruneMeetsTheLeafBudget)
+{
+	Quadtree tree(image(PHOTO, 64), 64);
+	for(int leaves : { 1, 10, 100, 1000 })
+	{
+		int tolerance = tree.idealPrune(leaves);
+		EXPECT_LE(tree.pruneSize(tolerance), leaves);
+		if(tolerance > 0)
+		{
+			EXPECT_GT(tree.pruneSize(tolerance - 1), leaves);
+		}
+	}
+}
+
+TEST(Prune, FixedAndBasicTreesFindTheSameTolerance)
+{
+	PNG const source = image(PHOTO, 64, true);
+	Quadtree tree(source, 64);
+	FixedQuadtree<6> fixed(source);
+	BasicQuadtree<uint8_t, 4> basic(toBasicImage(source), 64);
+	for(int leaves : { 1, 10, 100, 1000 })
+	{
+		EXPECT_EQ(tree.idealPrune(leaves), fixed.idealPrune(leaves)) << leaves << " leaves";
+		EXPECT_EQ(tree.idealPrune(leaves), basic.idealPrune(leaves)) << leaves << " leaves";
+		EXPECT_EQ(tree.idealPrune<LabMetric>(leaves), fixed.idealPrune<LabMetric>(leaves)) << leaves << " leaves";
+	}
+}
+
+TEST(Prune, CopiesAreIsolated)
+{
+	Quadtree original(image(NOISE, 32), 32);
+	std::string const before = serialized(original);
+
+	Quadtree copy(original);
+	copy.prune(20000);
+	copy.clockwiseRotate();
+
+	EXPECT_EQ(before, serialized(original));
+	EXPECT_NE(serialized(original), serialized(copy));
+}
@@ -0,0 +1,97 @@
+/**
+ * @file test_quality.cpp
+ * Tests of Quadtree::quality and pruneQuality against measurements made
+ * on the decompressed image.
+ */
+
+#include "test_harness.h"
+
+#include <cmath>
+#include <cstdlib>
+
+#include "test_images.h"
+
+using namespace testimages;
+
+namespace
+{
+
+// mean squared error per channel and largest channel difference, over red, green and blue
+void measure(PNG const & source, PNG const & decoded, double & mse, int & maxError)
+{
+	double squared = 0;
+	maxError = 0;
+	for(size_t y = 0; y < decoded.height(); y++)
+	{
+		for(size_t x = 0; x < decoded.width(); x++)
+		{
+			RGBAPixel const & a = *source(x, y);
+			RGBAPixel const & b = *decoded(x, y);
+			int const differences[3] = { a.red - b.red, a.green - b.green, a.blue - b.blue };
+			for(int difference : differences)
+			{
+				squared += difference * difference;
+				maxError = std::max(maxError, std::abs(difference));
+			}
+		}
+	}
+	mse = squared / (3.0 * decoded.width() * decoded.height());
+}
+
+}
+
+TEST(Quality, AnUnprunedTreeIsExact)
+{
+	for(Content content : { FLAT, NOISE, PHOTO })
+	{
+		PNG const source = image(content, 64, true);
+		Quadtree tree(source, 64);
+		QuadtreeQuality quality = tree.quality(source, true);
+
+		EXPECT_EQ(64L * 64, quality.pixels);
+		EXPECT_EQ(0.0, quality.mse);
+		EXPECT_EQ(0, quality.maxError);
+		EXPECT_TRUE(std::isinf(quality.psnr) && quality.psnr > 0) << quality;
+		EXPECT_LT(std::fabs(quality.ssim - 1), 1e-9) << quality;
+	}
+}
+
+TEST(Quality, MatchesTheDecompressedImageAfterPruning)
+{
+	for(Content content : { GRADIENT, NOISE, PHOTO })
+	{
+		PNG const source = image(content, 64);
+		Quadtree const tree(source, 64);
+		for(int tolerance : { 100, 2000, 20000 })
+		{
+			Quadtree pruned(tree);
+			pruned.prune(tolerance);
+
+			double mse;
+			int maxError;
+			measure(source, pruned.decompress(), mse, maxError);
+
+			QuadtreeQuality quality = pruned.quality(source, true);
+			EXPECT_LT(std::fabs(quality.mse - mse), 1e-9) << quality << " vs mse " << mse;
+			EXPECT_EQ(maxError, quality.maxError);
+			if(mse > 0)
+			{
+				EXPECT_LT(std::fabs(quality.psnr - 10 * std::log10(255.0 * 255.0 / mse)), 1e-9);
+			}
+			EXPECT_LE(quality.ssim, 1.0);
+
+			// measuring a prune without doing it gives the same figures
+			QuadtreeQuality predicted = tree.pruneQuality(source, tolerance, true);
+			EXPECT_EQ(quality.mse, predicted.mse);
+			EXPECT_EQ(quality.maxError, predicted.maxError);
+			EXPECT_EQ(quality.ssim, predicted.ssim);
+		}
+	}
+}
+
+TEST(Quality, EmptyTreesAndSmallSourcesMeasureNothing)
+{
+	PNG const source = image(PHOTO, 32);
+	EXPECT_EQ(0L, Quadtree().quality(source).pixels);
+	EXPECT_EQ(0L, Quadtree(image(PHOTO, 64), 64).quality(source).pixels);
+}
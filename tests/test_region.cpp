@@ -0,0 +1,151 @@
+/**
+ * @file test_region.cpp
+ * Tests of Quadtree::regionAverage and regionStats against sums over the
+ * source pixels.
+ */
+
+#include "test_harness.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "test_images.h"
+
+using namespace testimages;
+
+namespace
+{
+
+// the statistics of the source pixels inside the rectangle, clipped to size x size
+QuadtreeRegionStats bruteForce(PNG const & source, int size, int x, int y, int width, int height)
+{
+	QuadtreeRegionStats result;
+	double sum[4] = {0, 0, 0, 0};
+	double squares[4] = {0, 0, 0, 0};
+	int low[4] = {255, 255, 255, 255};
+	int high[4] = {0, 0, 0, 0};
+	for(int j = std::max(y, 0); j < std::min(y + height, size); j++)
+	{
+		for(int i = std::max(x, 0); i < std::min(x + width, size); i++)
+		{
+			RGBAPixel const & pixel = *source(i, j);
+			int const values[4] = { pixel.red, pixel.green, pixel.blue, pixel.alpha };
+			for(int c = 0; c < 4; c++)
+			{
+				sum[c] += values[c];
+				squares[c] += (double) values[c] * values[c];
+				low[c] = std::min(low[c], values[c]);
+				high[c] = std::max(high[c], values[c]);
+			}
+			result.pixels++;
+		}
+	}
+
+	if(result.pixels == 0)
+		return result;
+
+	for(int c = 0; c < 4; c++)
+	{
+		result.mean[c] = sum[c] / result.pixels;
+		result.variance += squares[c] / result.pixels - result.mean[c] * result.mean[c];
+	}
+	result.minimum = RGBAPixel(low[0], low[1], low[2], low[3]);
+	result.maximum = RGBAPixel(high[0], high[1], high[2], high[3]);
+	return result;
+}
+
+int const rectangles[][4] = {
+	{0, 0, 64, 64}, {0, 0, 1, 1}, {13, 7, 1, 40}, {5, 9, 30, 17}, {31, 31, 2, 2},
+	{17, 33, 46, 29}, {-10, -3, 40, 80}, {60, 50, 20, 20}, {63, 63, 5, 5}
+};
+
+}
+
+TEST(Region, ExactStatsMatchTheSourcePixels)
+{
+	for(Content content : { GRADIENT, NOISE, PHOTO })
+	{
+		PNG const source = image(content, 64, true);
+		Quadtree tree;
+		tree.setExactSums(true);
+		tree.buildTree(source, 64);
+		tree.pruneByVariance(50);
+
+		// pruned leaves keep the sums of their pixels, so only cut leaves can differ; test on the full tree
+		Quadtree full;
+		full.setExactSums(true);
+		full.buildTree(source, 64);
+
+		for(auto const & rect : rectangles)
+		{
+			QuadtreeRegionStats expected = bruteForce(source, 64, rect[0], rect[1], rect[2], rect[3]);
+			QuadtreeRegionStats stats = full.regionStats(rect[0], rect[1], rect[2], rect[3]);
+
+			ASSERT_TRUE(stats.exact);
+			EXPECT_EQ(expected.pixels, stats.pixels);
+			for(int c = 0; c < 4; c++)
+			{
+				EXPECT_LT(std::fabs(expected.mean[c] - stats.mean[c]), 1e-9)
+					<< "channel " << c << " of " << rect[0] << ", " << rect[1] << ", " << rect[2] << ", " << rect[3];
+			}
+			EXPECT_EQ(expected.minimum, stats.minimum);
+			EXPECT_EQ(expected.maximum, stats.maximum);
+			EXPECT_LT(std::fabs(expected.variance - stats.variance), 1e-6);
+
+			// the average is the truncated mean
+			RGBAPixel average = full.regionAverage(rect[0], rect[1], rect[2], rect[3]);
+			EXPECT_EQ(RGBAPixel((int) expected.mean[0], (int) expected.mean[1], (int) expected.mean[2],
+								(int) expected.mean[3]), average);
+
+			// a rectangle covering whole pruned leaves sees the same pixels
+			if(rect[2] == 64)
+			{
+				QuadtreeRegionStats pruned = tree.regionStats(rect[0], rect[1], rect[2], rect[3]);
+				EXPECT_LT(std::fabs(pruned.mean[0] - stats.mean[0]), 1e-9);
+				EXPECT_LT(std::fabs(pruned.variance - stats.variance), 1e-6);
+			}
+		}
+	}
+}
+
+TEST(Region, AveragesOutsideExactModeUseTheStoredColors)
+{
+	Quadtree tree(image(PHOTO, 64), 64);
+	tree.prune(3000);
+	PNG const decoded = tree.decompress();
+
+	// the stored averages truncate once per level, so the mean is off by less than one per level
+	for(auto const & rect : rectangles)
+	{
+		QuadtreeRegionStats expected = bruteForce(decoded, 64, rect[0], rect[1], rect[2], rect[3]);
+		QuadtreeRegionStats stats = tree.regionStats(rect[0], rect[1], rect[2], rect[3]);
+		EXPECT_FALSE(stats.exact);
+		EXPECT_EQ(expected.pixels, stats.pixels);
+		for(int c = 0; c < 4; c++)
+		{
+			EXPECT_LT(std::fabs(expected.mean[c] - stats.mean[c]), 6.0);
+		}
+	}
+
+	// a single pixel is the color of its leaf, and the whole tree that of the root
+	for(int i = 0; i < 64; i += 7)
+	{
+		EXPECT_EQ(*decoded(i, 63 - i), tree.regionAverage(i, 63 - i, 1, 1));
+	}
+	EXPECT_EQ(tree.regionAverage(0, 0, 64, 64), tree.regionAverage(-5, -5, 100, 100));
+}
+
+TEST(Region, EmptyAndOutsideRectanglesHaveNoPixels)
+{
+	Quadtree tree(image(PHOTO, 32), 32);
+	int const misses[][4] = { {0, 0, 0, 10}, {5, 5, 10, 0}, {3, 3, -4, 5}, {32, 0, 5, 5}, {0, 32, 5, 5},
+							  {-8, -8, 8, 8}, {100, 100, 1, 1} };
+	for(auto const & rect : misses)
+	{
+		EXPECT_EQ(0L, tree.regionStats(rect[0], rect[1], rect[2], rect[3]).pixels);
+		EXPECT_EQ(RGBAPixel(), tree.regionAverage(rect[0], rect[1], rect[2], rect[3]));
+	}
+
+	EXPECT_EQ(0L, Quadtree().regionStats(0, 0, 10, 10).pixels);
+	EXPECT_EQ(RGBAPixel(), Quadtree().regionAverage(0, 0, 10, 10));
+}
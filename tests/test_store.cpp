@@ -0,0 +1,117 @@
+/**
+ * @file test_store.cpp
+ * Tests of the QuadtreeStore, which deduplicates subtrees across trees.
+ */
+
+#include "test_harness.h"
+
+#include <memory>
+
+#include "../quadtree_store.h"
+#include "test_images.h"
+
+using namespace testimages;
+
+namespace
+{
+
+// the source image with its right half replaced, so the left halves' subtrees are shared
+PNG withRightHalf(PNG const & source, Content content)
+{
+	PNG result(source);
+	PNG const other = image(content, source.width(), false, 99);
+	for(size_t y = 0; y < source.height(); y++)
+		for(size_t x = source.width() / 2; x < source.width(); x++)
+			*result(x, y) = *other(x, y);
+	return result;
+}
+
+}
+
+TEST(Store, CommonSubtreesAreStoredOnce)
+{
+	PNG const first = image(NOISE, 32);
+	PNG const second = withRightHalf(first, NOISE);
+	Quadtree a(first, 32);
+	Quadtree b(second, 32);
+
+	QuadtreeStore store;
+	store.intern(a);
+	size_t const alone = store.size();
+	EXPECT_EQ((size_t) a.nodeCount(), alone);
+
+	// b adds only its root and its right half; its left half is a's
+	store.intern(b);
+	size_t const quarter = (b.nodeCount() - 1) / 4;
+	EXPECT_EQ(alone + 1 + 2 * quarter, store.size());
+
+	// interning changes no image, and interning again adds nothing
+	EXPECT_TRUE(a.decompress() == first);
+	EXPECT_TRUE(b.decompress() == second);
+	store.intern(a);
+	store.intern(b);
+	EXPECT_EQ(alone + 1 + 2 * quarter, store.size());
+}
+
+TEST(Store, RepeatedContentWithinATreeIsShared)
+{
+	Quadtree tree(image(FLAT, 64), 64);
+	QuadtreeStore store;
+	store.intern(tree);
+
+	// one distinct node per level of a flat image
+	EXPECT_EQ(7u, store.size());
+	EXPECT_EQ(64 * 64, tree.leafCount());
+	EXPECT_TRUE(tree.decompress() == image(FLAT, 64));
+}
+
+TEST(Store, EditingAStoredTreeLeavesTheOthersAlone)
+{
+	PNG const first = image(PHOTO, 32);
+	Quadtree a(first, 32);
+	Quadtree b(first, 32);
+
+	QuadtreeStore store;
+	store.intern(a);
+	size_t const alone = store.size();
+	store.intern(b);
+	EXPECT_EQ(alone, store.size());
+
+	std::string const before = serialized(a);
+	b.prune(3000);
+	b.rotate(1);
+	EXPECT_EQ(before, serialized(a));
+	EXPECT_TRUE(a.decompress() == first);
+
+	PNG edited(first);
+	*edited(3, 5) = RGBAPixel(1, 2, 3);
+	a.updateRegion(edited, 3, 5, 1, 1);
+	EXPECT_TRUE(a.decompress() == edited);
+	EXPECT_NE(serialized(a), before);
+}
+
+TEST(Store, PurgeDropsTheNodesOfDestroyedTrees)
+{
+	QuadtreeStore store;
+	Quadtree kept(image(PHOTO, 32), 32);
+	store.intern(kept);
+	size_t const keptNodes = store.size();
+
+	{
+		std::unique_ptr<Quadtree> gone(new Quadtree(image(NOISE, 32), 32));
+		store.intern(*gone);
+		EXPECT_GT(store.size(), keptNodes);
+
+		// nothing is dropped while the tree still uses its nodes
+		store.purge();
+		EXPECT_GT(store.size(), keptNodes);
+	}
+
+	store.purge();
+	EXPECT_EQ(keptNodes, store.size());
+	EXPECT_TRUE(kept.decompress() == image(PHOTO, 32));
+
+	store.clear();
+	EXPECT_EQ(0u, store.size());
+	EXPECT_TRUE(kept.decompress() == image(PHOTO, 32));
+}
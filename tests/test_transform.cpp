@@ -0,0 +1,119 @@
+/**
+ * @file test_transform.cpp
+ * Tests of Quadtree::rotate, flipHorizontal and flipVertical against the
+ * same transforms applied to the pixels.
+ */
+
+#include "test_harness.h"
+
+#include "test_images.h"
+
+using namespace testimages;
+
+namespace
+{
+
+// the image turned clockwise by quarterTurns * 90 degrees
+PNG rotated(PNG const & source, int quarterTurns)
+{
+	PNG result(source);
+	for(int turn = 0; turn < ((quarterTurns % 4) + 4) % 4; turn++)
+	{
+		PNG const before(result);
+		int size = before.width();
+		for(int y = 0; y < size; y++)
+			for(int x = 0; x < size; x++)
+				*result(size - 1 - y, x) = *before(x, y);
+	}
+	return result;
+}
+
+PNG mirrored(PNG const & source, bool horizontal)
+{
+	PNG result(source);
+	int size = source.width();
+	for(int y = 0; y < size; y++)
+		for(int x = 0; x < size; x++)
+			*result(x, y) = horizontal ? *source(size - 1 - x, y) : *source(x, size - 1 - y);
+	return result;
+}
+
+// a pruned tree of an image with no symmetry, so every transform shows
+Quadtree asymmetricTree()
+{
+	Quadtree tree(image(PHOTO, 64, true), 64);
+	tree.prune(1500);
+	return tree;
+}
+
+}
+
+TEST(Transform, RotateMatchesTheRotatedImage)
+{
+	Quadtree const original = asymmetricTree();
+	PNG const source = original.decompress();
+	ASSERT_TRUE(original.leafCount() < 64 * 64);
+
+	for(int turns = -5; turns <= 5; turns++)
+	{
+		Quadtree tree(original);
+		tree.rotate(turns);
+		EXPECT_TRUE(tree.decompress() == rotated(source, turns)) << turns << " turns";
+		EXPECT_EQ(original.leafCount(), tree.leafCount());
+	}
+
+	Quadtree clockwise(original);
+	clockwise.clockwiseRotate();
+	Quadtree once(original);
+	once.rotate(1);
+	EXPECT_TRUE(clockwise == once);
+	EXPECT_FALSE(once == original);
+}
+
+TEST(Transform, FlipsMatchTheMirroredImage)
+{
+	Quadtree const original = asymmetricTree();
+	PNG const source = original.decompress();
+
+	Quadtree horizontal(original);
+	horizontal.flipHorizontal();
+	EXPECT_TRUE(horizontal.decompress() == mirrored(source, true));
+
+	Quadtree vertical(original);
+	vertical.flipVertical();
+	EXPECT_TRUE(vertical.decompress() == mirrored(source, false));
+
+	// both flips are a half turn
+	horizontal.flipVertical();
+	Quadtree half(original);
+	half.rotate(2);
+	EXPECT_TRUE(horizontal == half);
+}
+
+TEST(Transform, FullTurnsAndDoubleFlipsAreIdentities)
+{
+	Quadtree const original = asymmetricTree();
+	std::string const before = serialized(original);
+
+	Quadtree tree(original);
+	tree.rotate(4);
+	EXPECT_EQ(before, serialized(tree));
+
+	for(int turn = 0; turn < 4; turn++)
+		tree.clockwiseRotate();
+	EXPECT_EQ(before, serialized(tree));
+
+	tree.flipHorizontal();
+	tree.flipHorizontal();
+	EXPECT_EQ(before, serialized(tree));
+
+	tree.flipVertical();
+	tree.flipVertical();
+	EXPECT_EQ(before, serialized(tree));
+
+	// transforming an empty tree leaves it empty
+	Quadtree empty;
+	empty.rotate(1);
+	empty.flipHorizontal();
+	EXPECT_EQ(0, empty.getResolution());
+}
@@ -0,0 +1,162 @@
+/**
+ * @file test_traversal.cpp
+ * Tests of QuadtreeLeaves and the QuadtreeTraversal walks.
+ */
+
+#include "test_harness.h"
+
+#include <vector>
+
+#include "../quadtree_store.h"
+#include "../quadtree_traversal.h"
+#include "test_images.h"
+
+using namespace testimages;
+
+namespace
+{
+
+// paints the tree's leaves into an image, counting how often each pixel is covered
+PNG paintLeaves(Quadtree const & tree, std::vector<int> & coverage)
+{
+	int const size = tree.getResolution();
+	PNG result(size, size);
+	coverage.assign((size_t) size * size, 0);
+	for(QuadtreeBlock const & leaf : QuadtreeLeaves(tree))
+	{
+		for(int y = leaf.y; y < leaf.y + leaf.resolution; y++)
+		{
+			for(int x = leaf.x; x < leaf.x + leaf.resolution; x++)
+			{
+				*result(x, y) = leaf.element;
+				coverage[(size_t) y * size + x]++;
+			}
+		}
+	}
+	return result;
+}
+
+// checks that the leaves tile the square once and decompress like the tree
+void expectLeavesTile(Quadtree const & tree)
+{
+	std::vector<int> coverage;
+	PNG const painted = paintLeaves(tree, coverage);
+	for(size_t i = 0; i < coverage.size(); i++)
+	{
+		ASSERT_EQ(1, coverage[i]) << "pixel " << i;
+	}
+	EXPECT_TRUE(painted == tree.decompress());
+}
+
+}
+
+TEST(Traversal, LeavesTileTheSquareAndMatchDecompress)
+{
+	for(Content content : { FLAT, GRADIENT, PHOTO })
+	{
+		Quadtree tree(image(content, 64, true), 64);
+		expectLeavesTile(tree);
+
+		tree.prune(2000);
+		expectLeavesTile(tree);
+
+		int leaves = 0;
+		for(QuadtreeLeaves::iterator it = QuadtreeLeaves(tree).begin(); it != QuadtreeLeaves(tree).end(); it++)
+		{
+			EXPECT_TRUE(it->leaf);
+			leaves++;
+		}
+		EXPECT_EQ(tree.leafCount(), leaves);
+	}
+
+	Quadtree empty;
+	EXPECT_TRUE(QuadtreeLeaves(empty).begin() == QuadtreeLeaves(empty).end());
+}
+
+TEST(Traversal, PreorderVisitsParentsFirstAndCanSkipChildren)
+{
+	Quadtree tree(image(PHOTO, 32), 32);
+	tree.prune(500);
+
+	// every node once, each after its parent
+	int nodes = 0;
+	int leaves = 0;
+	QuadtreeTraversal::preorder(tree, [&](QuadtreeBlock const & block) {
+		nodes++;
+		if(block.leaf)
+			leaves++;
+		EXPECT_EQ(32 >> block.depth, block.resolution);
+	});
+	EXPECT_EQ(tree.nodeCount(), nodes);
+	EXPECT_EQ(tree.leafCount(), leaves);
+
+	// returning false below depth 2 visits the root, its children and their children only
+	int visited = 0;
+	QuadtreeTraversal::preorder(tree, [&](QuadtreeBlock const & block) {
+		visited++;
+		EXPECT_LE(block.depth, 2);
+		return block.depth < 2;
+	});
+	EXPECT_EQ(1 + 4 + 16, visited);
+
+	// returning false for the northwest quadrant skips its subtree
+	int northwest = 0;
+	QuadtreeTraversal::preorder(tree, [&](QuadtreeBlock const & block) {
+		if(block.depth > 0 && block.x < 16 && block.y < 16)
+			northwest++;
+		return !(block.depth == 1 && block.x == 0 && block.y == 0);
+	});
+	EXPECT_EQ(1, northwest);
+}
+
+TEST(Traversal, PostorderVisitsChildrenFirst)
+{
+	PNG const source = image(PHOTO, 32);
+	Quadtree tree(source, 32);
+	tree.prune(500);
+
+	// each node is reached once its four children are: count the children seen at each depth so far
+	std::vector<int> pending(7, 0);
+	int nodes = 0;
+	QuadtreeTraversal::postorder(tree, [&](QuadtreeBlock const & block) {
+		nodes++;
+		if(!block.leaf)
+		{
+			EXPECT_EQ(4, pending[block.depth + 1]) << "node at " << block.x << ", " << block.y;
+			pending[block.depth + 1] = 0;
+		}
+		pending[block.depth]++;
+	});
+	EXPECT_EQ(tree.nodeCount(), nodes);
+	EXPECT_EQ(1, pending[0]);
+}
+
+TEST(Traversal, SharedSubtreesAreWalkedAtEveryPlace)
+{
+	Quadtree tree(image(PHOTO, 64), 64);
+	tree.prune(1000);
+
+	// a copy shares every node with the tree
+	Quadtree const copy(tree);
+	expectLeavesTile(copy);
+	int nodes = 0;
+	QuadtreeTraversal::postorder(copy, [&](QuadtreeBlock const &) {
+		nodes++;
+	});
+	EXPECT_EQ(tree.nodeCount(), nodes);
+
+	// a flat image in a store is one node per level, visited at all its places
+	Quadtree flat(image(FLAT, 64), 64);
+	QuadtreeStore store;
+	store.intern(flat);
+	store.intern(tree);
+	expectLeavesTile(flat);
+	expectLeavesTile(tree);
+
+	int leaves = 0;
+	QuadtreeTraversal::preorder(flat, [&](QuadtreeBlock const & block) {
+		if(block.leaf)
+			leaves++;
+	});
+	EXPECT_EQ(64 * 64, leaves);
+}
@@ -0,0 +1,76 @@
+/**
+ * @file test_update.cpp
+ * Tests of Quadtree::updateRegion against a rebuild from the edited image.
+ */
+
+#include "test_harness.h"
+
+#include "test_images.h"
+
+using namespace testimages;
+
+namespace
+{
+
+void paint(PNG & image, int x, int y, int width, int height, uint32_t seed)
+{
+	XorShift rng(seed);
+	for(int j = y; j < y + height; j++)
+		for(int i = x; i < x + width; i++)
+			*image(i, j) = RGBAPixel(rng.next() & 0xff, rng.next() & 0xff, rng.next() & 0xff, rng.next() & 0xff);
+}
+
+}
+
+TEST(UpdateRegion, MatchesRebuild)
+{
+	int const blocks[][4] = { {0, 0, 64, 64}, {5, 9, 1, 1}, {16, 16, 16, 16}, {3, 40, 50, 7}, {63, 0, 1, 64} };
+	for(bool exact : { false, true })
+	{
+		for(auto const & block : blocks)
+		{
+			PNG source = image(PHOTO, 64);
+			Quadtree tree;
+			tree.setExactSums(exact);
+			tree.buildTree(source, 64);
+
+			paint(source, block[0], block[1], block[2], block[3], block[0] * 131 + block[1]);
+			tree.updateRegion(source, block[0], block[1], block[2], block[3]);
+
+			Quadtree rebuilt;
+			rebuilt.setExactSums(exact);
+			rebuilt.buildTree(source, 64);
+			EXPECT_EQ(serialized(rebuilt), serialized(tree));
+			EXPECT_EQ(rebuilt.hash(), tree.hash());
+		}
+	}
+}
+
+TEST(UpdateRegion, SplitsPrunedLeavesItTouches)
+{
+	PNG source = image(FLAT, 64);
+	Quadtree tree(source, 64);
+	tree.prune(0);
+	ASSERT_EQ(1, tree.leafCount());
+
+	paint(source, 10, 20, 3, 3, 7);
+	tree.updateRegion(source, 10, 20, 3, 3);
+
+	// the unedited parts keep the flat color; the edited pixels are exact
+	EXPECT_TRUE(tree.decompress() == source);
+}
+
+TEST(UpdateRegion, ClipsToTheTreeAndLeavesCopiesAlone)
+{
+	PNG source = image(PHOTO, 64);
+	Quadtree tree(source, 32);
+	Quadtree copy(tree);
+	std::string const before = serialized(copy);
+
+	paint(source, 20, 20, 40, 40, 11);
+	tree.updateRegion(source, 20, 20, 40, 40);
+
+	Quadtree rebuilt(source, 32);
+	EXPECT_EQ(serialized(rebuilt), serialized(tree));
+	EXPECT_EQ(before, serialized(copy));
+}
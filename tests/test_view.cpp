@@ -0,0 +1,80 @@
+/**
+ * @file test_view.cpp
+ * Tests of QuadtreeView against the prune it simulates.
+ */
+
+#include "test_harness.h"
+
+#include "../quadtree_view.h"
+#include "test_images.h"
+
+using namespace testimages;
+
+namespace
+{
+
+// a view must show exactly what prune<Metric> leaves, and leave the tree alone
+template <class Metric>
+void expectViewMatchesPrune(bool premultiplied)
+{
+	for(Content content : { GRADIENT, NOISE, PHOTO })
+	{
+		Quadtree tree;
+		tree.setPremultipliedAlpha(premultiplied);
+		tree.buildTree(image(content, 32, premultiplied), 32);
+		std::string const before = serialized(tree);
+
+		for(int tolerance : { 0, 500, 5000, 40000 })
+		{
+			QuadtreeView view = QuadtreeView::withTolerance<Metric>(tree, tolerance);
+			Quadtree pruned(tree);
+			pruned.prune<Metric>(tolerance);
+
+			EXPECT_EQ(tolerance, view.getTolerance());
+			EXPECT_EQ(pruned.leafCount(), view.leafCount()) << "content " << content << ", tolerance " << tolerance;
+			EXPECT_EQ(tree.pruneSize<Metric>(tolerance), view.leafCount());
+			EXPECT_TRUE(pruned.decompress() == view.decompress()) << "content " << content << ", tolerance " << tolerance;
+		}
+
+		QuadtreeView budget = QuadtreeView::withLeafBudget<Metric>(tree, 40);
+		EXPECT_EQ(tree.idealPrune<Metric>(40), budget.getTolerance());
+		EXPECT_LE(budget.leafCount(), 40);
+		EXPECT_EQ(before, serialized(tree));
+	}
+}
+
+}
+
+TEST(View, MatchesPruneRgb)
+{
+	expectViewMatchesPrune<RgbMetric>(false);
+	expectViewMatchesPrune<RgbMetric>(true);
+
+	// the constructor measures with RgbMetric, as prune() does
+	Quadtree tree(image(PHOTO, 32), 32);
+	QuadtreeView view(tree, 1000);
+	EXPECT_EQ(tree.pruneSize(1000), view.leafCount());
+}
+
+TEST(View, MatchesPruneLuma)
+{
+	expectViewMatchesPrune<LumaRgbMetric>(false);
+	expectViewMatchesPrune<LumaRgbMetric>(true);
+}
+
+TEST(View, MatchesPruneYCbCr)
+{
+	expectViewMatchesPrune<YCbCrMetric>(false);
+	expectViewMatchesPrune<YCbCrMetric>(true);
+}
+
+TEST(View, MatchesPruneLab)
+{
+	expectViewMatchesPrune<LabMetric>(false);
+	expectViewMatchesPrune<LabMetric>(true);
+
+	// a coarser metric collapses different nodes, so the views differ
+	Quadtree tree(image(PHOTO, 32), 32);
+	EXPECT_NE(QuadtreeView::withTolerance<LabMetric>(tree, 2000).leafCount(),
+			  QuadtreeView::withTolerance<RgbMetric>(tree, 2000).leafCount());
+}